@@ -0,0 +1,107 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Checkpoints of the SSFM step loop, for fiberResume
+ */
+
+#ifndef SIMULIB_CHECKPOINT_HPP
+#define SIMULIB_CHECKPOINT_HPP
+
+#include "Fiber.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace SimuLib {
+
+/**
+ * Position of the SSFM step loop after a step, enough to continue it.
+ */
+struct SsfmState {
+    double zprop            = 0;      // running distance [m] of the step loop: the end of the next step in SSFM
+    double dz               = 0;      // length [m] of the next step of SSFM, 0 with the local error method
+    double dzNominal        = 0;      // next step before the rounding to fiber.stepGrid [m]
+    double dzs              = 0;      // symmetric step contribution [m]
+    double dzsNominal       = 0;      // symmetric step before the rounding to fiber.stepGrid [m]
+    double firstDz          = 0;      // length [m] of the first step
+    double lastDz           = 0;      // length [m] of the last step of RK4IP, whose Kerr increment starts the next one
+    unsigned long ncycle    = 0;      // steps done
+    bool halfStep           = false;  // the first half linear step of the symmetric scheme is still to do
+    unsigned long nFft      = 0;      // counters of the workspace at the end of the step
+    unsigned long nIfft     = 0;
+    unsigned long nRejected = 0;
+    double localError       = 0;
+};
+
+namespace HARDWARE_TYPE {
+
+/**
+ * Checkpoint file of a fiber: the waveplates, then two slots written in turn, so that
+ * the last complete checkpoint survives a process killed while writing the next one.
+ * The step loop only copies the field; a background thread writes it to the
+ * memory-mapped file.
+ */
+class Checkpoint {
+public:
+    // Maps fiber.checkpointFile for ROWS x COLS fields and writes the waveplates of LINEAR.
+    // RESUMED is the checkpoint the propagation continues from, if any: its file keeps its
+    // checkpoints, otherwise the ones of an earlier run are forgotten.
+    Checkpoint(const Fiber &fiber, Index rows, Index cols, const Linear *linear, const SsfmState *resumed = nullptr);
+
+    // Waits for the last checkpoint to be written
+    ~Checkpoint();
+
+    // True if a checkpoint is due after the step ending at ZPROP, the NCYCLE-th one
+    bool isDue(double zprop, unsigned long ncycle);
+
+    // Copies the field (or spectrum) and the counters of the workspace and returns; the writing is in background
+    void save(SsfmState state, const MatrixXcd &field, const SsfmWorkspace &workspace);
+
+    void save(SsfmState state, const MatrixXcf &field, const SsfmWorkspace &workspace);
+
+private:
+    void save(SsfmState state, const SsfmWorkspace &workspace);
+    void write();
+
+    unsigned long everySteps;  // fiber.checkpointSteps
+    double everyDistance;      // fiber.checkpointDistance [m]
+    double nextDistance;       // distance [m] of the next checkpoint by distance
+
+    int file       = -1;
+    char *map      = nullptr;  // the mapped file
+    size_t mapSize = 0;
+    size_t slotOffset;         // offset of the first slot
+    size_t slotSize;           // bytes of a slot
+
+    MatrixXcd snapshot;  // copy of the field being written
+    SsfmState snapshotState;
+    unsigned long sequence;  // number of the last checkpoint
+
+    std::thread writer;
+    std::mutex guard;
+    std::condition_variable changed;
+    bool isPending = false;  // a snapshot waits to be written
+    bool isStopped = false;
+};
+
+// Reads the last complete checkpoint of fiber.checkpointFile into STATE, FIELD (ROWS x COLS)
+// and the waveplates of LINEAR
+void loadCheckpoint(const Fiber &fiber, Index rows, Index cols, Linear *linear, SsfmState &state, MatrixXcd &field);
+
+}  // namespace HARDWARE_TYPE
+
+}  // namespace SimuLib
+
+#endif  // SIMULIB_CHECKPOINT_HPP
@@ -47,6 +47,10 @@ struct Gstate {
 
 void initGstate(double Nsamp, double Fs);
 
+void setNumThreads(int n);
+
+int getNumThreads();
+
 }  // namespace SimuLib
 
 #endif  // OPTICALAB_COMMON_TYPES_H
@@ -0,0 +1,96 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Fields distributed over the processes of MPI
+ */
+
+#ifndef SIMULIB_DISTRIBUTED_HPP
+#define SIMULIB_DISTRIBUTED_HPP
+
+#ifdef SIMULIB_USE_MPI
+
+// The C interface only: the C++ bindings of MPI would be pulled into all the objects of the library
+#ifndef OMPI_SKIP_MPICXX
+#define OMPI_SKIP_MPICXX
+#endif
+#ifndef MPICH_SKIP_MPICXX
+#define MPICH_SKIP_MPICXX
+#endif
+#include <mpi.h>
+
+namespace SimuLib {
+
+namespace HARDWARE_TYPE {
+
+/**
+ * Four-step FFT of a field of N = N1 * N2 samples whose slabs are held by the ranks
+ * of a communicator: rank r holds the N / P samples from r * N / P, one column per
+ * polarization. Seen as an N1 x N2 matrix, a slab is N2 / P of its columns: a first
+ * transpose by MPI_Alltoall gives each rank N1 / P rows, transformed by FFTs of
+ * length N2 and multiplied by the twiddles, and a second one N2 / P columns again,
+ * transformed by FFTs of length N1. The spectrum is left in this transposed order,
+ * sample i = k1 + N1 * j of rank r holding frequency index k = r * N2 / P + j +
+ * N2 * k1 (frequencies gives them); the inverse takes it back to the slabs of samples.
+ * The FFTs of the ranks are the batched fftCol of the columns.
+ */
+class DistributedFft {
+public:
+    // Plan of a field of LENGTH samples at SAMPFREQ [GHz] over the ranks of COMM
+    DistributedFft(Index length, double sampFreq, MPI_Comm comm = MPI_COMM_WORLD);
+
+    // Slab of samples to the slab of the transposed spectrum, and back, of all the columns
+    void forward(const MatrixXcd &field, MatrixXcd &spectrum);
+
+    void inverse(const MatrixXcd &spectrum, MatrixXcd &field);
+
+    // Frequencies [GHz] of the local spectrum, as gstate.FN for the whole field
+    const VectorXd &frequencies() const { return frequency; }
+
+    Index length() const { return n; }                       // samples of the whole field
+    Index localLength() const { return n / size; }           // samples of a slab
+    Index firstSample() const { return rank * (n / size); }  // first sample of the local slab
+    double samplingRate() const { return sampFreq; }         // [GHz]
+    int getRank() const { return rank; }
+    int getSize() const { return size; }
+
+    double transposeTime = 0;  // time [s] of the transposes since the plan was made
+
+private:
+    // EXCHANGE sends the blocks of sendBuffer to the ranks, the blocks of the ranks landing in receiveBuffer
+    void exchange();
+
+    MPI_Comm comm;
+    int rank;
+    int size;
+    Index n;
+    double sampFreq;
+    Index n1;              // rows of the matrix view, length of the second FFTs
+    Index n2;              // columns of the matrix view, length of the first FFTs
+    MatrixXcd twiddle;     // exp(-2i*pi*n1*k2/N) of the local rows, N2 x N1/P
+    VectorXd frequency;    // [GHz] of the local spectrum
+    MatrixXcd rows;        // N2 x (N1/P * columns): the local rows
+    MatrixXcd rowsOut;     // their FFTs
+    MatrixXcd columns;     // N1 x (N2/P * columns): the local columns
+    MatrixXcd columnsOut;  // their FFTs
+    vector<complex<double>> sendBuffer;
+    vector<complex<double>> receiveBuffer;
+};
+
+}  // namespace HARDWARE_TYPE
+
+}  // namespace SimuLib
+
+#endif  // SIMULIB_USE_MPI
+
+#endif  // SIMULIB_DISTRIBUTED_HPP
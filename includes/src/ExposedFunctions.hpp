@@ -23,7 +23,10 @@
 #ifndef EXPOSEDFUNCTIONS_HPP
 #define EXPOSEDFUNCTIONS_HPP
 
+#include "Distributed.hpp"
+#include "GnModel.hpp"
 #include "IQModulator.h"
+#include "Multimode.hpp"
 #include "Mzmodulator.hpp"
 #include "RxFrontend.h"
 
@@ -38,6 +41,21 @@ tuple<MatrixXcd, double> electricAmplifier(MatrixXcd signal, double gainEA, doub
 tuple<double, MatrixXcd> evaluateEye(MatrixXi pattern, const MatrixXcd &signal, double symbolRate, const string &modFormat, const Fiber &fiber);
 
 tuple<Out, E> fiberTransmit(E &e, Fiber fiber);
+Out fiberTransmit(E &e, Fiber fiber, SsfmWorkspace &workspace);
+Out fiberResume(E &e, Fiber fiber, SsfmWorkspace &workspace);
+Out fiberGradient(E &e, Fiber fiber, const LossFunction &loss, FiberGradient &gradient, SsfmWorkspace &workspace, unsigned checkpoints = 32);
+
+Out linkTransmit(E &e, const Link &link, SsfmWorkspace &workspace);
+Out linkParareal(E &e, const Link &link, const PararealOption &option, SsfmWorkspace &workspace);
+Out digitalBackpropagation(E &e, const Link &link, const DbpOption &option, SsfmWorkspace &workspace);
+
+GnOut gnModel(const Link &link, const GnSignal &signal);
+
+Out multimodeTransmit(E &e, const MultimodeFiber &fiber, SsfmWorkspace &workspace);
+
+#ifdef SIMULIB_USE_MPI
+Out distributedTransmit(E &e, const Fiber &fiber, DistributedFft &fft);
+#endif
 
 E iqModulator(E e, VectorXcd modSig, IqOption option);
 
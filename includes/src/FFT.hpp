@@ -25,6 +25,12 @@
 
 namespace SimuLib {
 
+struct FFTCacheStats {
+    unsigned long hits   = 0;  // plan lookups served from the cache
+    unsigned long misses = 0;  // plan lookups that had to build a new plan
+    unsigned long plans  = 0;  // plans currently held by the cache
+};
+
 namespace CPU {
 
 VectorXcd fft(const VectorXcd &in);
@@ -39,6 +45,37 @@ MatrixXcd fftCol(const MatrixXcd &in);
 
 MatrixXcd ifftCol(const MatrixXcd &in);
 
+// Column-wise transforms into a preallocated output of the same size as the input
+void fftCol(const MatrixXcd &in, MatrixXcd &out);
+
+void ifftCol(const MatrixXcd &in, MatrixXcd &out);
+
+// Single-precision column-wise transforms, with plans of their own
+void fftCol(const MatrixXcf &in, MatrixXcf &out);
+
+void ifftCol(const MatrixXcf &in, MatrixXcf &out);
+
+// Build the forward and inverse plans of the given length and batch ahead of time
+void warmFFTCache(Index length, Index batch = 1);
+
+// Hit/miss counters of the FFT plan cache
+FFTCacheStats fftCacheStats();
+
+// Release all cached plans and reset the counters
+void clearFFTCache();
+
+// Names of the FFT backends built in
+vector<string> fftBackends();
+
+// Select the backend of the next plans, clearing the plan cache
+void setFFTBackend(const string &name);
+
+// Name of the selected backend
+string fftBackend();
+
+// Best time [s] of a forward and inverse pair of each backend, the fastest first
+vector<pair<string, double>> rankFFTBackends(Index length, Index batch = 1);
+
 }  // namespace CPU
 
 namespace GPU {
@@ -55,6 +92,20 @@ MatrixXcd fftCol(const MatrixXcd &in);
 
 MatrixXcd ifftCol(const MatrixXcd &in);
 
+// Column-wise transforms into a preallocated output of the same size as the input
+void fftCol(const MatrixXcd &in, MatrixXcd &out);
+
+void ifftCol(const MatrixXcd &in, MatrixXcd &out);
+
+// Build the forward and inverse plans of the given length and batch ahead of time
+void warmFFTCache(Index length, Index batch = 1);
+
+// Hit/miss counters of the FFT plan cache
+FFTCacheStats fftCacheStats();
+
+// Release all cached plans and reset the counters
+void clearFFTCache();
+
 }  // namespace GPU
 
 }  // namespace SimuLib
@@ -24,7 +24,9 @@
 #define OPTICALAB_FIBER_TYPES_H
 
 #include "LaserSource.hpp"
+#include <cmath>
 #include <complex>
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -35,11 +37,13 @@ namespace SimuLib {
 struct Linear {
     bool is_scalar;
     bool is_unique;
+
+    virtual ~Linear() = default;  // owned through Linear pointers
 };
 
 struct NonScalarLinear : Linear {
-    vector<MatrixXcd> matin;
-    MatrixXd db;
+    vector<MatrixXcd> matin;  // 2x2 unitary matrix of the axes of each waveplate
+    MatrixXd db;              // birefringence [rad/m] of the two axes, one row per waveplate
 };
 
 struct ScalarLinear : Linear {
@@ -47,10 +51,209 @@ struct ScalarLinear : Linear {
     double db;
 };
 
+/**
+ * The field at a distance along the fiber, recorded by the field monitors.
+ */
+struct MonitorRecord {
+    double z;            // position [m] of the field
+    unsigned long step;  // steps done
+    double peakPower;    // peak power [mW], summed over the polarizations of each field
+    RowVectorXd energy;  // energy [pJ] of each column of the field
+    MatrixXd power;      // power profile [mW] of each column, one sample every fiber.monitorDecimation
+    MatrixXd spectrum;   // squared magnitude of the spectrum of each column, ordered as gstate.FN; empty if not asked at z
+};
+
+/**
+ * Cumulative time and calls of a phase of the SSFM.
+ */
+struct SsfmPhase {
+    unsigned long long time = 0;  // [ns]
+    unsigned long count     = 0;  // calls
+
+    SsfmPhase &operator+=(const SsfmPhase &other) {
+        time += other.time;
+        count += other.count;
+        return *this;
+    }
+};
+
+/**
+ * Where the time of the SSFM goes. The dispersion phase includes the exponentials
+ * of its cache misses; the other phases do not overlap.
+ */
+struct SsfmProfile {
+    SsfmPhase fft;          // forward FFTs of the field (all columns at once)
+    SsfmPhase ifft;         // inverse FFTs of the field
+    SsfmPhase dispersion;   // linear steps on the spectrum: products by the dispersion operators and the waveplate rotations
+    SsfmPhase exponential;  // evaluations of exp(-i*betat*dz) on dispersion cache misses
+    SsfmPhase nonlinear;    // nonlinear steps, with their peak power
+    SsfmPhase stepControl;  // step size: first and next step, local error of the "lem" step update
+    SsfmPhase checkStep;    // splits of the steps over the waveplates (CheckStep)
+
+    SsfmProfile &operator+=(const SsfmProfile &other) {
+        fft += other.fft;
+        ifft += other.ifft;
+        dispersion += other.dispersion;
+        exponential += other.exponential;
+        nonlinear += other.nonlinear;
+        stepControl += other.stepControl;
+        checkStep += other.checkStep;
+        return *this;
+    }
+};
+
 struct Out {
     double time;             // elapsed time [s] within the function FIBER.
     double firstStepLength;  // first step length [m] used by the SSFM.
     unsigned long nCycle;    // number of SSFM iterations.
+
+    unsigned long nDispersionHits;    // linear steps served by a cached dispersion operator.
+    unsigned long nDispersionMisses;  // linear steps that had to evaluate exp(-i*betat*dz).
+    unsigned long nFft;               // forward FFTs of the field (all columns at once).
+    unsigned long nIfft;              // inverse FFTs of the field (all columns at once).
+
+    unsigned long nRejected;  // steps rejected by the local error control ("lem" step update, "rk4ip" step type).
+    double localError;        // sum of the local errors of the accepted steps ("lem" step update, "rk4ip" step type): a conservative upper bound of the global error, as it measures the fine solution before the Richardson extrapolation ("lem") or the embedded third-order solution ("rk4ip"), not the field kept.
+    double samplingRate;      // sampling rate [GHz] of the propagation: gstate.SAMP_FREQ, or lower with fiber.isResampled.
+
+    vector<double> spanTime;  // elapsed time [s] of each span, fiber and amplifier (linkTransmit only).
+
+    unsigned long nIterations;  // parareal iterations, each a sweep of fine propagations over the segments still to converge (linkParareal only).
+    double speedUp;             // time of the sequential SSFM, estimated by the fine propagations of the first sweep with a core per thread, over the elapsed time (linkParareal only).
+
+    vector<MonitorRecord> monitor;  // records of the field monitors, in propagation order (fiberTransmit and fiberResume only).
+
+    SsfmProfile profile;  // time and calls of each phase of the SSFM (of the resumed part only, for fiberResume).
+};
+
+/**
+ * Linear propagators exp(-i*betat*dz) of the last few distinct step lengths,
+ * replaced in least-recently-used order.
+ */
+struct DispersionCache {
+    vector<double> dz;              // step length [m] of each entry, -1 if unused
+    vector<unsigned long> lastUse;  // clock value of the last lookup of each entry
+    vector<MatrixXcd> propagator;        // exp(-i*betat*dz), one column per column of betat
+    vector<MatrixXcf> singlePropagator;  // the same operators in single precision, for single-precision fields
+    double tolerance     = 0;  // relative tolerance for two step lengths to be the same
+    unsigned long clock  = 0;
+    unsigned long hits   = 0;
+    unsigned long misses = 0;
+
+    // Keep CAPACITY entries of ROWS x COLS operators and forget the cached ones (betat may have changed);
+    // ISSINGLE keeps them in single precision.
+    void reset(size_t capacity, double stepTolerance, Index rows, Index cols, bool isSingle = false) {
+        tolerance = stepTolerance;
+        dz.assign(capacity, -1);
+        lastUse.assign(capacity, 0);
+        if (isSingle) {
+            singlePropagator.resize(capacity);
+            for (auto &item: singlePropagator)
+                item.resize(rows, cols);
+        } else {
+            propagator.resize(capacity);
+            for (auto &item: propagator)
+                item.resize(rows, cols);  // no reallocation when already sized
+        }
+        clock = hits = misses = 0;
+    }
+};
+
+/**
+ * The steps of an SSFM run, recorded for the adjoint propagation of fiberGradient:
+ * the linear and nonlinear steps in order and the field at the input of one step
+ * every spacing. Past capacity fields every other one is dropped and the spacing
+ * doubles, so that at most capacity fields are kept, evenly spaced, whatever the steps.
+ */
+struct SsfmTape {
+    struct Step {
+        bool isLinear;  // linear step, else nonlinear step
+        double dz;      // step length [m]
+        double gain;    // amplitude gain of the step
+    };
+    vector<Step> steps;
+    vector<MatrixXcd> fields;  // field at the input of the steps 0, spacing, 2 * spacing...
+    size_t spacing  = 1;
+    size_t capacity = 32;
+
+    void record(const MatrixXcd &field, bool isLinear, double dz, double gain) {
+        if (steps.size() % spacing == 0) {
+            if (fields.size() >= capacity) {  // keep the even ones
+                for (size_t i = 0; 2 * i < fields.size(); ++i)
+                    swap(fields[i], fields[2 * i]);
+                fields.resize((fields.size() + 1) / 2);
+                spacing *= 2;
+            }
+            if (steps.size() % spacing == 0)
+                fields.push_back(field);
+        }
+        steps.push_back({isLinear, dz, gain});
+    }
+};
+
+/**
+ * Scratch buffers of the SSFM step loop. Keep one alive across fiberTransmit
+ * calls on fields of the same size and the step loop does no heap allocation.
+ */
+struct SsfmWorkspace {
+    MatrixXcd spectrum;     // field in the frequency domain
+    MatrixXcd coarse;       // coarse solution of the local error method, time and then frequency domain; RK4IP solution
+    MatrixXcd fine;         // spectrum of the fine solution of the local error method; last Kerr increment of RK4IP
+    MatrixXcd interaction;  // field in the interaction picture at the middle of an RK4IP step
+    MatrixXcd stage;        // argument of a Runge-Kutta stage of RK4IP
+    MatrixXcd increment;    // Kerr increment of a Runge-Kutta stage of RK4IP
+    MatrixXcf singleField;  // field, spectrum, coarse, fine and RK4IP buffers of single-precision propagation
+    MatrixXcf singleSpectrum;
+    MatrixXcf singleCoarse;
+    MatrixXcf singleFine;
+    MatrixXcf singleInteraction;
+    MatrixXcf singleStage;
+    MatrixXcf singleIncrement;
+    MatrixXcd power;          // power of the field, then low-pass filtered, in the nonlinear steps of filtered DBP
+    MatrixXcd powerSpectrum;  // spectrum of the power of filtered DBP
+    vector<double> dzb;       // step lengths [m] of the step split over the waveplates
+    vector<double> nindex;    // waveplate indexes of the split step
+    DispersionCache dispersion;
+    unsigned long nFft      = 0;  // forward FFTs done by the SSFM
+    unsigned long nIfft     = 0;  // inverse FFTs done by the SSFM
+    unsigned long nRejected = 0;  // steps rejected by the local error control
+    double localError       = 0;  // sum of the local errors of the accepted steps
+    SsfmProfile profile;          // time of each phase of the SSFM
+    SsfmTape *tape = nullptr;     // the steps recorded for fiberGradient, or nullptr
+
+    // Size the buffers for NSAMP x NCOLS fields and steps spanning up to NPLATES waveplates;
+    // ISLEM adds the buffers of the local error method, ISRK4IP those of RK4IP, ISSINGLE sizes the single-precision ones.
+    void resize(Index nsamp, Index ncols, Index nplates, bool isLem = false, bool isSingle = false, bool isRk4ip = false) {
+        if (isSingle) {
+            singleField.resize(nsamp, ncols);
+            singleSpectrum.resize(nsamp, ncols);
+            if (isLem || isRk4ip) {
+                singleCoarse.resize(nsamp, ncols);
+                singleFine.resize(nsamp, ncols);
+            }
+            if (isRk4ip) {
+                singleInteraction.resize(nsamp, ncols);
+                singleStage.resize(nsamp, ncols);
+                singleIncrement.resize(nsamp, ncols);
+            }
+        } else {
+            spectrum.resize(nsamp, ncols);  // no reallocation when already sized
+            if (isLem || isRk4ip) {
+                coarse.resize(nsamp, ncols);
+                fine.resize(nsamp, ncols);
+            }
+            if (isRk4ip) {
+                interaction.resize(nsamp, ncols);
+                stage.resize(nsamp, ncols);
+                increment.resize(nsamp, ncols);
+            }
+        }
+        dzb.reserve(nplates + 2);
+        nindex.reserve(nplates + 2);
+        nFft       = nIfft = nRejected = 0;
+        localError = 0;
+        profile    = SsfmProfile();
+    }
 };
 
 struct Fiber {
@@ -67,8 +270,14 @@ struct Fiber {
     double maxStepLength     = length;  // max. step [m]. Default: fiber.length.
     double chlambda          = 0;       // save for later, because E will be canceled
 
+    double stepGrid              = 0;      // if > 0, step lengths are rounded down to multiples of stepGrid [m], so that repeated steps reuse the cached dispersion operators. Default: 0 (off).
+    double stepTolerance         = 1e-12;  // relative tolerance for two step lengths to share a cached dispersion operator
+    unsigned dispersionCacheSize = 4;      // number of distinct step lengths whose dispersion operator is cached
+    double errorTolerance        = 1e-5;   // goal of the relative local error of each step with the "lem" step update [Sin03] and the "rk4ip" step type
+
     double accuracyParameter = 20;      // Accuracy parameter (dphimax)
     double alphaLinear       = 0;       // Nonlinear step parameter
+    unsigned nRealizations   = 1;       // Independent realizations of the field held by E.field on consecutive blocks of columns, propagated with the same steps. Set from E.field.
     double bandwidth         = 0;       // Bandwidth [GHz] for the step size set-up. Usually the bandwidth of the propagating wavelength-division multiplexing (WDM) signal.
                                         // Default: the simulation bandwidth, GSTATE.FSAMPLING (See INIGSTATE).
     double gam     = 0;                 // Nonlinear parameter
@@ -77,18 +286,119 @@ struct Fiber {
     bool isDual    = false;             // true: dual polarization
     bool isManakov = false;             // true: nonlinear Kerr effect is modeled by the Manakov equation [Mar97, Ant16, Mum14].
                                         // false: solve the coupled-NLSE (CNLSE). Default: false.
-    bool isCle   = true;                // constant local error (CLE)
-    bool isSym   = false;               // Symmetric step computation
-    bool trace   = false;               // true: print SSFM information on the screen. Default: false.
-    bool dphiFwm = true;                // true: set the first step according to the maximum four-wave mixing (FWM) phase criterion [Mus18].
+    bool isCle    = true;               // constant local error (CLE)
+    bool isLem    = false;              // local error method (LEM): step doubling with error control
+    bool isRk4ip  = false;              // Runge-Kutta in the interaction picture (RK4IP) with error control: fiber.stepType 'rk4ip'
+    bool isSingle = false;              // single-precision SSFM: fiber.precision 'single' or 'mixed'
+    bool isMixed  = false;              // the nonlinear power and phase in double precision: fiber.precision 'mixed'
+    bool isSym    = false;              // Symmetric step computation
+    bool trace    = false;              // true: print each monitor record on the screen, every step without monitor positions. Default: false.
+    bool dphiFwm  = true;               // true: set the first step according to the maximum four-wave mixing (FWM) phase criterion [Mus18].
                                         // false: set the first step according to the maximum nonlinear phase criterion [Sin03,Mus18].
                                         // Default: true.
     string coupling = "none";           // Polarization coupling mode. It can be 'none' for no coupling, or 'pol' for strong polarization coupling.
                                         // The default value depends on the PMD parameter and the Kerr effect.
     string stepUpdate = "cle";          // Step update rule. Sets the updating rule for all steps following the first one.
-                                        // It can be 'nlp' (nonlinear phase criterion, [Sin03]) or 'cle' (constant local error criterion, [Zha05,Zha08]).
+                                        // It can be 'nlp' (nonlinear phase criterion, [Sin03]), 'cle' (constant local error criterion, [Zha05,Zha08])
+                                        // or 'lem' (local error method, [Sin03]): every step is done with one coarse and two fine half steps,
+                                        // rejected if the relative difference exceeds twice fiber.errorTolerance and Richardson extrapolated otherwise.
                                         // Default: 'cle'.
-    string stepType;                    // step type. It can be 'asymm' (asymmetric step) or 'symm' (symmetric step) [Sha14]. Default: 'asymm'.
+    string stepType;                    // step type. It can be 'asymm' (asymmetric step), 'symm' (symmetric step) [Sha14] or 'rk4ip'
+                                        // (fourth-order Runge-Kutta in the interaction picture [Hul07], unique field only): fiber.stepUpdate is
+                                        // ignored and each step is rejected if its embedded third-order error estimate [Bal13] exceeds twice
+                                        // fiber.errorTolerance, the next step following the error. Default: 'asymm'.
+    string precision = "double";        // floating point precision of the SSFM. It can be 'double', 'single' (field, FFTs, dispersion operators
+                                        // and nonlinear step in single precision: half the memory traffic, relative accuracy ~1e-5) or 'mixed'
+                                        // (as 'single', with the power and the phase of the nonlinear step in double precision). Default: 'double'.
+    string checkpointFile;              // file of the checkpoints of fiberTransmit, for fiberResume. Default: empty (no checkpoints).
+    unsigned long checkpointSteps = 0;  // if > 0, a checkpoint every checkpointSteps steps
+    double checkpointDistance     = 0;  // if > 0, a checkpoint every checkpointDistance [m]
+
+    vector<double> monitorPositions;                  // distances [m] where the field monitors record the field (see MonitorRecord), at the end of the first step reaching each one
+    double monitorSpacing      = 0;                   // if > 0, a record every monitorSpacing [m] too, from the fiber input to its output
+    vector<double> spectrumPositions;                 // distances [m] where the records include the spectrum, recorded even if not in monitorPositions
+    unsigned monitorDecimation = 16;                  // the power profiles keep one sample every monitorDecimation
+    function<void(const MonitorRecord &)> onMonitor;  // called for each record, in order, by the thread of the monitors. Default: none.
+
+    bool isResampled         = false;  // true: fiberTransmit and fiberResume propagate the field on fewer samples, with the frequency spacing of
+                                       // gstate and the sampling rate of the smallest FFT length, even and a product of 2, 3 and 5, covering
+                                       // resampleMargin times the signal bandwidth; the output returns to the grid of gstate. The monitor
+                                       // records are on the propagation grid. Default: false.
+    double resampleMargin    = 3;      // propagation sampling rate over the signal bandwidth, the room for the nonlinear broadening. At least 2.
+    double resampleTolerance = 1e-4;   // the signal bandwidth holds all but this fraction of the energy of the input field, filtered out
+};
+
+/**
+ * A fiber checked for a field wavelength, with its operators. Spans of the same
+ * fiber share one FiberSetup.
+ */
+struct FiberSetup {
+    Fiber fiber;                 // checked fiber, with the derived parameters
+    unique_ptr<Linear> linear;   // waveplates of the fiber
+    MatrixXd betat;              // beta coefficients [1/m], one column per polarization
+    DispersionCache dispersion;  // dispersion operators of the fiber
+};
+
+/**
+ * A span of a link: a fiber followed by a lumped amplifier.
+ */
+struct Span {
+    size_t fiberType     = 0;      // index of the span fiber in Link::fibers
+    double gain          = 0;      // amplifier gain [dB], if not isLossRecovered
+    double noiseFigure   = 5;      // amplifier noise figure [dB]
+    bool isLossRecovered = true;   // true: the amplifier gain is the loss of the span fiber. Default: true.
+    bool isAse           = false;  // true: add the amplified spontaneous emission (ASE) noise of the amplifier
+};
+
+/**
+ * A multi-span link for linkTransmit.
+ */
+struct Link {
+    vector<Fiber> fibers;  // the fiber types of the link
+    vector<Span> spans;    // the spans, in propagation order
+    unsigned seed = 0;     // seed of the ASE noise of the amplifiers. 0: a random seed. Default: 0.
+};
+
+/**
+ * Digital backpropagation (DBP) of a link at the receiver, for digitalBackpropagation.
+ */
+struct DbpOption {
+    unsigned stepsPerSpan  = 1;  // steps of equal length per span
+    double gammaFactor     = 1;  // fraction of the nonlinear coefficient of the fibers to backpropagate. 0: dispersion compensation only.
+    double filterBandwidth = 0;  // if > 0, the nonlinear steps follow the power low-pass filtered by a Gaussian filter of this -3 dB
+                                 // bandwidth [GHz] (filtered DBP [Du10]), unique field only. Default: 0 (unfiltered).
+};
+
+/**
+ * Loss of the fiber output for fiberGradient: returns the loss of FIELD and sets
+ * GRADIENT to its gradient, dLoss = Re(sum(conj(GRADIENT) .* dFIELD)). E.g. the
+ * squared distance to a target, sum(|FIELD - target|^2), has GRADIENT = 2 * (FIELD - target).
+ */
+typedef function<double(const MatrixXcd &field, MatrixXcd &gradient)> LossFunction;
+
+/**
+ * Gradient of a loss of the fiber output, from fiberGradient.
+ */
+struct FiberGradient {
+    double loss           = 0;  // loss of the output field
+    MatrixXcd field;            // gradient with respect to the input field, as the one of the loss function
+    double nonlinearIndex = 0;  // dLoss/dn2 [1/(m^2/W)], 0 without Kerr effect
+    double dispersion     = 0;  // dLoss/dD [1/(ps/nm/km)]
+    double slope          = 0;  // dLoss/dS [1/(ps/nm^2/km)]
+    double attenuation    = 0;  // dLoss/dalphadB [1/(dB/km)]
+};
+
+/**
+ * Parareal (parallel-in-distance) propagation of a link, for linkParareal. Each span
+ * is cut into segments of equal length; a cheap coarse propagator predicts the field
+ * at the segment boundaries and the fine SSFM corrects all the segments concurrently.
+ */
+struct PararealOption {
+    unsigned segmentsPerSpan = 4;     // segments of equal length per span
+    unsigned coarseSteps     = 1;     // steps of equal length of the coarse propagator per segment, each a nonlinear step followed by a
+                                      // linear step. 0: linear propagation only. Default: 1.
+    double tolerance         = 1e-6;  // stop when no boundary field changes by more than this fraction of its norm
+    unsigned maxIterations   = 0;     // if > 0, stop after this many iterations anyway. Default: 0 (until all the segments are fine).
 };
 
 /**
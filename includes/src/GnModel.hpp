@@ -0,0 +1,50 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+
+/**
+ * Gaussian-noise (GN) model of the nonlinear interference of a link
+ */
+
+#ifndef SIMULIB_GN_MODEL_HPP
+#define SIMULIB_GN_MODEL_HPP
+
+#include "Fiber.hpp"
+
+namespace SimuLib {
+
+/**
+ * WDM signal of the GN model: channels of rectangular spectrum with the statistics
+ * of Gaussian noise, not overlapping.
+ */
+struct GnSignal {
+    double lambda = 1550;   // wavelength [nm] of the frequency reference of the channels
+    RowVectorXd frequency;  // center frequency [GHz] of each channel, from the reference
+    RowVectorXd bandwidth;  // bandwidth [GHz] of each channel: its symbol rate for Nyquist channels
+    RowVectorXd power;      // launch power [mW] of each channel, 0 for a spectral hole
+};
+
+/**
+ * Output of gnModel: each channel at the link output.
+ */
+struct GnOut {
+    RowVectorXd nliPsd;    // power spectral density [mW/GHz] of the nonlinear interference (NLI) at the channel center
+    RowVectorXd nliPower;  // NLI power [mW] in the channel bandwidth, nliPsd * bandwidth
+    RowVectorXd asePower;  // power [mW] of the ASE noise of the amplifiers with span.isAse in the channel bandwidth
+    RowVectorXd snr;       // signal to noise ratio power / (asePower + nliPower)
+    double time;           // elapsed time [s] within the function GNMODEL
+};
+
+}  // namespace SimuLib
+
+#endif  // SIMULIB_GN_MODEL_HPP
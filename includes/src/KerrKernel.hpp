@@ -0,0 +1,45 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Fused kernels of the SSFM nonlinear step
+ */
+
+#ifndef SIMULIB_KERR_KERNEL_HPP
+#define SIMULIB_KERR_KERNEL_HPP
+
+#include <complex>
+
+namespace SimuLib {
+
+namespace HARDWARE_TYPE {
+
+// u = gain * u * exp(-i*gamleff*|u|^2) in place, returning the peak power max(|u|^2) of the result
+double kerrKernel(std::complex<double> *u, Index n, double gamleff, double gain);
+
+// Manakov version on the two polarizations: the phase uses |ux|^2+|uy|^2, returned as peak power
+double kerrKernel(std::complex<double> *ux, std::complex<double> *uy, Index n, double gamleff, double gain);
+
+// Single-precision samples; ISMIXED evaluates the power and the phase in double precision
+double kerrKernel(std::complex<float> *u, Index n, double gamleff, double gain, bool isMixed);
+
+double kerrKernel(std::complex<float> *ux, std::complex<float> *uy, Index n, double gamleff, double gain, bool isMixed);
+
+// Name of the instruction set picked by kerrKernel on this machine
+const char *kerrKernelIsa();
+
+}  // namespace HARDWARE_TYPE
+
+}  // namespace SimuLib
+
+#endif  // SIMULIB_KERR_KERNEL_HPP
@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Field monitors of the SSFM step loop
+ */
+
+#ifndef SIMULIB_MONITOR_HPP
+#define SIMULIB_MONITOR_HPP
+
+#include "Fiber.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace SimuLib {
+
+namespace HARDWARE_TYPE {
+
+/**
+ * Records of the field along a fiber. The step loop only copies the field, and the
+ * spectrum if asked, into a ring of snapshots; a background thread reduces them to
+ * MonitorRecord, prints them with fiber.trace and calls fiber.onMonitor. The step
+ * loop waits only when the whole ring is still to be reduced.
+ */
+class Monitor {
+public:
+    // Records at the monitor positions of FIBER past START [m]
+    Monitor(const Fiber &fiber, double start = 0);
+
+    // Waits for the last records
+    ~Monitor();
+
+    // True if the field at Z is to be recorded; WITHSPECTRUM is set if the record includes the spectrum
+    bool isDue(double z, bool &withSpectrum);
+
+    // Copies the field, and the spectrum if not nullptr, and returns; the reduction is in background
+    void record(double z, unsigned long step, const MatrixXcd &field, const MatrixXcd *spectrum);
+
+    void record(double z, unsigned long step, const MatrixXcf &field, const MatrixXcf *spectrum);
+
+    // Waits for the last records and hands them over
+    vector<MonitorRecord> finish();
+
+private:
+    struct Snapshot {
+        double z;
+        unsigned long step;
+        MatrixXcd field;
+        MatrixXcd spectrum;  // empty if not asked
+    };
+
+    Snapshot &acquire();
+    void release();
+    void reduce();
+
+    Fiber fiber;
+    vector<double> positions;  // record positions [m] still to reach, sorted
+    vector<double> spectra;    // spectrum positions [m] still to reach, sorted
+    size_t nextPosition = 0;
+    size_t nextSpectrum = 0;
+    bool isEveryStep;  // fiber.trace without monitor positions
+
+    vector<Snapshot> ring;
+    size_t head = 0;  // next snapshot to fill
+    size_t size = 0;  // snapshots to reduce
+    vector<MonitorRecord> records;
+
+    std::thread reducer;
+    std::mutex guard;
+    std::condition_variable changed;
+    bool isStopped = false;
+};
+
+}  // namespace HARDWARE_TYPE
+
+}  // namespace SimuLib
+
+#endif  // SIMULIB_MONITOR_HPP
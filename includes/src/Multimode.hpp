@@ -0,0 +1,50 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Few-mode fiber of space-division multiplexing (SDM)
+ */
+
+#ifndef SIMULIB_MULTIMODE_HPP
+#define SIMULIB_MULTIMODE_HPP
+
+#include "Fiber.hpp"
+
+namespace SimuLib {
+
+/**
+ * Few-mode fiber for multimodeTransmit: N spatial and polarization modes, one per
+ * column of E.field, coupled by a linear coupling matrix, with the Kerr effect of
+ * the generalized Manakov equations [Mum13] between groups of strongly coupled modes.
+ */
+struct MultimodeFiber {
+    double length         = 10000;  // fiber length [m]
+    double lambda         = 1550;   // wavelength [nm] of the fiber parameters
+    double attenuation    = 0.2;    // attenuation [dB/km] of all the modes
+    RowVectorXd dispersion;         // chromatic dispersion [ps/nm/km] of each mode. Default: 17 ps/nm/km for all.
+    double slope          = 0;      // dispersion slope [ps/nm^2/km] of all the modes
+    RowVectorXd groupDelay;         // differential mode group delay [ps/km] of each mode, from the frame of the field. Default: 0 for all.
+    MatrixXcd coupling;             // N x N Hermitian linear coupling [1/m], dA/dz = -i * coupling * A besides the dispersion; the diagonal holds
+                                    // the mismatch of the propagation constants. Default: empty (no coupling).
+    double nonlinearIndex = 0;      // n2: nonlinear index [m^2/W]
+    double effectiveArea  = 80;     // aeff: effective area [um^2] of the fundamental mode
+    vector<unsigned> modeGroups;    // mode group of each mode, from 0. Default: empty (all the modes in one group).
+    MatrixXd kerrCoefficients;      // G x G coefficients of the generalized Manakov equations: a mode of group a takes the nonlinear phase
+                                    // gam * sum_b kerrCoefficients(a, b) * P_b per unit length, P_b the power of group b. Default: 8/9 for the
+                                    // two polarizations of one mode (the Manakov equation); needed with other fields and the Kerr effect.
+    double maxStepLength  = 100;    // the steps are of equal length, the longest up to maxStepLength [m]
+};
+
+}  // namespace SimuLib
+
+#endif  // SIMULIB_MULTIMODE_HPP
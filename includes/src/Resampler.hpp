@@ -0,0 +1,55 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+
+/**
+ * Resampling of the field around a fiber
+ */
+
+#ifndef SIMULIB_RESAMPLER_HPP
+#define SIMULIB_RESAMPLER_HPP
+
+#include "Fiber.hpp"
+
+namespace SimuLib {
+
+namespace HARDWARE_TYPE {
+
+/**
+ * Propagation grid of a fiber with fiber.isResampled: the field keeps the frequency
+ * spacing of gstate and only the bins of the smallest even FFT length, a product of
+ * 2, 3 and 5, covering fiber.resampleMargin times the signal bandwidth. gstate
+ * follows the propagation grid until restore, or the destructor on errors, so the
+ * SSFM runs unchanged on fewer samples.
+ */
+class Resampler {
+public:
+    // Moves the field of E to the propagation grid of FIBER, if smaller than the grid of gstate
+    Resampler(E &e, const Fiber &fiber);
+
+    // Restores gstate, if restore was not called
+    ~Resampler();
+
+    // Moves the field of E back to the grid of gstate at construction, and restores gstate
+    void restore(E &e);
+
+private:
+    Gstate saved;              // grid of gstate at construction
+    bool isResampled = false;  // the field is on the propagation grid
+};
+
+}  // namespace HARDWARE_TYPE
+
+}  // namespace SimuLib
+
+#endif  // SIMULIB_RESAMPLER_HPP
@@ -39,6 +39,10 @@ using Eigen::MatrixXi;
 using Eigen::RowVectorXi;
 using Eigen::VectorXi;
 
+// Single-precision fields of the SSFM, which only runs them on the CPU
+using Eigen::MatrixXcf;
+using Eigen::VectorXcf;
+
 
 }  // namespace SimuLib
 
@@ -21,6 +21,9 @@
 #include <cublas_v2.h>
 #include <cufft.h>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <utility>
 
 /**
  * CUDA FFT implementation
@@ -30,17 +33,38 @@ using namespace std;
 
 #define IDX(i, j, ld) (((j) * (ld)) + (i))
 
+// cuFFT plans are keyed by (length, batch); the direction is chosen at execution time,
+// so one plan serves both the forward and the inverse transform.
+static mutex planGuard;
+static map<pair<int, int>, cufftHandle> planMap;
+static SimuLib::FFTCacheStats planStats;
+
+static bool cuPlan(cufftHandle &plan, int rows, int cols) {
+    lock_guard<mutex> lock(planGuard);
+    auto found = planMap.find(make_pair(rows, cols));
+    if (found != planMap.end()) {
+        planStats.hits++;
+        plan = found->second;
+        return true;
+    }
+    planStats.misses++;
+    if (cufftPlan1d(&plan, rows, CUFFT_Z2Z, cols) != CUFFT_SUCCESS) {
+        fprintf(stderr, "CUFFT error: Plan creation failed");
+        return false;
+    }
+    planMap[make_pair(rows, cols)] = plan;
+    planStats.plans                = planMap.size();
+    return true;
+}
+
 static void cuFFT(complex<double> *data, int rows, int cols) {
     cufftHandle plan;
     cufftDoubleComplex *dataDev;
+    if (!cuPlan(plan, rows, cols))
+        return;
     HANDLE_ERROR(cudaMalloc((void **) &dataDev, sizeof(cufftDoubleComplex) * rows * cols));
     HANDLE_ERROR(cudaMemcpy(dataDev, data, sizeof(cufftDoubleComplex) * rows * cols, cudaMemcpyHostToDevice));
 
-    if (cufftPlan1d(&plan, rows, CUFFT_Z2Z, cols) != CUFFT_SUCCESS) {
-        fprintf(stderr, "CUFFT error: Plan creation failed");
-        return;
-    }
-
     // Notes: Identical pointers to input and output arrays implies in-place transformation
     if (cufftExecZ2Z(plan, dataDev, dataDev, CUFFT_FORWARD) != CUFFT_SUCCESS) {
         fprintf(stderr, "CUFFT error: ExecZ2Z Forward failed");
@@ -48,6 +72,7 @@ static void cuFFT(complex<double> *data, int rows, int cols) {
     }
 
     cudaMemcpy(data, dataDev, sizeof(cufftDoubleComplex) * rows * cols, cudaMemcpyDeviceToHost);
+    cudaFree(dataDev);
 }
 
 static void cuScale(complex<double> *data, complex<double> alpha, int rows, int cols) {
@@ -75,14 +100,11 @@ static void cuScale(complex<double> *data, complex<double> alpha, int rows, int
 static void cuIFFT(complex<double> *data, int rows, int cols) {
     cufftHandle plan;
     cufftDoubleComplex *dataDev;
+    if (!cuPlan(plan, rows, cols))
+        return;
     HANDLE_ERROR(cudaMalloc((void **) &dataDev, sizeof(cufftDoubleComplex) * rows * cols));
     HANDLE_ERROR(cudaMemcpy(dataDev, data, sizeof(cufftDoubleComplex) * rows * cols, cudaMemcpyHostToDevice));
 
-    if (cufftPlan1d(&plan, rows, CUFFT_Z2Z, cols) != CUFFT_SUCCESS) {
-        fprintf(stderr, "CUFFT error: Plan creation failed");
-        return;
-    }
-
     // Notes: Identical pointers to input and output arrays implies in-place transformation
     if (cufftExecZ2Z(plan, dataDev, dataDev, CUFFT_INVERSE) != CUFFT_SUCCESS) {
         fprintf(stderr, "CUFFT error: ExecZ2Z Forward failed");
@@ -90,7 +112,6 @@ static void cuIFFT(complex<double> *data, int rows, int cols) {
     }
 
     cudaMemcpy(data, dataDev, sizeof(cufftDoubleComplex) * rows * cols, cudaMemcpyDeviceToHost);
-    cufftDestroy(plan);
     cudaFree(dataDev);
     complex<double> scalar((double) 1 / (rows), 0);
     cuScale(data, scalar, rows, cols);
@@ -113,21 +134,45 @@ VectorXcd ifft(const VectorXcd &in) {
 }
 
 MatrixXcd fftCol(const MatrixXcd &in) {
-    MatrixXcd out(in.rows(), in.cols());
-    for (Index i = 0; i < in.cols(); ++i) {
-        out.col(i) = fft(in.col(i));
-    }
+    MatrixXcd out = in;
+    cuFFT(out.data(), (int) out.rows(), (int) out.cols());  // one batched call over all the columns
     return out;
 }
 
 MatrixXcd ifftCol(const MatrixXcd &in) {
-    MatrixXcd out(in.rows(), in.cols());
-    for (Index i = 0; i < in.cols(); ++i) {
-        out.col(i) = ifft(in.col(i));
-    }
+    MatrixXcd out = in;
+    cuIFFT(out.data(), (int) out.rows(), (int) out.cols());
     return out;
 }
 
+void fftCol(const MatrixXcd &in, MatrixXcd &out) {
+    out = in;
+    cuFFT(out.data(), (int) out.rows(), (int) out.cols());
+}
+
+void ifftCol(const MatrixXcd &in, MatrixXcd &out) {
+    out = in;
+    cuIFFT(out.data(), (int) out.rows(), (int) out.cols());
+}
+
+void warmFFTCache(Index length, Index batch) {
+    cufftHandle plan;
+    cuPlan(plan, (int) length, (int) batch);
+}
+
+FFTCacheStats fftCacheStats() {
+    lock_guard<mutex> lock(planGuard);
+    return planStats;
+}
+
+void clearFFTCache() {
+    lock_guard<mutex> lock(planGuard);
+    for (auto &item: planMap)
+        cufftDestroy(item.second);
+    planMap.clear();
+    planStats = FFTCacheStats();
+}
+
 }
 
 }  // namespace SimuLib
@@ -0,0 +1,294 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Checkpoint file of the SSFM step loop
+ *
+ * Layout: FileHeader, the waveplates (4 complex entries of matin and 2 of db each),
+ * then two slots of a SlotHeader and the samples of the field in complex<double>.
+ * The samples of a slot are synced to the file before its header, so a slot whose
+ * header holds a sequence number is complete.
+ */
+
+#include "Internal"
+#include <cstring>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SIMULIB_CHECKPOINT_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace SimuLib {
+
+namespace HARDWARE_TYPE {
+
+namespace {
+
+const char MAGIC[8]  = {'S', 'I', 'M', 'U', 'C', 'K', 'P', '1'};
+const size_t ALIGNED = 64;  // slots start on cache lines
+
+struct FileHeader {
+    char magic[8];
+    uint64_t rows;      // samples of the field
+    uint64_t cols;      // columns of the field
+    uint64_t nplates;   // waveplates stored after the header
+    double length;      // fiber length [m]
+    uint64_t slotSize;  // bytes of a slot
+};
+
+struct SlotHeader {
+    uint64_t sequence;  // number of the checkpoint, 0 if the slot is empty
+    SsfmState state;
+};
+
+size_t alignUp(size_t bytes) {
+    return (bytes + ALIGNED - 1) / ALIGNED * ALIGNED;
+}
+
+size_t plateBytes(Index nplates) {
+    return nplates * (4 * sizeof(complex<double>) + 2 * sizeof(double));
+}
+
+Index countPlates(const Linear *linear) {
+    return linear->is_scalar ? 0 : (Index) ((const NonScalarLinear *) linear)->matin.size();
+}
+
+}  // namespace
+
+/**
+ * @brief Maps the checkpoint file of a fiber and starts the thread writing it.
+ * @param fiber: the fiber, with checkpointFile, checkpointSteps and checkpointDistance.
+ * @param rows: samples of the field.
+ * @param cols: columns of the field.
+ * @param linear: the waveplates of the fiber, stored once in the file.
+ * @param resumed: the checkpoint the propagation continues from, or nullptr.
+ */
+Checkpoint::Checkpoint(const Fiber &fiber, Index rows, Index cols, const Linear *linear, const SsfmState *resumed) {
+#ifndef SIMULIB_CHECKPOINT_MMAP
+    ERROR("Checkpoints need a POSIX system to map the checkpoint file.");
+#else
+    everySteps    = fiber.checkpointSteps;
+    everyDistance = fiber.checkpointDistance;
+    nextDistance  = everyDistance;
+    if (resumed != nullptr && everyDistance > 0)
+        nextDistance = (floor((resumed->zprop - resumed->dz) / everyDistance) + 1) * everyDistance;
+
+    Index nplates = countPlates(linear);
+    slotOffset    = alignUp(sizeof(FileHeader) + plateBytes(nplates));
+    slotSize      = alignUp(sizeof(SlotHeader) + rows * cols * sizeof(complex<double>));
+    mapSize       = slotOffset + 2 * slotSize;
+
+    file = open(fiber.checkpointFile.c_str(), O_RDWR | O_CREAT, 0644);  // without O_TRUNC: the resumed checkpoint stays
+    if (file < 0)
+        ERROR("Cannot create the checkpoint file " + fiber.checkpointFile + ".");
+    if (ftruncate(file, (off_t) mapSize) != 0) {
+        close(file);  // no destructor for a throwing constructor
+        ERROR("Cannot create the checkpoint file " + fiber.checkpointFile + ".");
+    }
+    map = (char *) mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    if (map == MAP_FAILED) {
+        close(file);
+        ERROR("Cannot map the checkpoint file " + fiber.checkpointFile + ".");
+    }
+
+    FileHeader header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.rows     = rows;
+    header.cols     = cols;
+    header.nplates  = nplates;
+    header.length   = fiber.length;
+    header.slotSize = slotSize;
+    memcpy(map, &header, sizeof(header));
+    auto *plates = (double *) (map + sizeof(FileHeader));
+    for (Index k = 0; k < nplates; ++k) {
+        const auto *nonScalar = (const NonScalarLinear *) linear;
+        memcpy(plates, nonScalar->matin[k].data(), 4 * sizeof(complex<double>));
+        plates[8] = nonScalar->db(k, 0);
+        plates[9] = nonScalar->db(k, 1);
+        plates += 10;
+    }
+
+    sequence = 0;
+    for (int slot = 0; slot < 2; ++slot) {
+        auto *slotHeader = (SlotHeader *) (map + slotOffset + slot * slotSize);
+        if (resumed == nullptr)
+            slotHeader->sequence = 0;  // forget the checkpoints of an earlier run
+        else
+            sequence = max(sequence, (unsigned long) slotHeader->sequence);
+    }
+    msync(map, mapSize, MS_SYNC);
+
+    try {
+        snapshot.resize(rows, cols);
+        writer = thread(&Checkpoint::write, this);
+    } catch (...) {
+        munmap(map, mapSize);
+        close(file);
+        throw;
+    }
+#endif
+}
+
+Checkpoint::~Checkpoint() {
+#ifdef SIMULIB_CHECKPOINT_MMAP
+    {
+        unique_lock<mutex> lock(guard);
+        changed.wait(lock, [this] { return !isPending; });
+        isStopped = true;
+    }
+    changed.notify_all();
+    writer.join();
+    munmap(map, mapSize);
+    close(file);
+#endif
+}
+
+bool Checkpoint::isDue(double zprop, unsigned long ncycle) {
+    bool isDue = everySteps > 0 && ncycle % everySteps == 0;
+    if (everyDistance > 0 && zprop >= nextDistance) {
+        isDue = true;
+        while (nextDistance <= zprop)
+            nextDistance += everyDistance;
+    }
+    return isDue;
+}
+
+/**
+ * @brief Takes a checkpoint: the field is copied and written by the background
+ *        thread, once the previous checkpoint is written.
+ * @param state: position of the step loop.
+ * @param field: field, or spectrum, the step loop continues from.
+ * @param workspace: the counters of the SSFM.
+ */
+void Checkpoint::save(SsfmState state, const MatrixXcd &field, const SsfmWorkspace &workspace) {
+    unique_lock<mutex> lock(guard);
+    changed.wait(lock, [this] { return !isPending; });
+    snapshot.array() = field.array();
+    lock.unlock();
+    save(state, workspace);
+}
+
+void Checkpoint::save(SsfmState state, const MatrixXcf &field, const SsfmWorkspace &workspace) {
+    unique_lock<mutex> lock(guard);
+    changed.wait(lock, [this] { return !isPending; });
+    snapshot.array() = field.cast<complex<double>>().array();  // exact
+    lock.unlock();
+    save(state, workspace);
+}
+
+void Checkpoint::save(SsfmState state, const SsfmWorkspace &workspace) {
+    state.nFft       = workspace.nFft;
+    state.nIfft      = workspace.nIfft;
+    state.nRejected  = workspace.nRejected;
+    state.localError = workspace.localError;
+    {
+        lock_guard<mutex> lock(guard);
+        snapshotState = state;
+        isPending     = true;
+    }
+    changed.notify_all();
+}
+
+// WRITE is the loop of the background thread: each snapshot goes to the slot not
+// holding the last checkpoint.
+
+void Checkpoint::write() {
+#ifdef SIMULIB_CHECKPOINT_MMAP
+    unique_lock<mutex> lock(guard);
+    while (true) {
+        changed.wait(lock, [this] { return isPending || isStopped; });
+        if (!isPending)
+            return;
+        lock.unlock();  // the step loop does not touch the snapshot until isPending is cleared
+
+        char *slot         = map + slotOffset + (sequence % 2) * slotSize;
+        SlotHeader header  = {sequence + 1, snapshotState};
+        char *samples      = slot + sizeof(SlotHeader);
+        size_t sampleBytes = snapshot.size() * sizeof(complex<double>);
+        memcpy(samples, snapshot.data(), sampleBytes);
+        long page   = sysconf(_SC_PAGESIZE);
+        char *first = slot - (size_t) (slot - map) % page;  // msync needs page-aligned addresses
+        msync(first, samples + sampleBytes - first, MS_SYNC);
+        memcpy(slot, &header, sizeof(header));
+        msync(first, page, MS_SYNC);
+
+        lock.lock();
+        sequence++;
+        isPending = false;
+        changed.notify_all();
+    }
+#endif
+}
+
+/**
+ * @brief Reads the last complete checkpoint of a fiber.
+ * @param fiber: the fiber, with checkpointFile.
+ * @param rows: samples of the field.
+ * @param cols: columns of the field.
+ * @param linear: overwritten by the waveplates of the checkpoint.
+ * @param state: the position of the step loop.
+ * @param field: the field, or spectrum, of the checkpoint.
+ */
+void loadCheckpoint(const Fiber &fiber, Index rows, Index cols, Linear *linear, SsfmState &state, MatrixXcd &field) {
+    ifstream in(fiber.checkpointFile, ios::binary);
+    if (!in)
+        ERROR("Cannot open the checkpoint file " + fiber.checkpointFile + ".");
+
+    FileHeader header;
+    in.read((char *) &header, sizeof(header));
+    Index nplates = countPlates(linear);
+    if (!in || memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0)
+        ERROR(fiber.checkpointFile + " is not a checkpoint file.");
+    if ((Index) header.rows != rows || (Index) header.cols != cols || (Index) header.nplates != nplates || header.length != fiber.length)
+        ERROR("The checkpoint file " + fiber.checkpointFile + " is of another fiber or field.");
+
+    for (Index k = 0; k < nplates; ++k) {
+        auto *nonScalar = (NonScalarLinear *) linear;
+        double db[2];
+        in.read((char *) nonScalar->matin[k].data(), 4 * sizeof(complex<double>));
+        in.read((char *) db, sizeof(db));
+        nonScalar->db(k, 0) = db[0];
+        nonScalar->db(k, 1) = db[1];
+    }
+
+    size_t slotOffset = alignUp(sizeof(FileHeader) + plateBytes(nplates));
+    SlotHeader last   = {};
+    int lastSlot      = -1;
+    for (int slot = 0; slot < 2; ++slot) {
+        SlotHeader slotHeader;
+        in.seekg((streamoff) (slotOffset + slot * header.slotSize));
+        in.read((char *) &slotHeader, sizeof(slotHeader));
+        if (in && slotHeader.sequence > last.sequence) {
+            last     = slotHeader;
+            lastSlot = slot;
+        }
+    }
+    if (lastSlot < 0)
+        ERROR("No complete checkpoint in " + fiber.checkpointFile + ".");
+
+    field.resize(rows, cols);
+    in.seekg((streamoff) (slotOffset + lastSlot * header.slotSize + sizeof(SlotHeader)));
+    in.read((char *) field.data(), field.size() * sizeof(complex<double>));
+    if (!in)
+        ERROR("The checkpoint file " + fiber.checkpointFile + " is truncated.");
+    state = last.state;
+}
+
+}  // namespace HARDWARE_TYPE
+
+}  // namespace SimuLib
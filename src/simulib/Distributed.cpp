@@ -0,0 +1,262 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Fields distributed over the processes of MPI: the four-step FFT of the slabs of
+ * the ranks and the SSFM on them, for fields too large for one node
+ *
+ * The four-step FFT [Bai90] of N = N1 * N2 samples x[n1 + N1 * n2] is
+ *
+ *   X[k2 + N2 * k1] = sum_n1 W_N1^(n1 * k1) * W_N^(n1 * k2) * sum_n2 W_N2^(n2 * k2) * x[n1 + N1 * n2],
+ *
+ * FFTs of length N2 of the N1 rows of the N1 x N2 matrix of the samples, the
+ * twiddles W_N^(n1 * k2) and FFTs of length N1 of the N2 columns. The slabs of the
+ * ranks are columns of the matrix; two MPI_Alltoall transposes give each rank whole
+ * rows, then whole columns again. The spectrum is not transposed back to the natural
+ * order: the linear step of the SSFM multiplies each frequency on its own, so the
+ * ranks keep it in the order of the columns, with the frequencies to match, and the
+ * inverse FFT undoes the steps in reverse. A step of the SSFM costs two transposes per
+ * FFT, and no other exchange.
+ *
+ * [Bai90] D. H. Bailey, "FFTs in External or Hierarchical Memory," J. Supercomputing,
+ *         vol. 4, no. 1, 1990.
+ */
+
+#include "Internal"
+
+#ifdef SIMULIB_USE_MPI
+
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+namespace SimuLib {
+
+namespace HARDWARE_TYPE {
+
+tuple<double, double> DispersionCoefficients(double lambda, double dispersion, double slope);
+
+/**
+ * @brief Plans the four-step FFT of a field distributed over the ranks of a
+ *        communicator: N = N1 * N2 with N1 the divisor of N closest to sqrt(N) from
+ *        below such that the ranks divide both N1 and N2.
+ * @param length: samples N of the whole field.
+ * @param sampFreq: sampling rate [GHz] of the field.
+ * @param comm: communicator of the ranks holding the slabs.
+ */
+DistributedFft::DistributedFft(Index length, double sampFreq, MPI_Comm comm) : comm(comm), n(length), sampFreq(sampFreq) {
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    n1 = 0;
+    for (Index d = (Index) floor(sqrt((double) length)); d >= 1 && n1 == 0; --d)
+        if (length % d == 0 && d % size == 0 && length / d % size == 0)
+            n1 = d;
+    if (n1 == 0)
+        ERROR("The ranks must divide both factors N1 and N2 of the field length.");
+    n2 = length / n1;
+
+    Index q = n1 / size;  // local rows
+    Index c = n2 / size;  // local columns
+    twiddle.resize(n2, q);
+    for (Index j = 0; j < q; ++j)
+        for (Index k2 = 0; k2 < n2; ++k2) {
+            long long product = (long long) (rank * q + j) * k2 % length;  // exact below 2^63
+            twiddle(k2, j)    = polar(1.0, -2 * M_PI * (double) product / (double) length);
+        }
+    frequency.resize(n1 * c);
+    for (Index j = 0; j < c; ++j)
+        for (Index k1 = 0; k1 < n1; ++k1) {
+            Index k                = rank * c + j + n2 * k1;
+            frequency(k1 + n1 * j) = (double) (k < length / 2 ? k : k - length) * sampFreq / (double) length;
+        }
+}
+
+void DistributedFft::exchange() {
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    int block = (int) (sendBuffer.size() / size);
+    MPI_Alltoall(sendBuffer.data(), block, MPI_C_DOUBLE_COMPLEX, receiveBuffer.data(), block, MPI_C_DOUBLE_COMPLEX, comm);
+    transposeTime += chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+}
+
+/**
+ * @brief Forward FFT of a distributed field: the slab of samples of this rank to its
+ *        slab of the spectrum, in the order of frequencies(). All the ranks call it.
+ * @param field: the N/P samples from firstSample(), one column per polarization.
+ * @param spectrum: the N/P frequencies of this rank, of each column.
+ */
+void DistributedFft::forward(const MatrixXcd &field, MatrixXcd &spectrum) {
+    Index q = n1 / size, c = n2 / size, m = field.cols(), block = q * c * m;
+    if (field.rows() != n / size)
+        ERROR("The slab of the field must have N/P rows.");
+    sendBuffer.resize(block * size);
+    receiveBuffer.resize(block * size);
+
+    // Columns to rows: the block of rank s is rows s*q... of the local columns
+    for (int s = 0; s < size; ++s)
+        for (Index p = 0; p < m; ++p)
+            for (Index j = 0; j < q; ++j)
+                for (Index l = 0; l < c; ++l)
+                    sendBuffer[s * block + (p * q + j) * c + l] = field(s * q + j + n1 * l, p);
+    exchange();
+    rows.resize(n2, q * m);
+    for (int r = 0; r < size; ++r)
+        for (Index col = 0; col < q * m; ++col)
+            copy_n(&receiveBuffer[r * block + col * c], c, &rows(r * c, col));
+
+    // FFTs of the rows, twiddles, and rows to columns
+    rowsOut.resize(n2, q * m);
+    fftCol(rows, rowsOut);
+    for (Index p = 0; p < m; ++p)
+        rowsOut.middleCols(p * q, q).array() *= twiddle.array();
+    for (int t = 0; t < size; ++t)
+        for (Index p = 0; p < m; ++p)
+            for (Index l = 0; l < c; ++l)
+                for (Index j = 0; j < q; ++j)
+                    sendBuffer[t * block + (p * c + l) * q + j] = rowsOut(t * c + l, p * q + j);
+    exchange();
+    columns.resize(n1, c * m);
+    for (int s = 0; s < size; ++s)
+        for (Index col = 0; col < c * m; ++col)
+            copy_n(&receiveBuffer[s * block + col * q], q, &columns(s * q, col));
+
+    // FFTs of the columns: the N1 x c columns of a polarization are its slab of the spectrum
+    spectrum.resize(n1, c * m);
+    fftCol(columns, spectrum);
+    spectrum.resize(n / size, m);  // same storage, no reallocation
+}
+
+/**
+ * @brief Inverse FFT of a distributed field, scaled by 1/N: the slab of the spectrum
+ *        of this rank, in the order of frequencies(), to its slab of samples. All the
+ *        ranks call it.
+ * @param spectrum: the N/P frequencies of this rank, of each column.
+ * @param field: the N/P samples from firstSample(), of each column.
+ */
+void DistributedFft::inverse(const MatrixXcd &spectrum, MatrixXcd &field) {
+    Index q = n1 / size, c = n2 / size, m = spectrum.cols(), block = q * c * m;
+    if (spectrum.rows() != n / size)
+        ERROR("The slab of the spectrum must have N/P rows.");
+    sendBuffer.resize(block * size);
+    receiveBuffer.resize(block * size);
+
+    // Inverse FFTs of the columns, and columns to rows
+    columns.resize(n1, c * m);
+    copy_n(spectrum.data(), spectrum.size(), columns.data());
+    columnsOut.resize(n1, c * m);
+    ifftCol(columns, columnsOut);
+    for (int s = 0; s < size; ++s)
+        for (Index col = 0; col < c * m; ++col)
+            copy_n(&columnsOut(s * q, col), q, &sendBuffer[s * block + col * q]);
+    exchange();
+    rows.resize(n2, q * m);
+    for (int t = 0; t < size; ++t)
+        for (Index p = 0; p < m; ++p)
+            for (Index l = 0; l < c; ++l)
+                for (Index j = 0; j < q; ++j)
+                    rows(t * c + l, p * q + j) = receiveBuffer[t * block + (p * c + l) * q + j];
+
+    // Twiddles, inverse FFTs of the rows, and rows to columns
+    for (Index p = 0; p < m; ++p)
+        rows.middleCols(p * q, q).array() *= twiddle.array().conjugate();
+    rowsOut.resize(n2, q * m);
+    ifftCol(rows, rowsOut);
+    for (int r = 0; r < size; ++r)
+        for (Index col = 0; col < q * m; ++col)
+            copy_n(&rowsOut(r * c, col), c, &sendBuffer[r * block + col * c]);
+    exchange();
+    field.resize(n / size, m);
+    for (int s = 0; s < size; ++s)
+        for (Index p = 0; p < m; ++p)
+            for (Index j = 0; j < q; ++j)
+                for (Index l = 0; l < c; ++l)
+                    field(s * q + j + n1 * l, p) = receiveBuffer[s * block + (p * q + j) * c + l];
+}
+
+/**
+ * @brief SSFM of a field distributed over the ranks of a DistributedFft: the
+ *        nonlinear step on the slab of samples of each rank, the linear step on its
+ *        slab of the spectrum, symmetric steps of equal length up to
+ *        fiber.maxStepLength. Scalar field or dual polarization with the Manakov
+ *        equation, without polarization coupling. All the ranks call it.
+ * @param e: the slab of the electric field of this rank, one column per polarization,
+ *        overwritten by the slab at the fiber output. E.lambda: central wavelength [nm].
+ * @param fiber: the fiber.
+ * @param fft: the plan of the distributed field.
+ * @return out: fiber option, with the step length in out.firstStepLength
+ */
+Out distributedTransmit(E &e, const Fiber &fiber, DistributedFft &fft) {
+
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();  // Start time
+
+    Index npol = fiber.isDual ? 2 : 1;
+    if (e.field.rows() != fft.localLength() || e.field.cols() != npol)
+        ERROR("E.field must be the slab of this rank, one column per polarization.");
+    if (fiber.coupling != "none" || fiber.pmdParameter != 0)
+        ERROR("The distributed SSFM has no polarization coupling.");
+    if (fiber.isDual && !fiber.isManakov && fiber.nonlinearIndex != 0)
+        ERROR("Dual-polarization Kerr effect is only available with the Manakov equation.");
+    if (fiber.length <= 0 || fiber.maxStepLength <= 0)
+        ERROR("fiber.length and fiber.maxStepLength must be positive.");
+
+    // beta [1/m] of the local frequencies
+    double b2, b3;  // beta2 [ns^2/m] and beta3 [ns^3/m] @ fiber.lambda
+    tie(b2, b3)    = DispersionCoefficients(fiber.lambda, fiber.dispersion, fiber.slope);
+    VectorXd omega = 2 * M_PI * fft.frequencies();                                        // angular frequency [rad/ns]
+    double domega  = 2 * M_PI * LIGHT_SPEED * (1. / e.lambda(0, 0) - 1. / fiber.lambda);  // [1/ns]
+    double beta2   = b2 + b3 * domega;                                                    // [ns^2/m] @ E.lambda
+    VectorXd betat = omega.array() * omega.array() * (omega.array() * b3 / 6 + beta2 / 2);
+    double alpha   = log(10) * 1e-4 * fiber.attenuation;  // [1/m]
+    double gam     = 0;                                   // [1/mW/m], with the Manakov factor
+    if (fiber.nonlinearIndex != 0)
+        gam = 2 * M_PI * fiber.nonlinearIndex / (e.lambda(0, 0) * fiber.effectiveArea) * 1e18 * (fiber.isDual ? 8. / 9 : 1);
+
+    unsigned long nsteps = (unsigned long) ceil(fiber.length / fiber.maxStepLength);
+    double dz            = fiber.length / nsteps;
+    auto propagator      = [&](double h) { return VectorXcd((betat * complex<double>(0, -h)).array().exp() * exp(-alpha / 2 * h)); };
+    VectorXcd half       = propagator(dz / 2);
+    VectorXcd whole      = propagator(dz);
+
+    MatrixXcd spectrum;
+    fft.forward(e.field, spectrum);
+    spectrum.array().colwise() *= half.array();
+    for (unsigned long k = 1; k <= nsteps; ++k) {
+        fft.inverse(spectrum, e.field);
+        if (gam != 0) {
+            if (fiber.isDual)
+                kerrKernel(e.field.col(0).data(), e.field.col(1).data(), e.field.rows(), gam * dz, 1);
+            else
+                kerrKernel(e.field.data(), e.field.rows(), gam * dz, 1);
+        }
+        fft.forward(e.field, spectrum);
+        spectrum.array().colwise() *= (k < nsteps ? whole : half).array();
+    }
+    fft.inverse(spectrum, e.field);
+
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();  // End time
+
+    Out out             = {};
+    out.time            = chrono::duration<double>(end - begin).count();
+    out.firstStepLength = dz;
+    out.nCycle          = nsteps;
+    out.nFft            = nsteps + 1;
+    out.nIfft           = nsteps + 1;
+    out.samplingRate    = fft.samplingRate();
+    return out;
+}
+
+}  // namespace HARDWARE_TYPE
+
+}  // namespace SimuLib
+
+#endif  // SIMULIB_USE_MPI
@@ -21,6 +21,26 @@
  */
 
 #include "Internal"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef SIMULIB_USE_MKL
+#include <mkl.h>
+#endif
+
+#ifdef SIMULIB_USE_FFTW
+#include <fftw3.h>
+#endif
 
 using namespace std;
 
@@ -28,76 +48,574 @@ namespace SimuLib {
 
 namespace CPU {
 
-#ifdef SIMULIB_USE_MKL
+namespace {
 
-#include <mkl.h>
+enum PLAN_PRECISION { DOUBLE_PRECISION,
+                      SINGLE_PRECISION };
+
+struct PlanKey {
+    Index length;              // transform length
+    bool inverse;              // false: forward, true: inverse (scaled by 1/length)
+    PLAN_PRECISION precision;  // floating point precision of the samples
+    Index batch;               // number of contiguous transforms done per call
+
+    bool operator<(const PlanKey &other) const {
+        return tie(length, inverse, precision, batch) < tie(other.length, other.inverse, other.precision, other.batch);
+    }
+};
+
+// A plan of one backend: the transforms of a PlanKey, which several threads may run
+// at once
+class FFTPlan {
+public:
+    virtual ~FFTPlan() = default;
+    virtual void execute(const complex<double> *in, complex<double> *out) = 0;
+    virtual void execute(const complex<float> *in, complex<float> *out)   = 0;
+};
 
-// The implementation of fft referred to this website
+// Threads sharing the columns of a batch: one per column at most, as set by setNumThreads
+int columnThreads(Index batch) {
+#ifdef _OPENMP
+    if (batch > 1)
+        return min((int) batch, omp_get_max_threads());
+#endif
+    return 1;
+}
+
+// Scratch buffer of N samples of the calling thread
+template<typename T>
+complex<T> *scratch(Index n) {
+    thread_local vector<complex<T>> buffer;
+    if ((Index) buffer.size() < n)
+        buffer.resize(n);
+    return buffer.data();
+}
+
+#ifdef SIMULIB_USE_MKL
+
+// The MKL descriptor setup referred to this website
 // https://stackoverflow.com/questions/29805767/is-there-any-simple-c-example-on-how-to-use-intel-mkl-fft
-VectorXcd fft(const VectorXcd &in) {
-    VectorXcd out(in.size());
-    DFTI_DESCRIPTOR_HANDLE descriptor;
-    MKL_LONG status;
-
-    // Note after each operation status should be 0 on success
-    status = DftiCreateDescriptor(&descriptor, DFTI_DOUBLE, DFTI_COMPLEX, 1, in.size());  // Specify size and precision
-    status = DftiSetValue(descriptor, DFTI_PLACEMENT, DFTI_NOT_INPLACE);                  // Out of place fft
-    status = DftiCommitDescriptor(descriptor);                                            // Finalize the descriptor
-    status = DftiComputeForward(descriptor, (void *) in.data(), out.data());              // Compute the Forward fft
-    status = DftiFreeDescriptor(&descriptor);                                             // Free the descriptor
-    return out;
+class MklPlan : public FFTPlan {
+public:
+    explicit MklPlan(const PlanKey &key) : key(key) {
+        // Note after each operation status should be 0 on success
+        MKL_LONG status;
+        DFTI_CONFIG_VALUE precision = key.precision == SINGLE_PRECISION ? DFTI_SINGLE : DFTI_DOUBLE;
+        status                      = DftiCreateDescriptor(&descriptor, precision, DFTI_COMPLEX, 1, (MKL_LONG) key.length);  // Specify size and precision
+        status = DftiSetValue(descriptor, DFTI_PLACEMENT, DFTI_NOT_INPLACE);                              // Out of place fft
+        if (key.batch > 1) {                                                                             // One call transforms all the columns
+            status = DftiSetValue(descriptor, DFTI_NUMBER_OF_TRANSFORMS, (MKL_LONG) key.batch);
+            status = DftiSetValue(descriptor, DFTI_INPUT_DISTANCE, (MKL_LONG) key.length);
+            status = DftiSetValue(descriptor, DFTI_OUTPUT_DISTANCE, (MKL_LONG) key.length);
+        }
+        if (key.inverse)
+            status = DftiSetValue(descriptor, DFTI_BACKWARD_SCALE, 1.0 / (double) key.length);  // Scale down the output
+        status = DftiCommitDescriptor(descriptor);                                               // Finalize the descriptor
+        if (status != 0)
+            ERROR(DftiErrorMessage(status));
+    }
+
+    ~MklPlan() override {
+        DftiFreeDescriptor(&descriptor);
+    }
+
+    void execute(const complex<double> *in, complex<double> *out) override {
+        compute(in, out);
+    }
+
+    void execute(const complex<float> *in, complex<float> *out) override {
+        compute(in, out);
+    }
+
+private:
+    // A committed descriptor can be shared by several threads
+    template<typename T>
+    void compute(const complex<T> *in, complex<T> *out) {
+        if (key.inverse)
+            DftiComputeBackward(descriptor, (void *) in, out);
+        else
+            DftiComputeForward(descriptor, (void *) in, out);
+    }
+
+    PlanKey key;
+    DFTI_DESCRIPTOR_HANDLE descriptor = nullptr;
+};
+
+#endif
+
+#ifdef SIMULIB_USE_FFTW
+
+// FFTW plans all the columns of a batch at once; the new-array execution of a plan is
+// thread safe, but the planner is not, so the plans are made and destroyed under a
+// lock of their own, inside the plan cache or not (rankFFTBackends), as FFTW asks.
+// Double precision only: the single-precision plans are left to the fallback.
+class FftwPlan : public FFTPlan {
+public:
+    explicit FftwPlan(const PlanKey &key) : key(key) {
+        lock_guard<mutex> lock(planner());
+        int n               = (int) key.length;
+        fftw_complex *in    = fftw_alloc_complex(key.length * key.batch);  // FFTW_ESTIMATE does not touch them
+        fftw_complex *out   = fftw_alloc_complex(key.length * key.batch);
+        plan                = fftw_plan_many_dft(1, &n, (int) key.batch, in, nullptr, 1, n, out, nullptr, 1, n, key.inverse ? FFTW_BACKWARD : FFTW_FORWARD,
+                                                 FFTW_ESTIMATE | FFTW_UNALIGNED);
+        fftw_free(in);
+        fftw_free(out);
+        if (plan == nullptr)
+            ERROR("FFTW could not plan the transform.");
+    }
+
+    ~FftwPlan() override {
+        lock_guard<mutex> lock(planner());
+        fftw_destroy_plan(plan);
+    }
+
+    void execute(const complex<double> *in, complex<double> *out) override {
+        fftw_execute_dft(plan, (fftw_complex *) in, (fftw_complex *) out);  // out of place: the input is left untouched
+        if (key.inverse) {
+            Map<Eigen::VectorXcd> samples(out, key.length * key.batch);
+            samples *= 1.0 / (double) key.length;
+        }
+    }
+
+    void execute(const complex<float> *, complex<float> *) override {
+        ERROR("The FFTW backend has no single-precision plans.");
+    }
+
+private:
+    static mutex &planner() {
+        static mutex guard;
+        return guard;
+    }
+
+    PlanKey key;
+    fftw_plan plan;
+};
+
+#endif
+
+// kissfft keeps its scratch buffers inside the engine, so each call borrows a set of
+// engines of its own, one per OpenMP thread for a batch whose columns the threads
+// share. The sets are built on demand and kept by the plan: concurrent callers, e.g.
+// the segments of linkParareal, transform at the same time instead of waiting. The
+// threads are those of setNumThreads at the call, a set growing when they increase.
+class KissPlan : public FFTPlan {
+public:
+    explicit KissPlan(const PlanKey &key) : key(key) {
+        // kissfft builds the twiddles lazily: the first set is ready before the first call
+        if (key.precision == SINGLE_PRECISION)
+            singleEngines.push_back(build<float>(columnThreads(key.batch)));
+        else
+            engines.push_back(build<double>(columnThreads(key.batch)));
+    }
+
+    void execute(const complex<double> *in, complex<double> *out) override {
+        execute(engines, in, out);
+    }
+
+    void execute(const complex<float> *in, complex<float> *out) override {
+        execute(singleEngines, in, out);
+    }
+
+private:
+    template<typename T>
+    using EngineSet = unique_ptr<vector<FFT<T>>>;
+
+    template<typename T>
+    void execute(vector<EngineSet<T>> &pool, const complex<T> *in, complex<T> *out) {
+        EngineSet<T> set;
+        {
+            lock_guard<mutex> lock(guard);
+            if (!pool.empty()) {
+                set = move(pool.back());
+                pool.pop_back();
+            }
+        }
+        int nthreads = columnThreads(key.batch);
+        if (!set)
+            set = build<T>(nthreads);  // another caller holds the others
+        grow(*set, nthreads);
+        vector<FFT<T>> &engine = *set;
+        if (nthreads == 1) {
+            for (Index i = 0; i < key.batch; ++i)
+                transform(engine[0], in + i * key.length, out + i * key.length);
+        } else {
+#pragma omp parallel for num_threads(nthreads)
+            for (Index i = 0; i < key.batch; ++i) {
+                int thread = 0;
+#ifdef _OPENMP
+                thread = omp_get_thread_num();
+#endif
+                transform(engine[thread], in + i * key.length, out + i * key.length);
+            }
+        }
+        lock_guard<mutex> lock(guard);
+        pool.push_back(move(set));
+    }
+
+    // BUILD makes a set of N engines and GROW adds engines up to N, run once on zeros
+    // to have the twiddles ready
+    template<typename T>
+    EngineSet<T> build(int n) {
+        EngineSet<T> set(new vector<FFT<T>>());
+        grow(*set, n);
+        return set;
+    }
+
+    template<typename T>
+    void grow(vector<FFT<T>> &set, int n) {
+        if ((int) set.size() >= n)
+            return;
+        Matrix<complex<T>, Dynamic, 1> zeros = Matrix<complex<T>, Dynamic, 1>::Zero(key.length);
+        Matrix<complex<T>, Dynamic, 1> out(key.length);
+        Index first = (Index) set.size();
+        set.resize(n);
+        for (Index i = first; i < n; ++i)
+            transform(set[i], zeros.data(), out.data());
+    }
+
+    template<typename T>
+    void transform(FFT<T> &engine, const complex<T> *in, complex<T> *out) {
+        if (key.inverse)
+            engine.inv(out, in, key.length);
+        else
+            engine.fwd(out, in, key.length);
+    }
+
+    PlanKey key;
+    vector<EngineSet<double>> engines;       // idle sets of double precision engines
+    vector<EngineSet<float>> singleEngines;  // idle sets of single precision engines
+    mutex guard;
+};
+
+// Radix-4 Stockham autosort FFT of a power-of-two length, with a last radix-2 stage
+// for the odd powers: each stage reads one buffer and writes the other in order, so
+// there is no bit reversal, and the twiddles of all the stages are computed once.
+// The inner loop of a stage runs over the contiguous samples of the stride.
+template<typename T>
+class Stockham {
+public:
+    Stockham(Index length, bool inverse) : n(length), inverse(inverse) {
+        double sign = inverse ? 1 : -1;
+        for (Index len = n; len >= 4; len /= 4)
+            for (Index p = 0; p < len / 4; ++p)
+                for (int k = 1; k <= 3; ++k)
+                    twiddles.push_back(complex<T>(polar(1.0, sign * 2 * M_PI * (double) (k * p) / (double) len)));
+        stages = 0;
+        for (Index len = n; len > 1; len = len >= 4 ? len / 4 : 1)
+            stages++;
+    }
+
+    // Transforms IN into OUT, the stages going through SCRATCH of N samples; the inverse is scaled by 1/N
+    void transform(const complex<T> *in, complex<T> *out, complex<T> *scratch) const {
+        const complex<T> *x = in;
+        const complex<T> *w = twiddles.data();
+        Index len = n, s = 1;
+        for (int stage = 0; stage < stages; ++stage) {
+            complex<T> *y = (stages - 1 - stage) % 2 == 0 ? out : scratch;  // the last stage writes OUT
+            if (len >= 4) {
+                Index m = len / 4;
+                for (Index p = 0; p < m; ++p) {
+                    complex<T> w1 = w[3 * p], w2 = w[3 * p + 1], w3 = w[3 * p + 2];
+                    const complex<T> *x0 = x + s * p, *x1 = x0 + s * m, *x2 = x1 + s * m, *x3 = x2 + s * m;
+                    complex<T> *y0 = y + s * 4 * p, *y1 = y0 + s, *y2 = y1 + s, *y3 = y2 + s;
+                    for (Index q = 0; q < s; ++q) {
+                        complex<T> apc = x0[q] + x2[q], amc = x0[q] - x2[q];
+                        complex<T> bpd = x1[q] + x3[q], bmd = x1[q] - x3[q];
+                        complex<T> jbmd = inverse ? complex<T>(bmd.imag(), -bmd.real()) : complex<T>(-bmd.imag(), bmd.real());  // -+i * (b - d)
+                        y0[q]           = apc + bpd;
+                        y1[q]           = w1 * (amc - jbmd);
+                        y2[q]           = w2 * (apc - bpd);
+                        y3[q]           = w3 * (amc + jbmd);
+                    }
+                }
+                w += 3 * m;
+                len = m;
+                s *= 4;
+            } else {  // radix 2
+                for (Index q = 0; q < s; ++q) {
+                    complex<T> a = x[q], b = x[q + s];
+                    y[q]         = a + b;
+                    y[q + s]     = a - b;
+                }
+                len = 1;
+            }
+            x = y;
+        }
+        if (stages == 0)
+            out[0] = in[0];
+        if (inverse) {
+            Map<Matrix<complex<T>, Dynamic, 1>> samples(out, n);
+            samples *= (T) (1.0 / (double) n);
+        }
+    }
+
+private:
+    Index n;
+    bool inverse;
+    int stages;
+    vector<complex<T>> twiddles;  // w, w^2, w^3 of each butterfly, stage after stage
+};
+
+class StockhamPlan : public FFTPlan {
+public:
+    explicit StockhamPlan(const PlanKey &key) : key(key), engine(key.length, key.inverse), singleEngine(key.length, key.inverse) {}
+
+    void execute(const complex<double> *in, complex<double> *out) override {
+        execute(engine, in, out);
+    }
+
+    void execute(const complex<float> *in, complex<float> *out) override {
+        execute(singleEngine, in, out);
+    }
+
+private:
+    template<typename T>
+    void execute(const Stockham<T> &stockham, const complex<T> *in, complex<T> *out) {
+        int nthreads = columnThreads(key.batch);
+#pragma omp parallel for num_threads(nthreads) if (nthreads > 1)
+        for (Index i = 0; i < key.batch; ++i)
+            stockham.transform(in + i * key.length, out + i * key.length, scratch<T>(key.length));
+    }
+
+    PlanKey key;
+    Stockham<double> engine;
+    Stockham<float> singleEngine;
+};
+
+// A backend: its name, the keys it plans, and the plans
+struct FFTBackend {
+    string name;
+    function<bool(const PlanKey &)> supports;
+    function<FFTPlan *(const PlanKey &)> make;
+};
+
+const vector<FFTBackend> &backends() {
+    static const vector<FFTBackend> all = {
+            {"kissfft", [](const PlanKey &) { return true; }, [](const PlanKey &key) { return (FFTPlan *) new KissPlan(key); }},
+            {"stockham", [](const PlanKey &key) { return key.length > 0 && (key.length & (key.length - 1)) == 0; },
+             [](const PlanKey &key) { return (FFTPlan *) new StockhamPlan(key); }},
+#ifdef SIMULIB_USE_MKL
+            {"mkl", [](const PlanKey &) { return true; }, [](const PlanKey &key) { return (FFTPlan *) new MklPlan(key); }},
+#endif
+#ifdef SIMULIB_USE_FFTW
+            {"fftw", [](const PlanKey &key) { return key.precision == DOUBLE_PRECISION; }, [](const PlanKey &key) { return (FFTPlan *) new FftwPlan(key); }},
+#endif
+    };
+    return all;
 }
 
-VectorXcd ifft(const VectorXcd &in) {
-    VectorXcd out(in.size());
+const FFTBackend &findBackend(const string &name) {
+    for (const FFTBackend &backend: backends())
+        if (backend.name == name)
+            return backend;
+    ERROR("Unknown FFT backend: " + name);
+    return backends()[0];
+}
 
-    DFTI_DESCRIPTOR_HANDLE descriptor;
-    MKL_LONG status;
+// Plans are built once per (length, direction, precision, batch) and kept until
+// clearFFTCache() or setFFTBackend(). The callers hold a plan by a shared pointer for
+// the time of their transform, so a plan dropped from the cache while other threads
+// still transform with it is freed only after them. The plans are those of the
+// selected backend, or of kissfft for the keys it does not plan.
+class FFTPlanCache {
+public:
+    FFTPlanCache() {
+#ifdef SIMULIB_USE_MKL
+        backend = "mkl";
+#endif
+        const char *selected = getenv("SIMULIB_FFT_BACKEND");
+        if (selected != nullptr && *selected != '\0')
+            backend = findBackend(selected).name;
+    }
 
-    status = DftiCreateDescriptor(&descriptor, DFTI_DOUBLE, DFTI_COMPLEX, 1, in.size());  // Specify size and precision
-    status = DftiSetValue(descriptor, DFTI_PLACEMENT, DFTI_NOT_INPLACE);                  // Out of place fft
-    status = DftiSetValue(descriptor, DFTI_BACKWARD_SCALE, 1.0 / (double) in.size());     // Scale down the output
-    status = DftiCommitDescriptor(descriptor);                                            // Finalize the descriptor
-    status = DftiComputeBackward(descriptor, (void *) in.data(), out.data());             // Compute the Forward fft
-    status = DftiFreeDescriptor(&descriptor);                                             // Free the descriptor
+    shared_ptr<FFTPlan> plan(const PlanKey &key) {
+        lock_guard<mutex> lock(guard);
+        auto found = plans.find(key);
+        if (found != plans.end()) {
+            stats.hits++;
+            return found->second;
+        }
+        stats.misses++;
+        const FFTBackend &chosen = findBackend(backend);
+        shared_ptr<FFTPlan> plan(chosen.supports(key) ? chosen.make(key) : findBackend("kissfft").make(key));
+        plans[key]  = plan;
+        stats.plans = plans.size();
+        return plan;
+    }
 
-    return out;
+    FFTCacheStats statistics() {
+        lock_guard<mutex> lock(guard);
+        return stats;
+    }
+
+    void clear() {
+        lock_guard<mutex> lock(guard);
+        plans.clear();
+        stats = FFTCacheStats();
+    }
+
+    void select(const string &name) {
+        lock_guard<mutex> lock(guard);
+        backend = findBackend(name).name;
+        plans.clear();
+        stats = FFTCacheStats();
+    }
+
+    string selected() {
+        lock_guard<mutex> lock(guard);
+        return backend;
+    }
+
+private:
+    mutex guard;
+    map<PlanKey, shared_ptr<FFTPlan>> plans;
+    FFTCacheStats stats;
+    string backend = "kissfft";
+};
+
+FFTPlanCache &planCache() {
+    static FFTPlanCache cache;
+    return cache;
+}
+
+shared_ptr<FFTPlan> findPlan(Index length, bool inverse, Index batch, PLAN_PRECISION precision = DOUBLE_PRECISION) {
+    PlanKey key = {length, inverse, precision, batch};
+    return planCache().plan(key);
 }
 
-#else
+}  // namespace
 
 VectorXcd fft(const VectorXcd &in) {
     VectorXcd out(in.size());
-    FFT<double> fft;
-    fft.fwd(out, in);
+    findPlan(in.size(), false, 1)->execute(in.data(), out.data());
     return out;
 }
 
 VectorXcd ifft(const VectorXcd &in) {
     VectorXcd out(in.size());
-    FFT<double> fft;
-    fft.inv(out, in);
+    findPlan(in.size(), true, 1)->execute(in.data(), out.data());
     return out;
 }
 
-#endif
-
 MatrixXcd fftCol(const MatrixXcd &in) {
     MatrixXcd out(in.rows(), in.cols());
-    for (Index i = 0; i < in.cols(); ++i) {
-        out.col(i) = fft(in.col(i));
-    }
+    findPlan(in.rows(), false, in.cols())->execute(in.data(), out.data());
     return out;
 }
 
 MatrixXcd ifftCol(const MatrixXcd &in) {
     MatrixXcd out(in.rows(), in.cols());
-    for (Index i = 0; i < in.cols(); ++i) {
-        out.col(i) = ifft(in.col(i));
-    }
+    findPlan(in.rows(), true, in.cols())->execute(in.data(), out.data());
     return out;
 }
 
+void fftCol(const MatrixXcd &in, MatrixXcd &out) {
+    assert(in.data() != out.data());
+    out.resize(in.rows(), in.cols());  // no reallocation when already sized
+    findPlan(in.rows(), false, in.cols())->execute(in.data(), out.data());
+}
+
+void ifftCol(const MatrixXcd &in, MatrixXcd &out) {
+    assert(in.data() != out.data());
+    out.resize(in.rows(), in.cols());
+    findPlan(in.rows(), true, in.cols())->execute(in.data(), out.data());
+}
+
+void fftCol(const MatrixXcf &in, MatrixXcf &out) {
+    assert(in.data() != out.data());
+    out.resize(in.rows(), in.cols());
+    findPlan(in.rows(), false, in.cols(), SINGLE_PRECISION)->execute(in.data(), out.data());
+}
+
+void ifftCol(const MatrixXcf &in, MatrixXcf &out) {
+    assert(in.data() != out.data());
+    out.resize(in.rows(), in.cols());
+    findPlan(in.rows(), true, in.cols(), SINGLE_PRECISION)->execute(in.data(), out.data());
+}
+
+/**
+ * @brief Build the forward and inverse plans of a transform ahead of time, so
+ *        that the first fft/ifft/fftCol/ifftCol call does not pay for the
+ *        twiddle generation or the planning of the selected backend.
+ * @param length: number of samples of each transform, e.g., gstate.NSAMP.
+ * @param batch: number of columns transformed per call (1 for fft/ifft).
+ */
+void warmFFTCache(Index length, Index batch) {
+    findPlan(length, false, batch);
+    findPlan(length, true, batch);
+}
+
+FFTCacheStats fftCacheStats() {
+    return planCache().statistics();
+}
+
+void clearFFTCache() {
+    planCache().clear();
+}
+
+/**
+ * @brief Names of the FFT backends built in: "kissfft" and "stockham" always, "mkl"
+ *        and "fftw" when the library was built with them.
+ * @return the names, the fallback "kissfft" first.
+ */
+vector<string> fftBackends() {
+    vector<string> names;
+    for (const FFTBackend &backend: backends())
+        names.push_back(backend.name);
+    return names;
+}
+
+/**
+ * @brief Selects the backend of the next plans and clears the plan cache. The
+ *        default is "mkl" when built with it, else "kissfft", unless the
+ *        environment variable SIMULIB_FFT_BACKEND names another one. The keys a
+ *        backend does not plan (e.g., "stockham" for the lengths other than powers
+ *        of 2) fall back to kissfft.
+ * @param name: one of fftBackends().
+ */
+void setFFTBackend(const string &name) {
+    planCache().select(name);
+}
+
+string fftBackend() {
+    return planCache().selected();
+}
+
+/**
+ * @brief Times the transforms of each backend on random samples, e.g., to pick the
+ *        fastest for gstate.NSAMP. The plans are built outside the plan cache.
+ * @param length: number of samples of each transform.
+ * @param batch: number of columns transformed per call.
+ * @return the backends with their best time [s] of a forward and inverse pair, the
+ *         fastest first. The backends not planning the length are left out.
+ */
+vector<pair<string, double>> rankFFTBackends(Index length, Index batch) {
+    const int RUNS = 5;
+    MatrixXcd in   = MatrixXcd::Random(length, batch);
+    MatrixXcd spectrum(length, batch), out(length, batch);
+    vector<pair<string, double>> ranking;
+    for (const FFTBackend &backend: backends()) {
+        PlanKey forwardKey = {length, false, DOUBLE_PRECISION, batch};
+        PlanKey inverseKey = {length, true, DOUBLE_PRECISION, batch};
+        if (!backend.supports(forwardKey))
+            continue;
+        unique_ptr<FFTPlan> forward(backend.make(forwardKey));
+        unique_ptr<FFTPlan> inverse(backend.make(inverseKey));
+        forward->execute(in.data(), spectrum.data());  // the first call may finish the planning
+        inverse->execute(spectrum.data(), out.data());
+        double best = INFINITY;
+        for (int run = 0; run < RUNS; ++run) {
+            auto start = chrono::steady_clock::now();
+            forward->execute(in.data(), spectrum.data());
+            inverse->execute(spectrum.data(), out.data());
+            best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        }
+        ranking.push_back({backend.name, best});
+    }
+    sort(ranking.begin(), ranking.end(), [](const pair<string, double> &a, const pair<string, double> &b) { return a.second < b.second; });
+    return ranking;
+}
+
 }  // namespace CPU
 
 // MatrixXcd fft2D(const MatrixXcd &in) {
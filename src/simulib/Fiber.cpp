@@ -25,6 +25,12 @@
 #include <chrono>
 #include <cmath>
 #include <iostream>
+#include <numeric>
+#include <random>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace std;
 
@@ -32,13 +38,144 @@ namespace SimuLib {
 
 namespace HARDWARE_TYPE {
 
-tuple<Linear *, double> CheckFiber(const E &e, Fiber &fiber);
-tuple<double, double> FirstStep(const MatrixXcd &field, Fiber fiber);
-double NextStep(const MatrixXcd &field, const Fiber &fiber, double dz_old);
-tuple<RowVectorXd, RowVectorXd> CheckStep(double zprop, double dz, double len_corr);
-MatrixXcd LinearStep(Linear *linear, VectorXd betat, RowVectorXd dzb, RowVectorXd nindex, MatrixXcd field);
-VectorXcd NonlinearStep(VectorXcd field, Fiber fiber, double dz);
-tuple<double, unsigned long, E> SSFM(E e, Linear *linear, const VectorXd &betat, Fiber fiber);
+// Samples of a task of the threads in the dispersion and nonlinear steps: a multiple of
+// the SIMD width of the Kerr kernels, so that the samples of a column go through the
+// same vector lanes whatever the number of threads.
+const Index PARALLEL_CHUNK = 8192;
+
+tuple<unique_ptr<Linear>, double> CheckFiber(const E &e, Fiber &fiber);
+void DrawWaveplates(const Fiber &fiber, NonScalarLinear &linear);
+void SetupFiber(const E &e, Fiber fiber, FiberSetup &setup);
+tuple<double, double> DispersionCoefficients(double lambda, double dispersion, double slope);
+Out PropagateFiber(E &e, FiberSetup &setup, SsfmWorkspace &workspace, Checkpoint *checkpoint = nullptr, const SsfmState *resume = nullptr,
+                   Monitor *monitor = nullptr);
+bool IsMonitored(const Fiber &fiber);
+void Amplifier(MatrixXcd &field, const Span &span, const Fiber &fiber, double lambda, mt19937 &generator);
+double AmplifierGain(const Span &span, const Fiber &fiber);
+void FilteredNonlinearStep(MatrixXcd &field, const Fiber &fiber, const VectorXd &filter, SsfmWorkspace &workspace, double dz);
+tuple<MatrixXcd, RowVectorXd> EigenDecomposition(const Fiber &fiber);
+void CheckStep(double zprop, double dz, double len_corr, SsfmWorkspace &workspace);
+double SnapStep(double step, const Fiber &fiber);
+
+// The SSFM runs on double- (MatrixXcd) or single-precision (MatrixXcf) fields
+template<typename Field>
+tuple<double, double> FirstStep(const Field &field, Fiber fiber);
+template<typename Field>
+double NextStep(const Field &field, const Fiber &fiber, double dz_old, double pmax = -1);
+template<typename Field>
+void Fft(const Field &field, Field &spectrum, SsfmWorkspace &workspace);
+template<typename Field>
+void Ifft(const Field &spectrum, Field &field, SsfmWorkspace &workspace);
+template<typename Field>
+void LinearStep(Linear *linear, const MatrixXd &betat, Field &field, SsfmWorkspace &workspace, double gain = 1);
+template<typename Field>
+void LinearSpectrumStep(Linear *linear, const MatrixXd &betat, Field &spectrum, SsfmWorkspace &workspace, double gain = 1);
+template<typename Field>
+const Field &DispersionOperator(const MatrixXd &betat, double dz, SsfmWorkspace &workspace);
+template<typename Field>
+void JonesRotation(Field &spectrum, const Field &propagator, const NonScalarLinear &linear, Index plate, double dz, double gain);
+template<typename Field>
+double NonlinearStep(Field &field, const Fiber &fiber, SsfmWorkspace &workspace, double dz, double gain = 1);
+template<typename Field>
+double KerrColumns(Field &field, Index npol, double gamleff, double gain, const Fiber &fiber);
+template<typename Field>
+void KerrIncrement(const Field &field, Field &increment, const Fiber &fiber, SsfmWorkspace &workspace, double dz);
+template<typename Field>
+double PeakPower(const Field &field, const Fiber &fiber);
+template<typename Field>
+void MonitorStep(Monitor *monitor, double z, unsigned long step, Field &field, Field &spectrum, bool isFieldCurrent, bool isSpectrumCurrent);
+template<typename Field>
+double SeparateKerrStep(Field &field, Index nch, double gamleff, double gain);
+template<typename Field>
+double SeparateManakovStep(Field &field, Index nch, double gamleff, double gain);
+template<typename Field>
+tuple<double, unsigned long> SSFM(Field &field, Linear *linear, const MatrixXd &betat, Fiber fiber, SsfmWorkspace &workspace, Checkpoint *checkpoint,
+                                  const SsfmState *resume, Monitor *monitor);
+template<typename Field>
+tuple<double, unsigned long> LocalErrorSSFM(Field &field, Linear *linear, const MatrixXd &betat, Fiber fiber, SsfmWorkspace &workspace, Checkpoint *checkpoint,
+                                            const SsfmState *resume, Monitor *monitor);
+template<typename Field>
+tuple<double, unsigned long> RungeKuttaSSFM(Field &field, Linear *linear, const MatrixXd &betat, Fiber fiber, SsfmWorkspace &workspace, Checkpoint *checkpoint,
+                                            const SsfmState *resume, Monitor *monitor);
+
+// SSFMPRECISION picks the workspace buffers, the cached dispersion operators and the
+// Kerr kernel of the precision of the field.
+
+template<typename Field>
+struct SsfmPrecision;
+
+template<>
+struct SsfmPrecision<MatrixXcd> {
+    static MatrixXcd &spectrum(SsfmWorkspace &workspace) { return workspace.spectrum; }
+    static MatrixXcd &coarse(SsfmWorkspace &workspace) { return workspace.coarse; }
+    static MatrixXcd &fine(SsfmWorkspace &workspace) { return workspace.fine; }
+    static MatrixXcd &interaction(SsfmWorkspace &workspace) { return workspace.interaction; }
+    static MatrixXcd &stage(SsfmWorkspace &workspace) { return workspace.stage; }
+    static MatrixXcd &increment(SsfmWorkspace &workspace) { return workspace.increment; }
+    static MatrixXcd &propagator(DispersionCache &cache, size_t i) { return cache.propagator[i]; }
+
+    static double kerr(complex<double> *u, Index n, double gamleff, double gain, const Fiber &) {
+        return kerrKernel(u, n, gamleff, gain);
+    }
+
+    static double kerr(complex<double> *ux, complex<double> *uy, Index n, double gamleff, double gain, const Fiber &) {
+        return kerrKernel(ux, uy, n, gamleff, gain);
+    }
+};
+
+template<>
+struct SsfmPrecision<MatrixXcf> {
+    static MatrixXcf &spectrum(SsfmWorkspace &workspace) { return workspace.singleSpectrum; }
+    static MatrixXcf &coarse(SsfmWorkspace &workspace) { return workspace.singleCoarse; }
+    static MatrixXcf &fine(SsfmWorkspace &workspace) { return workspace.singleFine; }
+    static MatrixXcf &interaction(SsfmWorkspace &workspace) { return workspace.singleInteraction; }
+    static MatrixXcf &stage(SsfmWorkspace &workspace) { return workspace.singleStage; }
+    static MatrixXcf &increment(SsfmWorkspace &workspace) { return workspace.singleIncrement; }
+    static MatrixXcf &propagator(DispersionCache &cache, size_t i) { return cache.singlePropagator[i]; }
+
+    static double kerr(complex<float> *u, Index n, double gamleff, double gain, const Fiber &fiber) {
+        return kerrKernel(u, n, gamleff, gain, fiber.isMixed);
+    }
+
+    static double kerr(complex<float> *ux, complex<float> *uy, Index n, double gamleff, double gain, const Fiber &fiber) {
+        return kerrKernel(ux, uy, n, gamleff, gain, fiber.isMixed);
+    }
+};
+
+// PHASETIMER adds the time from its construction to its destruction to a phase of
+// the SSFM profile, and counts the call.
+
+class PhaseTimer {
+public:
+    explicit PhaseTimer(SsfmPhase &phase) : phase(phase), begin(chrono::steady_clock::now()) {}
+
+    ~PhaseTimer() {
+        phase.time += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - begin).count();
+        phase.count++;
+    }
+
+private:
+    SsfmPhase &phase;
+    chrono::steady_clock::time_point begin;
+};
+
+// PARAREALSEGMENT is a segment of a span for linkParareal: the setup of its fiber, cut
+// to the segment length, and the amplitude gain of the amplifier at its end, 1 within
+// the span.
+
+struct PararealSegment {
+    FiberSetup *setup;
+    double gain;
+};
+
+Out FineSegment(E &e, const PararealSegment &segment, SsfmWorkspace &workspace);
+void CoarseSegment(MatrixXcd &field, const PararealSegment &segment, unsigned steps, SsfmWorkspace &workspace);
+void RecordStep(SsfmWorkspace &workspace, const MatrixXcd &field, bool isLinear, double dz, double gain);
+void RecordStep(SsfmWorkspace &workspace, const MatrixXcf &field, bool isLinear, double dz, double gain);
+void ReplayStep(const SsfmTape::Step &step, MatrixXcd &field, FiberSetup &setup, SsfmWorkspace &workspace);
+void AdjointLinearStep(const SsfmTape::Step &step, const MatrixXcd &state, FiberSetup &setup, const MatrixXd &dispersionBeta, const MatrixXd &slopeBeta,
+                       SsfmWorkspace &workspace, FiberGradient &gradient);
+void AdjointNonlinearStep(const SsfmTape::Step &step, const MatrixXcd &state, const Fiber &fiber, FiberGradient &gradient);
 
 /**
  * @brief Single-mode optical fiber in the nonlinear regime
@@ -47,19 +184,505 @@ tuple<double, unsigned long, E> SSFM(E e, Linear *linear, const VectorXd &betat,
  *          wavelength that relates the lowpass equivalent signal to the
  *          corresponding bandpass signal.
  *        E.field: time samples of the electric field, with polarizations (if
- *          existing) alternated on columns
+ *          existing) alternated on columns. K independent realizations of the
+ *          field (e.g. for PMD or noise statistics) may be stacked on consecutive
+ *          blocks of columns: they share the FFTs, the dispersion operators and
+ *          the steps, the shortest of the realizations, and with polarization
+ *          coupling each one propagates in its own random fiber. With a step
+ *          update independent of the field ('cle', the default, or fixed steps)
+ *          the result is the one of K separate calls.
  * @param fiber: the transmit fiber.
  * @return out: fiber option
  * @return e: electric field
  */
 
 tuple<Out, E> fiberTransmit(E &e, Fiber fiber) {
+    SsfmWorkspace workspace;
+    Out out = fiberTransmit(e, fiber, workspace);
+    return make_tuple(out, e);
+}
+
+/**
+ * @brief Single-mode optical fiber in the nonlinear regime, propagating the
+ *        field in place.
+ * @param e: electric field, overwritten by the field at the fiber output.
+ * @param fiber: the transmit fiber.
+ * @param workspace: scratch buffers of the SSFM. Reusing the same workspace
+ *        over calls with equally sized fields avoids any allocation in the
+ *        step loop.
+ * @return out: fiber option
+ */
+Out fiberTransmit(E &e, Fiber fiber, SsfmWorkspace &workspace) {
+
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();  // Start time
+
+    Resampler resampler(e, fiber);  // gstate on the propagation grid until restored
+    FiberSetup setup;
+    SetupFiber(e, fiber, setup);
+    workspace.dispersion.reset(max(setup.fiber.dispersionCacheSize, 1u), setup.fiber.stepTolerance, setup.betat.rows(), setup.betat.cols(), setup.fiber.isSingle);
+    unique_ptr<Checkpoint> checkpoint;
+    if (!fiber.checkpointFile.empty() && (fiber.checkpointSteps > 0 || fiber.checkpointDistance > 0))
+        checkpoint.reset(new Checkpoint(setup.fiber, e.field.rows(), e.field.cols(), setup.linear.get()));
+    unique_ptr<Monitor> monitor;
+    if (IsMonitored(fiber))
+        monitor.reset(new Monitor(setup.fiber));
+    Out out = PropagateFiber(e, setup, workspace, checkpoint.get(), nullptr, monitor.get());
+    if (monitor)
+        out.monitor = monitor->finish();
+    resampler.restore(e);
+
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();  // End time
+
+    out.time = chrono::duration<double>(end - begin).count();
+    return out;
+}
+
+/**
+ * @brief Continues an interrupted fiberTransmit from the last checkpoint of
+ *        fiber.checkpointFile. The result is the one of the uninterrupted call,
+ *        bit for bit; the dispersion operators are computed again, so only
+ *        out.nDispersionHits and out.nDispersionMisses may differ.
+ * @param e: the input field of the interrupted call, for its size and wavelengths,
+ *        and its bandwidth with fiber.isResampled, overwritten by the field at
+ *        the fiber output.
+ * @param fiber: the fiber of the interrupted call. New checkpoints go on in the same
+ *        file.
+ * @param workspace: scratch buffers of the SSFM.
+ * @return out: fiber option, with the counters of the whole propagation and the
+ *         time of the resumed part
+ */
+Out fiberResume(E &e, Fiber fiber, SsfmWorkspace &workspace) {
+
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();  // Start time
+
+    Resampler resampler(e, fiber);  // the grid of the interrupted call, from the same input field
+    FiberSetup setup;
+    SetupFiber(e, fiber, setup);
+    SsfmState state;
+    loadCheckpoint(setup.fiber, e.field.rows(), e.field.cols(), setup.linear.get(), state, e.field);
+    workspace.dispersion.reset(max(setup.fiber.dispersionCacheSize, 1u), setup.fiber.stepTolerance, setup.betat.rows(), setup.betat.cols(), setup.fiber.isSingle);
+    unique_ptr<Checkpoint> checkpoint;
+    if (fiber.checkpointSteps > 0 || fiber.checkpointDistance > 0)
+        checkpoint.reset(new Checkpoint(setup.fiber, e.field.rows(), e.field.cols(), setup.linear.get(), &state));
+    unique_ptr<Monitor> monitor;
+    if (IsMonitored(fiber))
+        monitor.reset(new Monitor(setup.fiber, state.zprop - state.dz));
+    Out out = PropagateFiber(e, setup, workspace, checkpoint.get(), &state, monitor.get());
+    if (monitor)
+        out.monitor = monitor->finish();
+    resampler.restore(e);
+
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();  // End time
+
+    out.time = chrono::duration<double>(end - begin).count();
+    return out;
+}
+
+/**
+ * @brief Gradient of a scalar loss of the fiber output with respect to the input
+ *        field and the fiber parameters, by the adjoint of the SSFM: the forward
+ *        SSFM records its steps and the field every few steps, then the gradient goes
+ *        back through the steps in reverse order, each block of steps between two
+ *        recorded fields computed again from the first one. The cost is about the one
+ *        of three to four SSFM runs whatever the parameters, the memory at most CHECKPOINTS
+ *        fields and the steps of a block. The gradient is the one of the computed
+ *        output with the step lengths of the forward run held fixed. Unique fields
+ *        without polarization coupling, in double precision, with the "asymm" or
+ *        "symm" step types and the "cle" or "nlp" step updates.
+ * @param e: electric field, overwritten by the field at the fiber output.
+ * @param fiber: the transmit fiber. Resampling, monitors and checkpoint files are not used.
+ * @param loss: the loss of the output field, with its gradient.
+ * @param gradient: set to the loss and its gradient.
+ * @param workspace: scratch buffers of the SSFM.
+ * @param checkpoints: fields of the forward run kept at most. Default: 32.
+ * @return out: fiber option of the forward SSFM, with the time of the whole gradient
+ */
+Out fiberGradient(E &e, Fiber fiber, const LossFunction &loss, FiberGradient &gradient, SsfmWorkspace &workspace, unsigned checkpoints) {
+
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();  // Start time
+
+    FiberSetup setup;
+    SetupFiber(e, fiber, setup);
+    const Fiber &checked = setup.fiber;
+    if (!checked.isUnique || !setup.linear->is_scalar || checked.isSingle || checked.isLem || checked.isRk4ip)
+        ERROR("Adjoint gradients need a unique field without polarization coupling in double precision, and neither the \"lem\" step update nor the \"rk4ip\" step type.");
+    workspace.dispersion.reset(max(checked.dispersionCacheSize, 1u), checked.stepTolerance, setup.betat.rows(), setup.betat.cols());
+
+    // Forward SSFM, recording the steps
+    SsfmTape tape;
+    tape.capacity  = max(checkpoints, 1u);
+    workspace.tape = &tape;
+    Out out;
+    try {
+        out = PropagateFiber(e, setup, workspace);
+    } catch (...) {
+        workspace.tape = nullptr;
+        throw;
+    }
+    workspace.tape = nullptr;
+
+    gradient      = FiberGradient();
+    gradient.loss = loss(e.field, gradient.field);
+    if (gradient.field.rows() != e.field.rows() || gradient.field.cols() != e.field.cols())
+        ERROR("The gradient of the loss must have the size of the field.");
+
+    // betat is linear in the dispersion and the slope: its derivatives are the betat of unit values
+    FiberSetup unit;
+    fiber.dispersion = 1;
+    fiber.slope      = 0;
+    SetupFiber(e, fiber, unit);
+    MatrixXd dispersionBeta = unit.betat;
+    fiber.dispersion        = 0;
+    fiber.slope             = 1;
+    SetupFiber(e, fiber, unit);
+    MatrixXd slopeBeta = unit.betat;
+
+    // Backward, one block of steps at a time; gradient.nonlinearIndex and gradient.attenuation
+    // collect the derivatives with respect to the nonlinear coefficient and the linear loss [1/m]
+    workspace.coarse.resize(e.field.rows(), e.field.cols());
+    vector<MatrixXcd> states;  // inputs of the steps of the block
+    size_t nsteps = tape.steps.size();
+    for (size_t b = tape.fields.size(); b-- > 0;) {
+        size_t first = b * tape.spacing;
+        size_t last  = min(first + tape.spacing, nsteps);
+        states.resize(last - first);
+        states[0] = move(tape.fields[b]);
+        for (size_t k = first; k + 1 < last; ++k) {
+            states[k - first + 1] = states[k - first];
+            ReplayStep(tape.steps[k], states[k - first + 1], setup, workspace);
+        }
+        for (size_t k = last; k-- > first;) {
+            if (tape.steps[k].isLinear)
+                AdjointLinearStep(tape.steps[k], states[k - first], setup, dispersionBeta, slopeBeta, workspace, gradient);
+            else
+                AdjointNonlinearStep(tape.steps[k], states[k - first], checked, gradient);
+        }
+    }
+    if (checked.isKerr)
+        gradient.nonlinearIndex *= checked.gam / checked.nonlinearIndex;  // the nonlinear coefficient is proportional to n2
+    else
+        gradient.nonlinearIndex = 0;
+    gradient.attenuation *= log(10) * 1e-4;
+
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();  // End time
+
+    out.time = chrono::duration<double>(end - begin).count();
+    return out;
+}
+
+/**
+ * @brief Multi-span link: each span is a fiber followed by a lumped amplifier.
+ *        The fiber checks, the beta coefficients and the dispersion operators are
+ *        computed once per fiber of link.fibers and shared by all the spans using
+ *        it; only the waveplates of a fiber with polarization coupling are drawn
+ *        again for each span, since the spans are different fibers.
+ * @param e: electric field, overwritten by the field at the link output.
+ * @param link: the fibers and the spans of the link, and the seed of the ASE noise.
+ * @param workspace: scratch buffers of the SSFM, shared by all the spans.
+ * @return out: counters summed over the spans, with the time of each span in out.spanTime
+ */
+Out linkTransmit(E &e, const Link &link, SsfmWorkspace &workspace) {
+
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();  // Start time
+
+    vector<FiberSetup> setups(link.fibers.size());
+    for (size_t i = 0; i < link.fibers.size(); ++i) {
+        FiberSetup &setup = setups[i];
+        SetupFiber(e, link.fibers[i], setup);
+        setup.dispersion.reset(max(setup.fiber.dispersionCacheSize, 1u), setup.fiber.stepTolerance, setup.betat.rows(), setup.betat.cols(),
+                               setup.fiber.isSingle);
+    }
+    vector<bool> used(link.fibers.size(), false);
+    mt19937 generator(link.seed != 0 ? link.seed : random_device{}());  // ASE noise
+
+    Out out = {};
+    out.spanTime.reserve(link.spans.size());
+    for (const Span &span: link.spans) {
+        chrono::steady_clock::time_point spanBegin = chrono::steady_clock::now();
+        if (span.fiberType >= setups.size())
+            ERROR("Span fiber type out of link.fibers.");
+        FiberSetup &setup = setups[span.fiberType];
+        if (used[span.fiberType] && !setup.linear->is_scalar)
+            DrawWaveplates(setup.fiber, *(NonScalarLinear *) setup.linear.get());
+        used[span.fiberType] = true;
+
+        swap(workspace.dispersion, setup.dispersion);  // the operators of this fiber, without copies
+        Out spanOut = PropagateFiber(e, setup, workspace);
+        swap(workspace.dispersion, setup.dispersion);
+        Amplifier(e.field, span, setup.fiber, e.lambda(0, 0), generator);
+
+        if (out.spanTime.empty()) {
+            out.firstStepLength = spanOut.firstStepLength;
+            out.samplingRate    = spanOut.samplingRate;
+        }
+        out.nCycle += spanOut.nCycle;
+        out.nFft += spanOut.nFft;
+        out.nIfft += spanOut.nIfft;
+        out.nRejected += spanOut.nRejected;
+        out.localError += spanOut.localError;
+        out.profile += spanOut.profile;
+        out.spanTime.push_back(chrono::duration<double>(chrono::steady_clock::now() - spanBegin).count());
+    }
+    for (const FiberSetup &setup: setups) {  // the cache of a fiber counts the lookups of all its spans
+        out.nDispersionHits += setup.dispersion.hits;
+        out.nDispersionMisses += setup.dispersion.misses;
+    }
+
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();  // End time
+
+    out.time = chrono::duration<double>(end - begin).count();
+    return out;
+}
+
+/**
+ * @brief Parareal propagation of a multi-span link [Lio01]: each span is cut into
+ *        option.segmentsPerSpan segments of equal length, and the coarse propagator G
+ *        (option.coarseSteps steps of equal length per segment) predicts the field at
+ *        all the segment boundaries. Each iteration propagates the boundaries of the
+ *        segments still to converge through the fine SSFM F concurrently, one OpenMP
+ *        thread per segment, and corrects them in order with
+ *        U(n+1) = G(new U(n)) + F(U(n)) - G(U(n)). After k iterations the first k
+ *        segments are exact, so the field converges to the one of the fine SSFM on
+ *        the segments in at most as many iterations as segments; the fewer the
+ *        iterations, the larger the speed-up. The amplifier gain of a span goes with
+ *        its last segment. The steps of the constant local error rule start each
+ *        segment from the step length the sequential SSFM has there. The fine SSFM
+ *        runs in fiber.precision, the coarse propagator in double precision. The fibers must
+ *        have no polarization coupling and the amplifiers no ASE noise, the segments
+ *        being propagated several times. A single fiber is a link of one span with
+ *        span.isLossRecovered false and span.gain 0 dB.
+ * @param e: electric field, overwritten by the field at the link output.
+ * @param link: the fibers and the spans of the link.
+ * @param option: the segments, the coarse propagator and the tolerance.
+ * @param workspace: scratch buffers of the coarse propagator; the fine SSFM has one
+ *        workspace per thread.
+ * @return out: counters summed over the fine propagations, with out.nIterations and
+ *         out.speedUp
+ */
+Out linkParareal(E &e, const Link &link, const PararealOption &option, SsfmWorkspace &workspace) {
 
     chrono::steady_clock::time_point begin = chrono::steady_clock::now();  // Start time
 
+    if (option.segmentsPerSpan == 0)
+        ERROR("option.segmentsPerSpan must be at least 1.");
+    if (option.tolerance < 0)
+        ERROR("option.tolerance must not be negative.");
+
+    // Segment k of the spans of fiber i: setups[i * segmentsPerSpan + k], the fiber cut to the segment length
+    unsigned nseg = option.segmentsPerSpan;
+    vector<FiberSetup> setups(link.fibers.size() * nseg);
+    for (size_t i = 0; i < link.fibers.size(); ++i) {
+        for (unsigned k = 0; k < nseg; ++k) {
+            Fiber fiber       = link.fibers[i];
+            fiber.length      = fiber.length / nseg;
+            FiberSetup &setup = setups[i * nseg + k];
+            SetupFiber(e, fiber, setup);
+            if (!setup.linear->is_scalar)
+                ERROR("Parareal needs fibers without polarization coupling.");
+            if (setup.fiber.isCle) {  // the step grows as exp(alpha * z / q) along the fiber
+                double q = setup.fiber.isSym ? 3 : 2;
+                setup.fiber.accuracyParameter *= exp(setup.fiber.alphaLinear * k * setup.fiber.length / q);
+            }
+            // The coarse propagator, in double precision whatever fiber.precision
+            setup.dispersion.reset(max(setup.fiber.dispersionCacheSize, 1u), setup.fiber.stepTolerance, setup.betat.rows(), setup.betat.cols());
+        }
+    }
+    vector<PararealSegment> segments;
+    segments.reserve(link.spans.size() * nseg);
+    for (const Span &span: link.spans) {
+        if (span.fiberType >= link.fibers.size())
+            ERROR("Span fiber type out of link.fibers.");
+        if (span.isAse)
+            ERROR("Parareal needs amplifiers without ASE noise.");
+        for (unsigned k = 0; k < nseg; ++k) {
+            PararealSegment segment;
+            segment.setup = &setups[span.fiberType * nseg + k];
+            segment.gain  = k + 1 == nseg ? sqrt(AmplifierGain(span, link.fibers[span.fiberType])) : 1;
+            segments.push_back(segment);
+        }
+    }
+    Index nsegments = (Index) segments.size();
+    workspace.resize(e.field.rows(), e.field.cols(), 1);
+
+    int threads = 1;
+#ifdef _OPENMP
+    threads = max(1, min(omp_get_max_threads(), (int) nsegments));
+#endif
+    vector<SsfmWorkspace> fineWorkspaces(threads);  // the fine SSFM of each thread
+    vector<E> fineFields(threads, e);
+
+    // Prediction: the coarse propagation of the whole link
+    vector<MatrixXcd> boundary(nsegments + 1);  // field at the input of each segment, and at the link output
+    vector<MatrixXcd> jump(nsegments);          // G(U(n)) of the last sweep, then F(U(n)) - G(U(n))
+    boundary[0] = e.field;
+    for (Index n = 0; n < nsegments; ++n) {
+        boundary[n + 1] = boundary[n];
+        CoarseSegment(boundary[n + 1], segments[n], option.coarseSteps, workspace);
+        jump[n] = boundary[n + 1];
+    }
+
+    vector<Out> fineOut(nsegments);
+    MatrixXcd coarse;
+    Out out               = {};
+    double sequentialTime = 0;  // [s] of the fine propagations of the first sweep
+    Index first           = 0;  // the segments before it are exact
+    double change         = INFINITY;
+    while (first < nsegments && change > option.tolerance && (option.maxIterations == 0 || out.nIterations < option.maxIterations)) {
+#pragma omp parallel for schedule(dynamic) num_threads(threads)
+        for (Index n = first; n < nsegments; ++n) {
+            int thread = 0;
+#ifdef _OPENMP
+            thread = omp_get_thread_num();
+#endif
+            E &field    = fineFields[thread];
+            field.field = boundary[n];
+            fineOut[n]  = FineSegment(field, segments[n], fineWorkspaces[thread]);
+            jump[n]     = field.field - jump[n];
+        }
+        for (Index n = first; n < nsegments; ++n) {
+            const Out &segmentOut = fineOut[n];
+            if (out.nIterations == 0) {
+                sequentialTime += segmentOut.time;
+                if (n == 0)
+                    out.firstStepLength = segmentOut.firstStepLength;
+            }
+            out.nCycle += segmentOut.nCycle;
+            out.nDispersionHits += segmentOut.nDispersionHits;
+            out.nDispersionMisses += segmentOut.nDispersionMisses;
+            out.nFft += segmentOut.nFft;
+            out.nIfft += segmentOut.nIfft;
+            out.nRejected += segmentOut.nRejected;
+            out.localError += segmentOut.localError;
+            out.profile += segmentOut.profile;
+        }
+        out.nIterations++;
+        first++;
+
+        // Correction, in order: the boundary after the first segment is now the fine one
+        change = 0;
+        for (Index n = first - 1; n < nsegments; ++n) {
+            coarse = boundary[n];
+            CoarseSegment(coarse, segments[n], option.coarseSteps, workspace);
+            jump[n] += coarse;  // the new boundary
+            double norm = jump[n].norm();
+            if (norm > 0)
+                change = max(change, (jump[n] - boundary[n + 1]).norm() / norm);
+            swap(boundary[n + 1], jump[n]);
+            swap(jump[n], coarse);  // G(U(n)) of this sweep
+        }
+    }
+    e.field = boundary[nsegments];
+
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();  // End time
+
+    out.time         = chrono::duration<double>(end - begin).count();
+    out.samplingRate = gstate.SAMP_FREQ;
+    out.speedUp      = sequentialTime / out.time;
+    return out;
+}
+
+/**
+ * @brief Digital backpropagation (DBP) of a link at the receiver: the spans in
+ *        reverse order, each one undoing its amplifier gain and then its fiber with
+ *        the opposite dispersion and nonlinear coefficient and the loss recovered.
+ *        A span takes option.stepsPerSpan steps of equal length, each a linear step
+ *        followed by a nonlinear step over its effective length [Ip08]. The
+ *        operators of each fiber are computed once and shared by its spans, and the
+ *        steps of equal length reuse one cached dispersion operator. DBP knows no
+ *        waveplates, so the fibers are backpropagated without PMD, in double precision.
+ * @param e: received electric field, overwritten by the field at the link input.
+ * @param link: the fibers and the spans of the link.
+ * @param option: the DBP steps and nonlinear compensation.
+ * @param workspace: scratch buffers of the SSFM, shared by all the spans.
+ * @return out: counters summed over the spans, with the time of each span in out.spanTime
+ */
+Out digitalBackpropagation(E &e, const Link &link, const DbpOption &option, SsfmWorkspace &workspace) {
+
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();  // Start time
+
+    if (option.stepsPerSpan == 0)
+        ERROR("option.stepsPerSpan must be at least 1.");
+    vector<FiberSetup> setups(link.fibers.size());
+    for (size_t i = 0; i < link.fibers.size(); ++i) {
+        Fiber fiber        = link.fibers[i];
+        fiber.pmdParameter = 0;
+        fiber.coupling     = "none";
+        fiber.precision    = "double";
+        FiberSetup &setup  = setups[i];
+        SetupFiber(e, fiber, setup);
+        if (option.filterBandwidth > 0 && !setup.fiber.isUnique)
+            ERROR("Filtered DBP needs a unique field.");
+        setup.betat     = -setup.betat;
+        setup.fiber.gam = -setup.fiber.gam * option.gammaFactor;
+        setup.dispersion.reset(max(setup.fiber.dispersionCacheSize, 1u), setup.fiber.stepTolerance, setup.betat.rows(), setup.betat.cols());
+    }
+    VectorXd filter;  // response of the power filter, ordered as gstate.FN
+    if (option.filterBandwidth > 0)
+        filter = (gstate.FN.array() / option.filterBandwidth).square().unaryExpr([](double x) { return exp(-log(2) / 2 * x); });
+    workspace.resize(e.field.rows(), e.field.cols(), 1);
+
+    Out out = {};
+    out.spanTime.reserve(link.spans.size());
+    for (auto span = link.spans.rbegin(); span != link.spans.rend(); ++span) {
+        chrono::steady_clock::time_point spanBegin = chrono::steady_clock::now();
+        if (span->fiberType >= setups.size())
+            ERROR("Span fiber type out of link.fibers.");
+        FiberSetup &setup  = setups[span->fiberType];
+        const Fiber &fiber = setup.fiber;
+        e.field.array() /= sqrt(AmplifierGain(*span, fiber));
+
+        swap(workspace.dispersion, setup.dispersion);  // the operators of this fiber, without copies
+        double dz   = fiber.length / option.stepsPerSpan;
+        double gain = exp(0.5 * fiber.alphaLinear * dz);  // the loss of the step recovered
+        for (unsigned k = 1; k <= option.stepsPerSpan; ++k) {
+            CheckStep(k * dz, dz, fiber.length, workspace);
+            LinearStep(setup.linear.get(), setup.betat, e.field, workspace, gain);
+            if (fiber.gam == 0)
+                continue;
+            if (option.filterBandwidth > 0)
+                FilteredNonlinearStep(e.field, fiber, filter, workspace, dz);
+            else
+                NonlinearStep(e.field, fiber, workspace, dz);
+        }
+        swap(workspace.dispersion, setup.dispersion);
+        out.nCycle += option.stepsPerSpan;
+        out.spanTime.push_back(chrono::duration<double>(chrono::steady_clock::now() - spanBegin).count());
+    }
+    out.firstStepLength = link.spans.empty() ? 0 : setups[link.spans.back().fiberType].fiber.length / option.stepsPerSpan;
+    for (const FiberSetup &setup: setups) {
+        out.nDispersionHits += setup.dispersion.hits;
+        out.nDispersionMisses += setup.dispersion.misses;
+    }
+    out.nFft         = workspace.nFft;
+    out.nIfft        = workspace.nIfft;
+    out.samplingRate = gstate.SAMP_FREQ;
+    out.profile      = workspace.profile;
+
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();  // End time
+
+    out.time = chrono::duration<double>(end - begin).count();
+    return out;
+}
+
+// DISPERSIONCOEFFICIENTS returns beta2 [ns^2/m] and beta3 [ns^3/m] at the wavelength
+// LAMBDA [nm] of a fiber with DISPERSION [ps/nm/km] and SLOPE [ps/nm^2/km] there.
+
+tuple<double, double> DispersionCoefficients(double lambda, double dispersion, double slope) {
+    double b2 = -pow(lambda, 2) / 2 / M_PI / LIGHT_SPEED * dispersion * 1e-6;
+    double b3 = pow(lambda / 2 / M_PI / LIGHT_SPEED, 2) * (2 * lambda * dispersion + pow(lambda, 2) * slope) * 1e-6;
+    return make_tuple(b2, b3);
+}
+
+/**
+ * @brief Checks the fiber and computes its linear propagator, beta coefficients
+ *        and nonlinear coefficient for the wavelength of the field.
+ * @param e: electric field.
+ * @param fiber: the transmit fiber.
+ * @param setup: filled with the checked fiber and its operators.
+ */
+void SetupFiber(const E &e, Fiber fiber, FiberSetup &setup) {
     double diffGroupDelay;
-    Linear *linear;
-    tie(linear, diffGroupDelay) = CheckFiber(e, fiber);
+    tie(setup.linear, diffGroupDelay) = CheckFiber(e, fiber);
 
     /************************ SET-UP PARAMETERS ************************/
 
@@ -73,12 +696,9 @@ tuple<Out, E> fiberTransmit(E &e, Fiber fiber) {
     double b0 = 0;  // Phase reference of propagation constant
     double b1 = 0;  // Retarded time frame
 
-    // beta2 [ns^2/m] @ fiber.lambda
-    double b2 = -pow(fiber.lambda, 2) / 2 / M_PI / LIGHT_SPEED * fiber.dispersion *
-                1e-6;
-    // beta3 [ns^3/m] @ fiber.lambda
-    double b3 = pow(fiber.lambda / 2 / M_PI / LIGHT_SPEED, 2) * (2 * fiber.lambda * fiber.dispersion + pow(fiber.lambda, 2) * fiber.slope) * (1e-6);
-    MatrixXd betat;
+    double b2, b3;  // beta2 [ns^2/m] and beta3 [ns^3/m] @ fiber.lambda
+    tie(b2, b3) = DispersionCoefficients(fiber.lambda, fiber.dispersion, fiber.slope);
+    MatrixXd &betat  = setup.betat;
     Index omega_size = omega.size();
 
     double domega_i  = 2 * M_PI * LIGHT_SPEED * (1. / e.lambda(0, 0) - 1. / fiber.lambda);  // [1/ns]
@@ -94,11 +714,31 @@ tuple<Out, E> fiberTransmit(E &e, Fiber fiber) {
         // betat: deterministic beta coefficient [1/m]
         if (fiber.isDual) {  // Add DGD on polarizations
             betat.conservativeResize(omega_size, 2);
-            betat.col(ipm + 1) = betat.col(ipm) - diffGroupDelay / 2 * omega;
+            betat.col(ipm + 1) = betat.col(ipm) - diffGroupDelay * omega;
         }
-    } else {                                         // Separate field
-        double freq = LIGHT_SPEED / e.lambda(0, 0);  // carrier frequencies [GHz]
-        // Separate field 情况还没有实现
+    } else {  // Separate field: one set of columns per channel, each sampled at the channel bandwidth
+        Index nch  = e.lambda.size();
+        Index npol = fiber.isDual ? 2 : 1;
+        RowVectorXd freq = LIGHT_SPEED / e.lambda.array();                           // carrier frequencies [GHz]
+        RowVectorXd dw   = 2 * M_PI * (freq.array() - LIGHT_SPEED / fiber.lambda);  // [1/ns] @ channels
+
+        // Phase and retarded time frame refer to the comb center, as in a unique field
+        // centered there: the channels walk off by their beta1 difference.
+        double dwc    = 2 * M_PI * (freq.mean() - LIGHT_SPEED / fiber.lambda);  // [1/ns]
+        double beta2c = b2 + b3 * dwc;                                          // beta2 [ns^2/m] @ comb center
+        VectorXd unit = VectorXd::Ones(omega_size);
+        betat.resize(omega_size, nch * npol);
+        for (Index k = 0; k < nch; ++k) {
+            double dk           = dw[k] - dwc;                                               // [1/ns] from the comb center
+            double beta0        = b0 + beta2c / 2 * dk * dk + b3 / 6 * dk * dk * dk;         // [1/m] @ channel
+            double beta1        = b1 + beta2c * dk + b3 / 2 * dk * dk + diffGroupDelay / 2;  // [ns/m] @ channel
+            double beta2        = beta2c + b3 * dk;                                          // [ns^2/m] @ channel
+            betat.col(npol * k) = omega.cwiseProduct((omega.cwiseProduct(omega * b3 / 6 + unit * beta2 / 2)) + unit * beta1) + unit * beta0;
+            if (fiber.isDual)
+                betat.col(npol * k + 1) = betat.col(npol * k) - diffGroupDelay * omega;
+        }
+        if (fiber.bandwidth == 0)
+            fiber.bandwidth = freq.maxCoeff() - freq.minCoeff() + gstate.SAMP_FREQ;  // the whole comb [GHz]
     }
 
     /******* Nonlinear Parameters *******/
@@ -107,7 +747,7 @@ tuple<Out, E> fiberTransmit(E &e, Fiber fiber) {
     if (!fiber.isKerr) {
         gam = 0;
     } else {
-        gam = (2 * M_PI * fiber.nonlinearIndex) / (e.lambda(0, 0) * fiber.effectiveArea * 1e18);  // Nonlinear coeff [1/mW/m]
+        gam = (2 * M_PI * fiber.nonlinearIndex) / (e.lambda(0, 0) * fiber.effectiveArea) * 1e18;  // Nonlinear coeff [1/mW/m]
         if (isinf(gam))
             ERROR("Cannot continue: not finite nonlinear Kerr coefficient.");
     }
@@ -131,49 +771,285 @@ tuple<Out, E> fiberTransmit(E &e, Fiber fiber) {
         fiber.maxStepLength     = fiber.length;
     }
 
-    /********** SSFM Propagation **********/
+    setup.fiber = fiber;
+}
 
+/**
+ * @brief Propagates the field over a fiber prepared by SetupFiber.
+ * @param e: electric field, overwritten by the field at the fiber output.
+ * @param setup: checked fiber and its operators.
+ * @param workspace: scratch buffers of the SSFM, holding the dispersion cache of this fiber.
+ * @param checkpoint: checkpoints of the step loop, or nullptr.
+ * @param resume: the checkpoint to continue from, or nullptr. E.field then holds its
+ *        field, the spectrum with the local error method.
+ * @param monitor: field monitors of the step loop, or nullptr.
+ * @return out: fiber option, without the time
+ */
+Out PropagateFiber(E &e, FiberSetup &setup, SsfmWorkspace &workspace, Checkpoint *checkpoint, const SsfmState *resume, Monitor *monitor) {
+    Fiber fiber    = setup.fiber;
+    fiber.chlambda = e.lambda(0, 0);
     double first_dz;
     unsigned long ncycle;
 
-    tie(first_dz, ncycle, e) = SSFM(e, linear, betat, fiber);
+    bool isRk4ip = fiber.isRk4ip && fiber.gam != 0;  // without Kerr effect a single step is exact
+    bool isLem   = fiber.isLem && fiber.gam != 0 && !isRk4ip;
+    workspace.resize(e.field.rows(), e.field.cols(), (Index) fiber.nWavePlates, isLem, fiber.isSingle, isRk4ip);
+    if (resume != nullptr) {
+        workspace.nFft       = resume->nFft;
+        workspace.nIfft      = resume->nIfft;
+        workspace.nRejected  = resume->nRejected;
+        workspace.localError = resume->localError;
+    }
+    if (fiber.isSingle) {  // the field is rounded to single precision for the whole fiber
+        MatrixXcf &field = workspace.singleField;
+        field            = e.field.cast<complex<float>>();
+        if (isRk4ip)
+            tie(first_dz, ncycle) = RungeKuttaSSFM(field, setup.linear.get(), setup.betat, fiber, workspace, checkpoint, resume, monitor);
+        else if (isLem)
+            tie(first_dz, ncycle) = LocalErrorSSFM(field, setup.linear.get(), setup.betat, fiber, workspace, checkpoint, resume, monitor);
+        else
+            tie(first_dz, ncycle) = SSFM(field, setup.linear.get(), setup.betat, fiber, workspace, checkpoint, resume, monitor);
+        e.field.array() = field.cast<complex<double>>().array();
+    } else if (isRk4ip) {
+        tie(first_dz, ncycle) = RungeKuttaSSFM<MatrixXcd>(e.field, setup.linear.get(), setup.betat, fiber, workspace, checkpoint, resume, monitor);
+    } else if (isLem) {
+        tie(first_dz, ncycle) = LocalErrorSSFM<MatrixXcd>(e.field, setup.linear.get(), setup.betat, fiber, workspace, checkpoint, resume, monitor);
+    } else {
+        tie(first_dz, ncycle) = SSFM<MatrixXcd>(e.field, setup.linear.get(), setup.betat, fiber, workspace, checkpoint, resume, monitor);
+    }
 
-    chrono::steady_clock::time_point end = chrono::steady_clock::now();  // End time
+    Out out = {.time              = 0,
+               .firstStepLength   = first_dz,
+               .nCycle            = ncycle,
+               .nDispersionHits   = workspace.dispersion.hits,
+               .nDispersionMisses = workspace.dispersion.misses,
+               .nFft              = workspace.nFft,
+               .nIfft             = workspace.nIfft,
+               .nRejected         = workspace.nRejected,
+               .localError        = workspace.localError,
+               .samplingRate      = gstate.SAMP_FREQ};
+    out.profile = workspace.profile;
+    return out;
+}
 
-    long long duration_ms = chrono::duration_cast<chrono::milliseconds>(end - begin).count();
-    double time           = (double) duration_ms / 1000;
+// FINESEGMENT propagates the field over a segment of linkParareal with the SSFM and
+// then through the amplifier gain at its end. The time [s] is in out.time.
+
+Out FineSegment(E &e, const PararealSegment &segment, SsfmWorkspace &workspace) {
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    FiberSetup &setup                      = *segment.setup;
+    workspace.dispersion.reset(max(setup.fiber.dispersionCacheSize, 1u), setup.fiber.stepTolerance, setup.betat.rows(), setup.betat.cols(),
+                               setup.fiber.isSingle);
+    Out out = PropagateFiber(e, setup, workspace);
+    if (segment.gain != 1)
+        e.field.array() *= segment.gain;
+    out.time = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    return out;
+}
 
-    Out out = {.time = time, .firstStepLength = first_dz, .nCycle = ncycle};
-    return make_tuple(out, e);
+// COARSESEGMENT is the coarse propagator of linkParareal: STEPS steps of equal length
+// over the segment, each a nonlinear step followed by a linear step with the loss of the
+// step, or a single linear step without STEPS; then the amplifier gain of the segment.
+// The steps of equal length reuse one cached dispersion operator of the segment.
+
+void CoarseSegment(MatrixXcd &field, const PararealSegment &segment, unsigned steps, SsfmWorkspace &workspace) {
+    FiberSetup &setup  = *segment.setup;
+    const Fiber &fiber = setup.fiber;
+    swap(workspace.dispersion, setup.dispersion);  // the operators of this segment, without copies
+    if (steps == 0 || fiber.gam == 0) {
+        CheckStep(fiber.length, fiber.length, fiber.length, workspace);
+        LinearStep(setup.linear.get(), setup.betat, field, workspace, exp(-0.5 * fiber.alphaLinear * fiber.length) * segment.gain);
+    } else {
+        double dz   = fiber.length / steps;
+        double gain = exp(-0.5 * fiber.alphaLinear * dz);  // the loss of the step
+        for (unsigned k = 1; k <= steps; ++k) {
+            NonlinearStep(field, fiber, workspace, dz, gain);
+            CheckStep(k * dz, dz, fiber.length, workspace);
+            LinearStep(setup.linear.get(), setup.betat, field, workspace, k == steps ? segment.gain : 1.);
+        }
+    }
+    swap(workspace.dispersion, setup.dispersion);
+}
+
+// RECORDSTEP adds a step on the field to the tape of fiberGradient. Single-precision
+// fields have no adjoint.
+
+void RecordStep(SsfmWorkspace &workspace, const MatrixXcd &field, bool isLinear, double dz, double gain) {
+    workspace.tape->record(field, isLinear, dz, gain);
+}
+
+void RecordStep(SsfmWorkspace &, const MatrixXcf &, bool, double, double) {
+    ERROR("Adjoint gradients need double precision.");
+}
+
+// REPLAYSTEP applies a recorded step of fiberGradient to the field again.
+
+void ReplayStep(const SsfmTape::Step &step, MatrixXcd &field, FiberSetup &setup, SsfmWorkspace &workspace) {
+    if (step.isLinear) {
+        workspace.dzb.assign(1, step.dz);
+        workspace.nindex.assign(1, 1);
+        LinearStep(setup.linear.get(), setup.betat, field, workspace, step.gain);
+    } else {
+        NonlinearStep(field, setup.fiber, workspace, step.dz, step.gain);
+    }
 }
 
-tuple<double, unsigned long, E> SSFM(E e, Linear *linear, const VectorXd &betat, Fiber fiber) {
-    if (fiber.trace) {
-        cout << "Stepupd      step #   z [m]" << endl;
+// ADJOINTLINEARSTEP takes the gradient with respect to the output of a linear step,
+// V = IFFT(gain * exp(-i*betat*dz) .* FFT(U)) of input STATE, back to the gradient with
+// respect to U: the linear step of -dz. With the Parseval relation the derivative with
+// respect to a parameter p of betat is dz/N * sum(dbetat/dp .* imag(conj(FFT(gradient)) .* FFT(V))).
+// Without Kerr effect the fiber is a single linear step whose gain is the loss of the fiber.
+
+void AdjointLinearStep(const SsfmTape::Step &step, const MatrixXcd &state, FiberSetup &setup, const MatrixXd &dispersionBeta, const MatrixXd &slopeBeta,
+                       SsfmWorkspace &workspace, FiberGradient &gradient) {
+    MatrixXcd &output  = workspace.spectrum;  // spectrum of V
+    MatrixXcd &adjoint = workspace.coarse;    // spectrum of the gradient
+    const Fiber &fiber = setup.fiber;
+    double n           = (double) state.rows();
+    Fft(state, output, workspace);
+    Fft(gradient.field, adjoint, workspace);
+    const MatrixXcd &propagator = DispersionOperator<MatrixXcd>(setup.betat, step.dz, workspace);
+    for (Index j = 0; j < state.cols(); ++j) {
+        Index c = j % propagator.cols();
+        output.col(j).array() *= propagator.col(c).array() * step.gain;
+        ArrayXd product = (adjoint.col(j).conjugate().array() * output.col(j).array()).imag();
+        gradient.dispersion += step.dz / n * (dispersionBeta.col(c).array() * product).sum();
+        gradient.slope += step.dz / n * (slopeBeta.col(c).array() * product).sum();
+        if (fiber.gam == 0)
+            gradient.attenuation -= fiber.length / 2 / n * (adjoint.col(j).conjugate().array() * output.col(j).array()).real().sum();
+        adjoint.col(j).array() *= propagator.col(c).array().conjugate() * step.gain;
+    }
+    Ifft(adjoint, gradient.field, workspace);
+}
+
+// ADJOINTNONLINEARSTEP takes the gradient L with respect to the output of a nonlinear
+// step, V = gain * U .* exp(-i*c*P) with c = gam * leff and P the power of the input
+// STATE (of both polarizations in dual polarization), back to the gradient with respect
+// to U: conj(gain * exp(-i*c*P)) .* L + 2 * c * S .* U, with S = imag(conj(L) .* V)
+// summed over the polarizations. The derivative with respect to c is sum(P .* S), and
+// the gain exp(-alpha*dz/2) adds -dz/2 * real(sum(conj(L) .* V)) to the one of alpha.
+
+void AdjointNonlinearStep(const SsfmTape::Step &step, const MatrixXcd &state, const Fiber &fiber, FiberGradient &gradient) {
+    double alpha = fiber.alphaLinear;
+    double leff, dleff;  // effective length [m] and its derivative with respect to alpha
+    if (alpha == 0) {
+        leff  = step.dz;
+        dleff = -step.dz * step.dz / 2;
+    } else {
+        leff  = (1 - exp(-alpha * step.dz)) / alpha;
+        dleff = (step.dz * exp(-alpha * step.dz) - leff) / alpha;
     }
-    fiber.chlambda       = e.lambda(0, 0);
+    double c     = fiber.gam * leff;
+    Index npol   = fiber.isDual ? 2 : 1;
+    MatrixXcd &l = gradient.field;
+    double dc    = 0;  // derivative of the loss with respect to c
+    double dgain = 0;  // real(sum(conj(L) .* V))
+    for (Index j = 0; j + npol <= state.cols(); j += npol) {
+        for (Index i = 0; i < state.rows(); ++i) {
+            double p = 0;
+            for (Index k = j; k < j + npol; ++k)
+                p += norm(state(i, k));
+            complex<double> w = polar(step.gain, -c * p);
+            double s          = 0;
+            for (Index k = j; k < j + npol; ++k) {
+                complex<double> product = conj(l(i, k)) * state(i, k) * w;
+                s += product.imag();
+                dgain += product.real();
+            }
+            for (Index k = j; k < j + npol; ++k)
+                l(i, k) = conj(w) * l(i, k) + 2 * c * s * state(i, k);
+            dc += p * s;
+        }
+    }
+    gradient.nonlinearIndex += leff * dc;
+    gradient.attenuation += fiber.gam * dleff * dc - step.dz / 2 * dgain;
+}
+
+// AMPLIFIERGAIN is the power gain of the amplifier of a span: the loss of its fiber,
+// or span.gain.
+
+double AmplifierGain(const Span &span, const Fiber &fiber) {
+    double gainDb = span.isLossRecovered ? fiber.attenuation * fiber.length * 1e-3 : span.gain;  // [dB]
+    return pow(10, gainDb / 10);
+}
+
+/**
+ * @brief Lumped optical amplifier at the end of a span, with flat gain and, if
+ *        span.isAse, the ASE noise of its noise figure added to each polarization.
+ * @param field: electric field, amplified in place.
+ * @param span: the amplifier gain and noise figure.
+ * @param fiber: the fiber of the span, whose loss is the default gain.
+ * @param lambda: wavelength [nm] of the field.
+ * @param generator: random generator of the noise.
+ */
+void Amplifier(MatrixXcd &field, const Span &span, const Fiber &fiber, double lambda, mt19937 &generator) {
+    double gain = AmplifierGain(span, fiber);
+    field.array() *= sqrt(gain);
+    if (!span.isAse || gain <= 1)
+        return;
+
+    double nsp   = pow(10, span.noiseFigure / 10) / 2;            // spontaneous emission factor
+    double freq  = LIGHT_SPEED / lambda * 1e9;                    // carrier frequency [Hz]
+    double n0    = (gain - 1) * nsp * PLANK_CONST * freq * 1e12;  // ASE spectral density [mW/GHz] per polarization
+    double sigma = sqrt(n0 * gstate.SAMP_FREQ / 2);               // standard deviation per quadrature [sqrt(mW)]
+    normal_distribution<double> noise(0, sigma);
+    for (Index j = 0; j < field.cols(); ++j)
+        for (Index i = 0; i < field.rows(); ++i) {
+            double re = noise(generator);  // in this order, for the noise of a seed to be the same with all compilers
+            double im = noise(generator);
+            field(i, j) += complex<double>(re, im);
+        }
+}
+
+template<typename Field>
+tuple<double, unsigned long> SSFM(Field &field, Linear *linear, const MatrixXd &betat, Fiber fiber, SsfmWorkspace &workspace, Checkpoint *checkpoint,
+                                  const SsfmState *resume, Monitor *monitor) {
     unsigned long ncycle = 1;                                 // number of steps
     double len_corr      = fiber.length / fiber.nWavePlates;  // waveplate length [m]
     double dz, phimax, dzs;
-
-    tie(dz, phimax)   = FirstStep(e.field, fiber);
+    {
+        PhaseTimer timer(workspace.profile.stepControl);
+        tie(dz, phimax) = FirstStep(field, fiber);
+    }
+    double dzNominal  = dz;  // step before the rounding to fiber.stepGrid [m]
+    double dzsNominal = 0;
+    dz                = SnapStep(dz, fiber);
     double half_alpha = 0.5 * fiber.alphaLinear;  // [1/m]
     double first_dz   = dz;
     double zprop      = dz;  // running distance [m]
 
-    RowVectorXd dzb, nindex;
-    if (fiber.isSym) {  // first half LIN step outside the cycle
-        tie(dzb, nindex) = CheckStep(dz / 2, dz / 2, len_corr);
-        e.field          = LinearStep(linear, betat, dzb, nindex, e.field);  // Linear step
-    } else {
+    // The first half LIN step of the symmetric scheme is only applied when a nonlinear
+    // step needs the time samples; without nonlinear steps it merges with the last one.
+    bool halfStep = fiber.isSym;
+    if (!fiber.isSym)
         dzs = 0;  // symmetric step contribution.
+
+    if (resume != nullptr) {  // the loop continues after the step of the checkpoint
+        zprop      = resume->zprop;
+        dz         = resume->dz;
+        dzNominal  = resume->dzNominal;
+        dzs        = resume->dzs;
+        dzsNominal = resume->dzsNominal;
+        first_dz   = resume->firstDz;
+        ncycle     = resume->ncycle;
+        halfStep   = resume->halfStep;
     }
-    while (zprop < fiber.length) {                    // all steps except the last
-        e.field = NonlinearStep(e.field, fiber, dz);  // Nonlinear step
-        e.field = e.field * exp(-half_alpha * dz);    // Linear step 1/2: attenuation (scalar)
+    Field &spectrum = SsfmPrecision<Field>::spectrum(workspace);  // the spectrum of the field after each linear step
+    MonitorStep(monitor, halfStep || !fiber.isSym ? zprop - dz : zprop - dz / 2, ncycle - 1, field, spectrum, true, false);
+
+    while (zprop < fiber.length) {  // all steps except the last
+        if (halfStep) {             // first half LIN step outside the cycle
+            CheckStep(dz / 2, dz / 2, len_corr, workspace);
+            LinearStep(linear, betat, field, workspace);
+            halfStep = false;
+        }
+        // Nonlinear step and linear step 1/2: attenuation (scalar), in one pass
+        double pmax = NonlinearStep(field, fiber, workspace, dz, exp(-half_alpha * dz));
         double hlin;
         if (fiber.isSym) {
-            dzs = NextStep(e.field, fiber, dz);
+            PhaseTimer timer(workspace.profile.stepControl);
+            dzsNominal = NextStep(field, fiber, dzNominal, pmax);
+            dzs        = SnapStep(dzsNominal, fiber);
             if (zprop + dzs > fiber.length)
                 dzs = fiber.length - zprop;  // needed in case of last step
             hlin = (dz + dzs) / 2;
@@ -182,37 +1058,295 @@ tuple<double, unsigned long, E> SSFM(E e, Linear *linear, const VectorXd &betat,
         }
 
         // Linear step 2/2: GVD + birefringence
-        tie(dzb, nindex) = CheckStep(zprop + dzs / 2, hlin, len_corr);       // zprop+dzs/2: end of step
-        e.field          = LinearStep(linear, betat, dzb, nindex, e.field);  // Linear step
+        CheckStep(zprop + dzs / 2, hlin, len_corr, workspace);  // zprop+dzs/2: end of step
+        LinearStep(linear, betat, field, workspace);            // Linear step
         if (fiber.isSym) {
             swap(dz, dzs);  // exchange dz and dzs
+            swap(dzNominal, dzsNominal);
         } else {
-            dz = NextStep(e.field, fiber, dz);
+            PhaseTimer timer(workspace.profile.stepControl);
+            dzNominal = NextStep(field, fiber, dzNominal);
+            dz        = SnapStep(dzNominal, fiber);
         }
 
         zprop += dz;
         ncycle++;
+
+        if (checkpoint != nullptr && checkpoint->isDue(zprop - dz, ncycle - 1)) {
+            SsfmState state;
+            state.zprop      = zprop;
+            state.dz         = dz;
+            state.dzNominal  = dzNominal;
+            state.dzs        = dzs;
+            state.dzsNominal = dzsNominal;
+            state.firstDz    = first_dz;
+            state.ncycle     = ncycle;
+            state.halfStep   = halfStep;
+            checkpoint->save(state, field, workspace);
+        }
+        MonitorStep(monitor, fiber.isSym ? zprop - dz / 2 : zprop - dz, ncycle - 1, field, spectrum, true, true);  // the symmetric step stops in the middle of the next step
     }
 
     double last_step = fiber.length - zprop + dz;
     zprop            = zprop - dz + last_step;
     double hlin      = fiber.isSym ? last_step / 2 : last_step;
+    double gain      = exp(-half_alpha * last_step);
 
     // Last Nonlinear step
-    if (fiber.gam != 0)
-        e.field = NonlinearStep(e.field, fiber, last_step);
+    if (fiber.gam != 0) {
+        if (halfStep) {
+            CheckStep(dz / 2, dz / 2, len_corr, workspace);
+            LinearStep(linear, betat, field, workspace);
+        }
+        NonlinearStep(field, fiber, workspace, last_step, gain);
+        gain = 1;
+    } else if (halfStep) {  // two adjacent half LIN steps: one FFT pair
+        hlin += dz / 2;
+    }
+
+    // Last Linear step: GVD + birefringence, and the attenuation if not done yet
+    CheckStep(fiber.length, hlin, len_corr, workspace);
+    LinearStep(linear, betat, field, workspace, gain);
+    MonitorStep(monitor, fiber.length, ncycle, field, spectrum, true, true);
+
+    return make_tuple(first_dz, ncycle);
+}
+
+// LOCALERRORSSFM is the SSFM with the local error method [Sin03]: each step DZ is
+// done once with a symmetric step of DZ (coarse) and twice with symmetric steps of
+// DZ/2 (fine). Their relative difference is the local error of the step; the step
+// is rejected above twice fiber.errorTolerance and otherwise kept as the Richardson
+// extrapolation 4/3 fine - 1/3 coarse. The field stays in the frequency domain
+// between steps, so the coarse and fine solutions share the FFT of the starting
+// spectrum and the extrapolation needs no inverse FFT.
+
+template<typename Field>
+tuple<double, unsigned long> LocalErrorSSFM(Field &field, Linear *linear, const MatrixXd &betat, Fiber fiber, SsfmWorkspace &workspace, Checkpoint *checkpoint,
+                                            const SsfmState *resume, Monitor *monitor) {
+    typedef typename Field::RealScalar Real;
+    const double GROWTH   = cbrt(2.);  // step factor of the error control
+    const double MIN_STEP = 1e-9;      // smallest step as a fraction of the fiber length
+
+    unsigned long ncycle = 0;                                 // number of accepted steps
+    double len_corr      = fiber.length / fiber.nWavePlates;  // waveplate length [m]
+    double half_alpha    = 0.5 * fiber.alphaLinear;           // [1/m]
+    double tolerance     = fiber.errorTolerance;
+    double dzNominal, phimax;
+    {
+        PhaseTimer timer(workspace.profile.stepControl);
+        tie(dzNominal, phimax) = FirstStep(field, fiber);
+    }
+    double first_dz = 0;
+    double zprop    = 0;  // distance [m] at the start of the step
+
+    Field &spectrum = SsfmPrecision<Field>::spectrum(workspace);
+    Field &coarse   = SsfmPrecision<Field>::coarse(workspace);
+    Field &fine     = SsfmPrecision<Field>::fine(workspace);  // the field is the time-domain buffer of the nonlinear steps
+    if (resume != nullptr) {                                  // the field holds the spectrum of the checkpoint
+        spectrum.array() = field.array();
+        zprop            = resume->zprop;
+        dzNominal        = resume->dzNominal;
+        first_dz         = resume->firstDz;
+        ncycle           = resume->ncycle;
+    } else {
+        Fft(field, spectrum, workspace);
+    }
+    MonitorStep(monitor, zprop, ncycle, field, spectrum, resume == nullptr, true);
+
+    while (zprop < fiber.length) {
+        double dz = min(SnapStep(dzNominal, fiber), fiber.length - zprop);
+        double h  = dz / 2;
+        if (dz < MIN_STEP * fiber.length)
+            ERROR("Cannot continue: the step needed for fiber.errorTolerance is too small.");
+
+        // Coarse solution: LIN dz/2, NL dz, LIN dz/2
+        coarse.array() = spectrum.array();
+        CheckStep(zprop + h, h, len_corr, workspace);
+        LinearSpectrumStep(linear, betat, coarse, workspace);
+        Ifft(coarse, field, workspace);
+        NonlinearStep(field, fiber, workspace, dz, exp(-half_alpha * dz));
+        Fft(field, coarse, workspace);
+        CheckStep(zprop + dz, h, len_corr, workspace);
+        LinearSpectrumStep(linear, betat, coarse, workspace);
+
+        // Fine solution: two symmetric steps of dz/2, with the middle LIN steps merged
+        fine.array() = spectrum.array();
+        CheckStep(zprop + h / 2, h / 2, len_corr, workspace);
+        LinearSpectrumStep(linear, betat, fine, workspace);
+        Ifft(fine, field, workspace);
+        NonlinearStep(field, fiber, workspace, h, exp(-half_alpha * h));
+        Fft(field, fine, workspace);
+        CheckStep(zprop + 3 * h / 2, h, len_corr, workspace);
+        LinearSpectrumStep(linear, betat, fine, workspace);
+        Ifft(fine, field, workspace);
+        NonlinearStep(field, fiber, workspace, h, exp(-half_alpha * h));
+        Fft(field, fine, workspace);
+        CheckStep(zprop + dz, h / 2, len_corr, workspace);
+        LinearSpectrumStep(linear, betat, fine, workspace);
+
+        double delta = 0;  // relative local error, by Parseval, of the least accurate realization
+        {
+            PhaseTimer timer(workspace.profile.stepControl);
+            for (Index c = 0; c < fine.cols(); c += betat.cols())
+                delta = max(delta, (double) ((fine.middleCols(c, betat.cols()) - coarse.middleCols(c, betat.cols())).norm() / fine.middleCols(c, betat.cols()).norm()));
+        }
+        if (delta > 2 * tolerance) {  // reject and halve the step
+            workspace.nRejected++;
+            dzNominal = h;
+            continue;
+        }
+        spectrum.array() = fine.array() * (Real) (4. / 3) - coarse.array() * (Real) (1. / 3);
+        if (ncycle == 0)
+            first_dz = dz;
+        zprop += dz;
+        ncycle++;
+        workspace.localError += delta;
+
+        if (delta > tolerance)
+            dzNominal /= GROWTH;
+        else if (delta < tolerance / 2)
+            dzNominal = min(dzNominal * GROWTH, fiber.maxStepLength);
+
+        if (checkpoint != nullptr && checkpoint->isDue(zprop, ncycle)) {
+            SsfmState state;
+            state.zprop     = zprop;
+            state.dzNominal = dzNominal;
+            state.firstDz   = first_dz;
+            state.ncycle    = ncycle;
+            checkpoint->save(state, spectrum, workspace);
+        }
+        MonitorStep(monitor, zprop, ncycle, field, spectrum, false, true);  // the field is scratch between steps
+    }
+    Ifft(spectrum, field, workspace);
+    MonitorStep(monitor, fiber.length, ncycle, field, spectrum, true, true);
 
-    e.field = e.field * exp(-half_alpha * last_step);
+    return make_tuple(first_dz, ncycle);
+}
 
-    // Last Linear step: GVD + birefringence
-    tie(dzb, nindex) = CheckStep(fiber.length, hlin, len_corr);
+// RUNGEKUTTASSFM is the fourth-order Runge-Kutta method in the interaction picture
+// (RK4IP) [Hul07]: the linear operator of half a step moves the field to the
+// interaction picture at the middle of the step, where the Kerr term is integrated by
+// the four classical Runge-Kutta stages. The Kerr increment k5 of the new field gives
+// the embedded third-order solution of [Bal13], (k4 - k5) / 10 away from the
+// fourth-order one: relative to the field, it is the local error of the step, rejected
+// above twice fiber.errorTolerance, and the next step follows it. k5 is also the first
+// stage of the next step (first same as last), so a step takes four Kerr increments and
+// four linear steps, whose two half-step lengths the dispersion cache serves.
+
+template<typename Field>
+tuple<double, unsigned long> RungeKuttaSSFM(Field &field, Linear *linear, const MatrixXd &betat, Fiber fiber, SsfmWorkspace &workspace, Checkpoint *checkpoint,
+                                            const SsfmState *resume, Monitor *monitor) {
+    typedef typename Field::RealScalar Real;
+    const double SAFETY     = 0.9;   // step factor of the error control below its optimum
+    const double MAX_GROWTH = 2;     // largest step factor
+    const double MIN_SHRINK = 0.2;   // smallest step factor
+    const double MIN_STEP   = 1e-9;  // smallest step as a fraction of the fiber length
+
+    unsigned long ncycle = 0;                                 // number of accepted steps
+    double len_corr      = fiber.length / fiber.nWavePlates;  // waveplate length [m]
+    double half_alpha    = 0.5 * fiber.alphaLinear;           // [1/m]
+    double tolerance     = fiber.errorTolerance;
+    double dzNominal, phimax;
+    {
+        PhaseTimer timer(workspace.profile.stepControl);
+        tie(dzNominal, phimax) = FirstStep(field, fiber);
+    }
+    double first_dz = 0;
+    double zprop    = 0;  // distance [m] at the start of the step
+    double lastDz   = 0;  // length [m] of the last accepted step, 0 before the first
+
+    Field &spectrum    = SsfmPrecision<Field>::spectrum(workspace);
+    Field &solution    = SsfmPrecision<Field>::coarse(workspace);  // fourth-order solution
+    Field &last        = SsfmPrecision<Field>::fine(workspace);    // Kerr increment k5 of the last accepted step
+    Field &interaction = SsfmPrecision<Field>::interaction(workspace);
+    Field &stage       = SsfmPrecision<Field>::stage(workspace);
+    Field &increment   = SsfmPrecision<Field>::increment(workspace);
+    if (resume != nullptr) {
+        zprop     = resume->zprop;
+        dzNominal = resume->dzNominal;
+        first_dz  = resume->firstDz;
+        ncycle    = resume->ncycle;
+        lastDz    = resume->lastDz;
+        if (lastDz > 0)
+            KerrIncrement(field, last, fiber, workspace, lastDz);  // as computed at the end of that step
+    }
+    MonitorStep(monitor, zprop, ncycle, field, spectrum, true, false);
+
+    while (zprop < fiber.length) {
+        double dz = min(SnapStep(dzNominal, fiber), fiber.length - zprop);
+        double h  = dz / 2;
+        if (dz < MIN_STEP * fiber.length)
+            ERROR("Cannot continue: the step needed for fiber.errorTolerance is too small.");
+        double gain = exp(-half_alpha * h);
+
+        // Interaction picture at the middle of the step: A_I = P(A), k1 = P(dz * N(A))
+        interaction.array() = field.array();
+        if (lastDz > 0)
+            increment.array() = last.array() * (Real) (dz / lastDz);
+        else
+            KerrIncrement(field, increment, fiber, workspace, dz);
+        CheckStep(zprop + h, h, len_corr, workspace);
+        LinearStep(linear, betat, interaction, workspace, gain);
+        LinearStep(linear, betat, increment, workspace, gain);
+
+        // k2 = dz * N(A_I + k1/2), k3 = dz * N(A_I + k2/2), summed up in the solution
+        solution.array() = interaction.array() + increment.array() * (Real) (1. / 6);
+        stage.array()    = interaction.array() + increment.array() * (Real) 0.5;
+        KerrIncrement(stage, increment, fiber, workspace, dz);
+        solution.array() += increment.array() * (Real) (1. / 3);
+        stage.array() = interaction.array() + increment.array() * (Real) 0.5;
+        KerrIncrement(stage, increment, fiber, workspace, dz);
+        solution.array() += increment.array() * (Real) (1. / 3);
+        stage.array() = interaction.array() + increment.array();
+
+        // Out of the interaction picture: k4 = dz * N(P(A_I + k3)), A = P(sum) + k4/6
+        CheckStep(zprop + dz, h, len_corr, workspace);
+        LinearStep(linear, betat, stage, workspace, gain);
+        KerrIncrement(stage, increment, fiber, workspace, dz);
+        LinearStep(linear, betat, solution, workspace, gain);
+        solution.array() += increment.array() * (Real) (1. / 6);
+        KerrIncrement(solution, stage, fiber, workspace, dz);  // k5
+
+        double delta = 0;  // relative local error of the least accurate realization
+        double factor;     // of the step length
+        {
+            PhaseTimer timer(workspace.profile.stepControl);
+            for (Index c = 0; c < solution.cols(); c += betat.cols())
+                delta = max(delta, (double) ((increment.middleCols(c, betat.cols()) - stage.middleCols(c, betat.cols())).norm() / (10 * solution.middleCols(c, betat.cols()).norm())));
+            factor = delta > 0 ? min(max(SAFETY * pow(tolerance / delta, 0.25), MIN_SHRINK), MAX_GROWTH) : MAX_GROWTH;
+        }
+        if (delta > 2 * tolerance) {  // reject and shorten the step
+            workspace.nRejected++;
+            dzNominal = dz * factor;
+            continue;
+        }
+        field.array() = solution.array();
+        last.swap(stage);
+        lastDz = dz;
+        if (ncycle == 0)
+            first_dz = dz;
+        zprop += dz;
+        ncycle++;
+        workspace.localError += delta;
+        dzNominal = min(dzNominal * factor, fiber.maxStepLength);
+
+        if (checkpoint != nullptr && checkpoint->isDue(zprop, ncycle)) {
+            SsfmState state;
+            state.zprop     = zprop;
+            state.dzNominal = dzNominal;
+            state.firstDz   = first_dz;
+            state.lastDz    = lastDz;
+            state.ncycle    = ncycle;
+            checkpoint->save(state, field, workspace);
+        }
+        MonitorStep(monitor, zprop, ncycle, field, spectrum, true, false);
+    }
 
-    e.field        = LinearStep(linear, betat, dzb, nindex, e.field);
-    e.lambda(0, 0) = fiber.chlambda;
-    return make_tuple(first_dz, ncycle, e);
+    return make_tuple(first_dz, ncycle);
 }
 
-tuple<double, double> FirstStep(const MatrixXcd &field, Fiber fiber) {
+template<typename Field>
+tuple<double, double> FirstStep(const Field &field, Fiber fiber) {
     double step;
     double phimax;
     if (fiber.length == fiber.maxStepLength) {
@@ -220,13 +1354,14 @@ tuple<double, double> FirstStep(const MatrixXcd &field, Fiber fiber) {
         phimax = INFINITY;
     } else {
         if (fiber.dphiFwm) {
-            fiber.bandwidth = gstate.SAMP_FREQ;
+            if (fiber.bandwidth == 0)
+                fiber.bandwidth = gstate.SAMP_FREQ;
             double spac     = fiber.bandwidth * pow(fiber.chlambda, 2) / LIGHT_SPEED;  // bandwidth in [nm]
             step            = (fiber.accuracyParameter / abs(fiber.dispersion) / (2 * M_PI * spac * fiber.bandwidth * 1e-3) * 1e3);
             if (step > fiber.maxStepLength)
                 step = fiber.maxStepLength;
             if (fiber.stepUpdate == "nlp") {                               // nonlinear phase criterion
-                double invLnl = field.cwiseAbs2().maxCoeff() * fiber.gam;  // Max of 1/Lnl [1/m]
+                double invLnl = PeakPower(field, fiber) * fiber.gam;  // Max of 1/Lnl [1/m]
                 double leff;
                 if (fiber.alphaLinear == 0)
                     leff = step;
@@ -237,30 +1372,31 @@ tuple<double, double> FirstStep(const MatrixXcd &field, Fiber fiber) {
                 phimax = fiber.accuracyParameter;
             }
         } else {  // nonlinear phase criterion
-            step   = NextStep(field, fiber, NAN);
+            step   = NextStep(field, fiber, 0);
             phimax = fiber.accuracyParameter;
         }
     }
     return make_tuple(step, phimax);
 }
 
-// NEXTSTEP step size setup for the SSFM algorithm DZ=NEXTSTEP(U,X,DZ_OLD)
+// NEXTSTEP step size setup for the SSFM algorithm DZ=NEXTSTEP(U,X,DZ_OLD,PMAX)
 // evaluates the step size of the SSFM. U is the electric field,
-// DZ_OLD is the step used in the previous SSFM cycle.
+// DZ_OLD is the step used in the previous SSFM cycle. PMAX is the peak power
+// of U if already known, e.g., from the nonlinear step; negative to compute it
+// (a NAN flag would not survive -ffinite-math-only).
 
-double NextStep(const MatrixXcd &field, const Fiber &fiber, double dz_old) {
+template<typename Field>
+double NextStep(const Field &field, const Fiber &fiber, double dz_old, double pmax) {
     double step;
     if (fiber.isCle) {  // constant local error (CLE)
         double q = fiber.isSym ? 3 : 2;
         step     = dz_old * std::exp(fiber.alphaLinear / q * dz_old);  // [m]
 
     } else {  // nonlinear phase criterion
-        double pmax{};
-        if (fiber.isDual) {  // max over time
-            // 存在偏振的情况，还未实现
-            // Pmax = max(abs(u(:,1:2:end)).^2 + abs(u(:,2:2:end)).^2);
+        if (pmax >= 0) {
+            // peak power given by the nonlinear step
         } else {
-            pmax = field.cwiseAbs2().maxCoeff();
+            pmax = PeakPower(field, fiber);
         }
         double invLnl = pmax * fiber.gam;                  // max over channels
         double leff   = fiber.accuracyParameter / invLnl;  // effective length [m] of the step
@@ -283,70 +1419,494 @@ double NextStep(const MatrixXcd &field, const Fiber &fiber, double dz_old) {
     return dz;
 }
 
-tuple<RowVectorXd, RowVectorXd> CheckStep(double zprop, double dz, double len_corr) {
+// SNAPSTEP rounds the step down to a multiple of fiber.stepGrid, if set, so that
+// consecutive steps tend to repeat and hit the cache of dispersion operators.
+// Steps shorter than the grid are left untouched. The step-update rule keeps
+// running on the unrounded steps, otherwise rounding down would stop the growth.
+
+double SnapStep(double step, const Fiber &fiber) {
+    if (fiber.stepGrid <= 0 || step <= fiber.stepGrid)
+        return step;
+    return floor(step / fiber.stepGrid) * fiber.stepGrid;
+}
+
+// CHECKSTEP splits the step ending at ZPROP of length DZ over the waveplates it
+// crosses. The split lengths and waveplate indexes are left in workspace.dzb
+// and workspace.nindex, skipping zero-length pieces.
+
+void CheckStep(double zprop, double dz, double len_corr, SsfmWorkspace &workspace) {
+    PhaseTimer timer(workspace.profile.checkStep);
     double zini = zprop - dz;  // starting coordinate of the step [m]
     double zend = zprop;       // ending coordinate of the step [m]
 
     // first waveplate index is 1
-    double nini      = floor(zini / len_corr) + 1;  // Waveplate of starting coordinate
-    double nend      = ceil(zend / len_corr);       // waveplate of ending coordinate
-    RowVectorXd nmid = genVector(nini, nend);       // waveplate indexes
+    double nini = floor(zini / len_corr) + 1;  // Waveplate of starting coordinate
+    double nend = ceil(zend / len_corr);       // waveplate of ending coordinate
+
+    vector<double> &dzb    = workspace.dzb;
+    vector<double> &nindex = workspace.nindex;
+    dzb.clear();
+    nindex.clear();
+
+    if (nini >= nend) {  // start/end of the step within a waveplate
+        if (dz != 0 && nini == nend) {
+            dzb.push_back(dz);
+            nindex.push_back(nini);
+        }
+        return;
+    }
 
-    RowVectorXd dz_split;
+    // multi-waveplate step: pieces are cut at the waveplate boundaries
+    double zcut = zini;
+    for (double n = nini; n <= nend; ++n) {
+        double znext = n < nend ? len_corr * n : zend;
+        if (znext - zcut != 0) {  // remove zero-length steps
+            dzb.push_back(znext - zcut);
+            nindex.push_back(n);
+        }
+        zcut = znext;
+    }
+}
 
-    if (nini == nend) {  // start/end of the step within a waveplate
-        dz_split.resize(1);
-        dz_split << dz;
-    } else {  // multi-waveplate step
+template<typename Field>
+void LinearStep(Linear *linear, const MatrixXd &betat, Field &field, SsfmWorkspace &workspace, double gain) {
+    if (workspace.tape != nullptr)
+        RecordStep(workspace, field, true, accumulate(workspace.dzb.begin(), workspace.dzb.end(), 0.), gain);
+    Field &spectrum = SsfmPrecision<Field>::spectrum(workspace);
+    Fft(field, spectrum, workspace);
+    LinearSpectrumStep(linear, betat, spectrum, workspace, gain);
+    Ifft(spectrum, field, workspace);
+}
 
-        // waveplate mid-coordinates
-        RowVectorXd zmid      = len_corr * nmid.block(0, 0, 1, nmid.size() - 1);
-        RowVectorXd diff_zmid = diff(zmid.transpose());
-        dz_split.resize(2 + diff_zmid.size());
-        dz_split << zmid(0) - zini, diff_zmid, zend - zmid(zmid.size() - 1);
-    }
-    RowVectorXd dzb    = removeZero(dz_split, dz_split);  // remove zero-length steps
-    RowVectorXd nindex = removeZero(nmid, dz_split);      // remove zero-length steps
-    return make_tuple(dzb, nindex);
+// FFT and IFFT transform all the columns of the field, timed and counted in the workspace.
+
+template<typename Field>
+void Fft(const Field &field, Field &spectrum, SsfmWorkspace &workspace) {
+    PhaseTimer timer(workspace.profile.fft);
+    fftCol(field, spectrum);
+    workspace.nFft++;
+}
+
+template<typename Field>
+void Ifft(const Field &spectrum, Field &field, SsfmWorkspace &workspace) {
+    PhaseTimer timer(workspace.profile.ifft);
+    ifftCol(spectrum, field);
+    workspace.nIfft++;
 }
 
-MatrixXcd LinearStep(Linear *linear, VectorXd betat, RowVectorXd dzb, RowVectorXd nindex, MatrixXcd field) {
-    field = fftCol(field);
+// LINEARSPECTRUMSTEP is the linear step of the split in workspace.dzb/nindex on a
+// field already in the frequency domain.
 
+template<typename Field>
+void LinearSpectrumStep(Linear *linear, const MatrixXd &betat, Field &spectrum, SsfmWorkspace &workspace, double gain) {
+    typedef typename Field::RealScalar Real;
+    PhaseTimer timer(workspace.profile.dispersion);
     if (linear->is_scalar) {
-        auto *scalar_linear = (ScalarLinear *) linear;
-        for (Index i = 0; i < dzb.size(); ++i) {  // the step is made of multi-waveplates
-            VectorXcd temp = fastExp((-betat) * dzb[i]);
-            for (Index j = 0; j < field.cols(); ++j) {
-                field.col(i) = field.col(i).cwiseProduct(temp);
+        Index rows    = spectrum.rows();
+        Index nchunks = (rows + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK;
+        Index ntasks  = spectrum.cols() * nchunks;  // chunks of all the columns, shared by the threads
+        for (double dz: workspace.dzb) {            // the step is made of multi-waveplates
+            const Field &propagator = DispersionOperator<Field>(betat, dz, workspace);
+#pragma omp parallel for if (ntasks > 1)
+            for (Index t = 0; t < ntasks; ++t) {
+                Index j     = t / nchunks;
+                Index first = t % nchunks * PARALLEL_CHUNK;
+                Index n     = min(PARALLEL_CHUNK, rows - first);
+                // polarizations alternate on columns, as the columns of betat do
+                auto p = propagator.col(j % propagator.cols()).segment(first, n).array();
+                if (gain == 1)
+                    spectrum.col(j).segment(first, n).array() *= p;
+                else
+                    spectrum.col(j).segment(first, n).array() *= p * (Real) gain;
             }
+            gain = 1;  // the scalar gain goes with the first piece only
         }
     } else {
-        // Linear非标量的情况还未实现
+        // Birefringence: within a waveplate the field is rotated on the waveplate axes
+        // by matin, propagated and rotated back, all in one pass per waveplate.
+        auto *nonScalar = (NonScalarLinear *) linear;
+        Index nplates   = (Index) nonScalar->matin.size() / (spectrum.cols() / betat.cols());  // waveplates of one realization
+        for (size_t k = 0; k < workspace.dzb.size(); ++k) {
+            double dz               = workspace.dzb[k];
+            Index plate             = min((Index) workspace.nindex[k], nplates) - 1;  // waveplates are numbered from 1
+            const Field &propagator = DispersionOperator<Field>(betat, dz, workspace);
+            JonesRotation(spectrum, propagator, *nonScalar, plate, dz, gain);
+            gain = 1;  // the scalar gain goes with the first piece only
+        }
+    }
+}
+
+/**
+ * @brief Propagation within a waveplate of the x/y spectra on alternating columns:
+ *        [X Y] = [X Y] * U * diag(px * bx, py * by) * U', for each frequency bin.
+ *        The four complex products of a bin are done in one pass over the spectra,
+ *        and the bins are shared by the OpenMP threads.
+ *        U and the birefringence of the axes are those of the waveplate in the fiber
+ *        of the realization each column belongs to.
+ * @param spectrum: spectra of the two polarizations on alternating columns, overwritten.
+ * @param propagator: dispersion of the two waveplate axes, exp(-i*betat*dz).
+ * @param linear: axes (U) and birefringence of the waveplates of all the realizations.
+ * @param plate: the waveplate, from 0, within the fiber of a realization.
+ * @param dz: length [m] of the piece of step within the waveplate.
+ * @param gain: field gain of the piece of step.
+ */
+template<typename Field>
+void JonesRotation(Field &spectrum, const Field &propagator, const NonScalarLinear &linear, Index plate, double dz, double gain) {
+    typedef typename Field::Scalar Complex;
+    const Index MIN_PARALLEL_BINS = 4096;  // below this the threads cost more than the pass
+    Index ncols   = propagator.cols();                                        // columns of one realization
+    Index nplates = (Index) linear.matin.size() / (spectrum.cols() / ncols);  // waveplates of one realization
+
+    Index rows = spectrum.rows();
+    for (Index j = 0; j + 1 < spectrum.cols(); j += 2) {  // one x/y pair per channel
+        Index w                = j / ncols * nplates + plate;  // the waveplate in the fiber of this realization
+        const MatrixXcd &matin = linear.matin[w];
+        Complex u00 = Complex(matin(0, 0)), u01 = Complex(matin(0, 1)), u10 = Complex(matin(1, 0)), u11 = Complex(matin(1, 1));
+        Complex bx  = Complex(polar(gain, -linear.db(w, 0) * dz));  // birefringence phase and gain of the axes
+        Complex by  = Complex(polar(gain, -linear.db(w, 1) * dz));
+
+        const Complex *px = propagator.col(j % ncols).data();
+        const Complex *py = propagator.col((j + 1) % ncols).data();
+        Complex *x        = spectrum.col(j).data();
+        Complex *y        = spectrum.col(j + 1).data();
+#pragma omp parallel for if (rows >= MIN_PARALLEL_BINS)
+        for (Index i = 0; i < rows; ++i) {
+            Complex a = (x[i] * u00 + y[i] * u10) * (px[i] * bx);  // on the waveplate axes
+            Complex b = (x[i] * u01 + y[i] * u11) * (py[i] * by);
+            x[i]              = a * conj(u00) + b * conj(u01);
+            y[i]              = a * conj(u10) + b * conj(u11);
+        }
     }
-    return ifftCol(field);
 }
 
-VectorXcd NonlinearStep(VectorXcd field, Fiber fiber, double dz) {
+// DISPERSIONOPERATOR returns exp(-i*betat*dz), reusing the operator of a cached
+// step length within the cache tolerance. On a miss the least recently used entry
+// is overwritten, so the storage of a full cache is recycled.
+
+template<typename Field>
+const Field &DispersionOperator(const MatrixXd &betat, double dz, SsfmWorkspace &workspace) {
+    DispersionCache &cache = workspace.dispersion;
+    cache.clock++;
+    size_t lru = 0;
+    for (size_t i = 0; i < cache.dz.size(); ++i) {
+        if (abs(cache.dz[i] - dz) <= cache.tolerance * dz) {
+            cache.hits++;
+            cache.lastUse[i] = cache.clock;
+            return SsfmPrecision<Field>::propagator(cache, i);
+        }
+        if (cache.lastUse[i] < cache.lastUse[lru])
+            lru = i;
+    }
+    PhaseTimer timer(workspace.profile.exponential);
+    cache.misses++;
+    cache.dz[lru]      = dz;
+    cache.lastUse[lru] = cache.clock;
+
+    auto expi         = [](double phase) { return typename Field::Scalar(polar(1.0, phase)); };  // exp(i*phase), phase in double precision
+    Field &propagator = SsfmPrecision<Field>::propagator(cache, lru);
+    propagator.array() = (betat.array() * (-dz)).unaryExpr(expi);
+    return propagator;
+}
+
+template<typename Field>
+double NonlinearStep(Field &field, const Fiber &fiber, SsfmWorkspace &workspace, double dz, double gain) {
+    if (workspace.tape != nullptr)
+        RecordStep(workspace, field, false, dz, gain);
+    PhaseTimer timer(workspace.profile.nonlinear);
     double leff;
     if (fiber.alphaLinear == 0)
         leff = dz;
     else
         leff = (1 - exp(-fiber.alphaLinear * dz)) / fiber.alphaLinear;  // effective length [m] of dz
     double gamleff = fiber.gam * leff;                                  // [1/mW]
+    double pmax    = 0;                                                 // peak power [mW] after the step
     if (fiber.isUnique) {                                               // UNIQUE FIELD
-        VectorXd phi       = field.cwiseAbs2() * gamleff;               // nl phase [rad].
-        VectorXcd expi_phi = fastExp(-phi);
-        field              = field.cwiseProduct(expi_phi);  // expiphi .* u
-
-        // dual-polarization未完成
+        if (fiber.isDual) {
+            if (!fiber.isManakov && fiber.gam != 0)  // CNLSE
+                ERROR("Dual-polarization Kerr effect is only available with the Manakov equation.");
+            // Manakov: x/y on alternating columns, phi = gamleff * (|ux|^2 + |uy|^2)
+            pmax = KerrColumns(field, 2, gamleff, gain, fiber);
+        } else {
+            // expiphi .* u .* gain, with nl phase [rad] phi = gamleff * |u|^2
+            pmax = KerrColumns(field, 1, gamleff, gain, fiber);
+        }
     } else {  // separate-field
-        // 未完成
+        if (fiber.isDual && !fiber.isManakov && fiber.gam != 0)  // CNLSE
+            ERROR("Dual-polarization Kerr effect is only available with the Manakov equation.");
+        Index nch = field.cols() / fiber.nRealizations / (fiber.isDual ? 2 : 1);  // channels of one realization
+        pmax      = fiber.isDual ? SeparateManakovStep(field, nch, gamleff, gain) : SeparateKerrStep(field, nch, gamleff, gain);
+    }
+    return pmax;
+}
+
+// KERRCOLUMNS is the Kerr step of a unique field of NPOL polarizations on alternating
+// columns: the chunks of all the columns are shared by the threads, and the peak
+// power is their maximum, so the result does not depend on the threads.
+
+template<typename Field>
+double KerrColumns(Field &field, Index npol, double gamleff, double gain, const Fiber &fiber) {
+    typedef typename Field::Scalar Complex;
+    Index rows    = field.rows();
+    Index nchunks = (rows + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK;
+    Index ntasks  = field.cols() / npol * nchunks;
+    double pmax   = 0;
+#pragma omp parallel for reduction(max : pmax) if (ntasks > 1)
+    for (Index t = 0; t < ntasks; ++t) {
+        Index j     = t / nchunks * npol;
+        Index first = t % nchunks * PARALLEL_CHUNK;
+        Index n     = min(PARALLEL_CHUNK, rows - first);
+        Complex *ux = field.col(j).data() + first;
+        double p;
+        if (npol == 2)
+            p = SsfmPrecision<Field>::kerr(ux, field.col(j + 1).data() + first, n, gamleff, gain, fiber);
+        else
+            p = SsfmPrecision<Field>::kerr(ux, n, gamleff, gain, fiber);
+        pmax = max(pmax, p);
+    }
+    return pmax;
+}
+
+// FILTEREDNONLINEARSTEP is the nonlinear step of filtered DBP [Du10] on a unique
+// field: the phase follows the power of the field low-pass filtered by FILTER, the
+// frequency response ordered as gstate.FN, which keeps the intra-channel part of the
+// nonlinear phase that few steps can backpropagate. The power of each realization,
+// both polarizations together, is filtered with one FFT pair.
+
+void FilteredNonlinearStep(MatrixXcd &field, const Fiber &fiber, const VectorXd &filter, SsfmWorkspace &workspace, double dz) {
+    PhaseTimer timer(workspace.profile.nonlinear);
+    double leff;
+    if (fiber.alphaLinear == 0)
+        leff = dz;
+    else
+        leff = (1 - exp(-fiber.alphaLinear * dz)) / fiber.alphaLinear;  // effective length [m] of dz
+    double gamleff = fiber.gam * leff;                                  // [1/mW]
+    Index npol     = fiber.isDual ? 2 : 1;
+    Index ngroups  = field.cols() / npol;  // realizations
+
+    MatrixXcd &power = workspace.power;
+    power.resize(field.rows(), ngroups);  // no reallocation when already sized
+    for (Index g = 0; g < ngroups; ++g)
+        power.col(g) = field.middleCols(g * npol, npol).rowwise().squaredNorm().cast<complex<double>>();
+    Fft(power, workspace.powerSpectrum, workspace);
+    for (Index g = 0; g < ngroups; ++g)
+        workspace.powerSpectrum.col(g).array() *= filter.array();
+    Ifft(workspace.powerSpectrum, power, workspace);
+
+    auto expi = [gamleff](complex<double> p) { return polar(1.0, -gamleff * p.real()); };
+    for (Index j = 0; j < field.cols(); ++j)
+        field.col(j).array() *= power.col(j / npol).unaryExpr(expi).array();
+}
+
+/**
+ * @brief Nonlinear step of separate scalar channels on the columns of the field:
+ *        SPM and XPM without FWM, phi_k = gamleff * (|u_k|^2 + 2 * sum_{m!=k} |u_m|^2).
+ *        The samples are shared by the OpenMP threads.
+ * @param field: one column per channel, the channels of each realization of the field
+ *        on consecutive columns, overwritten.
+ * @param nch: number of channels of a realization.
+ * @param gamleff: nonlinear coefficient times the effective length of the step [1/mW].
+ * @param gain: field attenuation of the step.
+ * @return peak power [mW] of the channels of a realization together after the step.
+ */
+template<typename Field>
+double SeparateKerrStep(Field &field, Index nch, double gamleff, double gain) {
+    typedef typename Field::Scalar Complex;
+    Index rows  = field.rows();
+    double pmax = 0;
+#pragma omp parallel for reduction(max : pmax)
+    for (Index i = 0; i < rows; ++i) {
+        for (Index c = 0; c < field.cols(); c += nch) {  // one realization
+            double ptot = 0;                             // power of all the channels
+            for (Index k = c; k < c + nch; ++k)
+                ptot += norm(field(i, k));
+            for (Index k = c; k < c + nch; ++k)
+                field(i, k) *= Complex(polar(gain, -gamleff * (2 * ptot - norm(field(i, k)))));
+            pmax = max(pmax, ptot);
+        }
+    }
+    return pmax * gain * gain;
+}
+
+/**
+ * @brief Manakov nonlinear step of separate dual-polarization channels, x/y on
+ *        alternating columns: SPM and XPM, including the cross-polarization
+ *        modulation, without FWM [Mar97]. Channel k is rotated by
+ *        exp(-i*gamleff*(P_k*I + sum_{m!=k} (P_m*I + u_m*u_m'))), i.e., by the 2x2
+ *        exponential of a0*I + a.sigma with a0 = P_k + 3/2*sum P_m and a the half
+ *        Stokes vector of the other channels.
+ * @param field: x/y columns of each channel, the channels of each realization of the
+ *        field on consecutive columns, overwritten.
+ * @param nch: number of channels of a realization.
+ * @param gamleff: nonlinear coefficient, including the 8/9 Manakov factor, times the
+ *        effective length of the step [1/mW].
+ * @param gain: field attenuation of the step.
+ * @return peak power [mW] of the channels of a realization together after the step.
+ */
+template<typename Field>
+double SeparateManakovStep(Field &field, Index nch, double gamleff, double gain) {
+    typedef typename Field::Scalar Complex;
+    Index rows  = field.rows();
+    double pmax = 0;
+#pragma omp parallel for reduction(max : pmax)
+    for (Index i = 0; i < rows; ++i) {
+        for (Index c = 0; c < field.cols() / 2; c += nch) {  // one realization
+            double ptot = 0, s1 = 0, s2 = 0, s3 = 0;          // power and Stokes vector of all the channels
+            for (Index k = c; k < c + nch; ++k) {
+                complex<double> x = field(i, 2 * k), y = field(i, 2 * k + 1);
+                complex<double> xy = x * conj(y);
+                ptot += norm(x) + norm(y);
+                s1 += norm(x) - norm(y);
+                s2 += 2 * xy.real();
+                s3 -= 2 * xy.imag();
+            }
+            for (Index k = c; k < c + nch; ++k) {
+                complex<double> x = field(i, 2 * k), y = field(i, 2 * k + 1);  // in double precision
+                complex<double> xy = x * conj(y);
+                double pk          = norm(x) + norm(y);
+                double a0          = gamleff * (pk + 1.5 * (ptot - pk));
+                double a1          = gamleff / 2 * (s1 - norm(x) + norm(y));  // the other channels only
+                double a2          = gamleff / 2 * (s2 - 2 * xy.real());
+                double a3          = gamleff / 2 * (s3 + 2 * xy.imag());
+                double na          = sqrt(a1 * a1 + a2 * a2 + a3 * a3);
+                double sinc        = na < 1e-8 ? 1 : sin(na) / na;  // sin(|a|)/|a|
+                complex<double> ic(0, -sinc);                       // -i*sin(|a|)/|a|
+                complex<double> phase = polar(gain, -a0);
+                complex<double> xn    = phase * (cos(na) * x + ic * (a1 * x + complex<double>(a2, -a3) * y));
+                complex<double> yn    = phase * (cos(na) * y + ic * (complex<double>(a2, a3) * x - a1 * y));
+                field(i, 2 * k)       = Complex(xn);
+                field(i, 2 * k + 1)   = Complex(yn);
+            }
+            pmax = max(pmax, ptot);
+        }
     }
-    return field;
+    return pmax * gain * gain;
 }
 
-tuple<Linear *, double> CheckFiber(const E &e, Fiber &fiber) {
+// KERRINCREMENT is the Kerr term of a Runge-Kutta stage of length DZ:
+// INCREMENT = -i * gam * dz * P .* FIELD, with P the power of the field, of both
+// polarizations together in dual polarization (Manakov).
+
+template<typename Field>
+void KerrIncrement(const Field &field, Field &increment, const Fiber &fiber, SsfmWorkspace &workspace, double dz) {
+    typedef typename Field::Scalar Complex;
+    typedef typename Field::RealScalar Real;
+    const Index MIN_PARALLEL_SAMPLES = 4096;  // below this the threads cost more than the pass
+    PhaseTimer timer(workspace.profile.nonlinear);
+    if (fiber.isDual && !fiber.isManakov)  // CNLSE
+        ERROR("Dual-polarization Kerr effect is only available with the Manakov equation.");
+    Real gamdz = (Real) (fiber.gam * dz);  // [1/mW]
+    Index rows = field.rows();
+    if (fiber.isDual) {  // x/y on alternating columns
+        for (Index j = 0; j + 1 < field.cols(); j += 2) {
+            const Complex *x = field.col(j).data();
+            const Complex *y = field.col(j + 1).data();
+            Complex *kx      = increment.col(j).data();
+            Complex *ky      = increment.col(j + 1).data();
+#pragma omp parallel for if (rows >= MIN_PARALLEL_SAMPLES)
+            for (Index i = 0; i < rows; ++i) {
+                Complex phase(0, -gamdz * (norm(x[i]) + norm(y[i])));
+                kx[i] = phase * x[i];
+                ky[i] = phase * y[i];
+            }
+        }
+    } else {
+        for (Index j = 0; j < field.cols(); ++j) {
+            const Complex *u = field.col(j).data();
+            Complex *k       = increment.col(j).data();
+#pragma omp parallel for if (rows >= MIN_PARALLEL_SAMPLES)
+            for (Index i = 0; i < rows; ++i)
+                k[i] = Complex(0, -gamdz * norm(u[i])) * u[i];
+        }
+    }
+}
+
+/**
+ * @brief Peak power of the field over time, as used by the nonlinear phase criterion.
+ *        For dual polarization the power of a sample is |ux|^2 + |uy|^2, with x and y
+ *        on alternating columns; for separate fields it is the power of all the channels
+ *        of a realization. The peak is the highest among the realizations of the field.
+ * @param field: electric field.
+ * @param fiber: fiber parameters.
+ * @return the peak power [mW].
+ */
+template<typename Field>
+double PeakPower(const Field &field, const Fiber &fiber) {
+    if (!fiber.isUnique) {  // all the channels of a realization together
+        Index ncols = field.cols() / fiber.nRealizations;
+        double pmax = 0;
+        for (Index c = 0; c < field.cols(); c += ncols)
+            pmax = max(pmax, (double) field.middleCols(c, ncols).rowwise().squaredNorm().maxCoeff());
+        return pmax;
+    }
+    if (!fiber.isDual)
+        return field.cwiseAbs2().maxCoeff();
+    double pmax = 0;  // Pmax = max(abs(u(:,1:2:end)).^2 + abs(u(:,2:2:end)).^2)
+    for (Index j = 0; j + 1 < field.cols(); j += 2)
+        pmax = max(pmax, (double) (field.col(j).cwiseAbs2() + field.col(j + 1).cwiseAbs2()).maxCoeff());
+    return pmax;
+}
+
+// MONITORSTEP records the field at Z after STEP steps if a record of the monitor is
+// due there. The time samples or the spectrum, when not current, are computed in the
+// scratch buffers FIELD or SPECTRUM; these transforms are not counted in the workspace.
+
+template<typename Field>
+void MonitorStep(Monitor *monitor, double z, unsigned long step, Field &field, Field &spectrum, bool isFieldCurrent, bool isSpectrumCurrent) {
+    bool withSpectrum;
+    if (monitor == nullptr || !monitor->isDue(z, withSpectrum))
+        return;
+    if (!isFieldCurrent)
+        ifftCol(spectrum, field);
+    if (withSpectrum && !isSpectrumCurrent)
+        fftCol(field, spectrum);
+    monitor->record(z, step, field, withSpectrum ? &spectrum : nullptr);
+}
+
+// ISMONITORED is true if the fiber asks for field monitors, or for the trace.
+
+bool IsMonitored(const Fiber &fiber) {
+    return !fiber.monitorPositions.empty() || fiber.monitorSpacing > 0 || !fiber.spectrumPositions.empty() || fiber.trace;
+}
+
+// DRAWWAVEPLATES draws new random axes and birefringence for all the waveplates,
+// an independent fiber for each realization of the field: waveplate p of
+// realization r is number r * fiber.nWavePlates + p.
+
+void DrawWaveplates(const Fiber &fiber, NonScalarLinear &linear) {
+    Index nplates = (Index) fiber.nWavePlates * fiber.nRealizations;
+    linear.matin.resize(nplates);
+    linear.db.resize(nplates, 2);
+    for (Index i = 0; i < nplates; ++i) {  // SVD, hence different with the old FIBER version
+        RowVectorXd db;
+        tie(linear.matin[i], db) = EigenDecomposition(fiber);
+        linear.db.row(i)         = db;
+    }
+}
+
+/**
+ * @brief Eigendecomposition of a waveplate with random axes: the axes are a uniform
+ *        point on the Poincare sphere, with the birefringence of the beat length.
+ * @param fiber: fiber parameters.
+ * @return tuple of matin, the 2x2 unitary matrix of the axes, and db, the 1x2
+ *         birefringence [rad/m] of the axes.
+ */
+tuple<MatrixXcd, RowVectorXd> EigenDecomposition(const Fiber &fiber) {
+    double theta   = uniformRng() * M_PI;               // azimuth: uniform R.V.
+    double epsilon = 0.5 * asin(uniformRng() * 2 - 1);  // ellipticity: uniform R.V. over the Poincare sphere
+    complex<double> i1(0, 1);
+
+    MatrixXcd matin(2, 2);
+    matin << cos(theta) * cos(epsilon) - i1 * sin(theta) * sin(epsilon), -sin(theta) * cos(epsilon) + i1 * cos(theta) * sin(epsilon),
+            sin(theta) * cos(epsilon) + i1 * cos(theta) * sin(epsilon), cos(theta) * cos(epsilon) + i1 * sin(theta) * sin(epsilon);
+    RowVectorXd db(2);
+    if (fiber.beatLength == 0)
+        db << 0, 0;
+    else
+        db << M_PI / fiber.beatLength, -M_PI / fiber.beatLength;  // birefringence [rad/m]
+    return make_tuple(matin, db);
+}
+
+tuple<unique_ptr<Linear>, double> CheckFiber(const E &e, Fiber &fiber) {
     const string DEF_STEP_UPDATE = "cle";  // Default step-updating rule
     const bool DEF_IS_SYMMETRIC  = false;  // Default step computation
     const double DEF_PHI_FWM_CLE = 20;     // Default X.dphimax [rad] for CLE stepupd rule
@@ -365,6 +1925,13 @@ tuple<Linear *, double> CheckFiber(const E &e, Fiber &fiber) {
         ERROR(R"(Coupling must be "none" or "pol".)");
     }
 
+    // Precision
+    if (fiber.precision != "double" && fiber.precision != "single" && fiber.precision != "mixed") {
+        ERROR(R"(Precision must be "double", "single" or "mixed".)");
+    }
+    fiber.isSingle = fiber.precision != "double";
+    fiber.isMixed  = fiber.precision == "mixed";
+
     if (!fiber.isDual) {  // Scalar propagation
         if (fiber.isManakov)
             WARNING("Cannot use Manakov equation in scalar propagation: forced to NLSE.");
@@ -397,7 +1964,17 @@ tuple<Linear *, double> CheckFiber(const E &e, Fiber &fiber) {
         }
     }
 
-    Linear *linear= nullptr;
+    // Realizations of the field on consecutive blocks of columns
+    Index ncols = (fiber.isUnique ? 1 : e.lambda.size()) * (fiber.isDual ? 2 : 1);  // columns of one realization
+    if (e.field.cols() == 0 || e.field.cols() % ncols != 0) {
+        if (fiber.isUnique)
+            ERROR("E.field must have one column per polarization and realization.");
+        else
+            ERROR("Separate field: E.field must have one column per channel, polarization and realization.");
+    }
+    fiber.nRealizations = (unsigned) (e.field.cols() / ncols);
+
+    unique_ptr<Linear> linear;
 
     // Differential Group delay
     double diffGroupDelay;
@@ -408,22 +1985,21 @@ tuple<Linear *, double> CheckFiber(const E &e, Fiber &fiber) {
         // Group delay (DGD) per unit length [ns/m] @ x.lambda within a
         // Waveplate. To get [Df00] remember that within a waveplate the delay is dgd * corr_len.
 
-        // 这两行没有替换
-        //        x1.coupling = x.coupling;
-        //        x1.beatlength = x.beatlength;
-        for (int i = 0; i < fiber.nWavePlates; ++i) {  // SVD, hence different with the old FIBER version
-                                                       //            [U,S]=eigendec(x1);
-                                                       //            [lin.matin(:,:,l),lin.db0(l,:)] = deal(U,S);
-        }
-        // lin.db extended later
+        // The eigendecompositions of all waveplates are drawn once per fiber and kept
+        // in the linear propagator for all the steps.
+        NonScalarLinear *nonScalar = new NonScalarLinear();
+        nonScalar->is_scalar       = false;
+        DrawWaveplates(fiber, *nonScalar);
+        linear.reset(nonScalar);
     } else {
         diffGroupDelay                   = 0;  // Turn off all polarization and birefringence effects
         fiber.nWavePlates                = 1;
         fiber.coupling                   = "none";
-        linear                           = new ScalarLinear();
-        linear->is_scalar                = true;
-        ((ScalarLinear *) linear)->matin = 1;
-        ((ScalarLinear *) linear)->db    = 0;
+        ScalarLinear *scalar = new ScalarLinear();
+        scalar->is_scalar    = true;
+        scalar->matin        = 1;
+        scalar->db           = 0;
+        linear.reset(scalar);
     }
     linear->is_unique = fiber.isUnique;
 
@@ -437,6 +2013,13 @@ tuple<Linear *, double> CheckFiber(const E &e, Fiber &fiber) {
         if (fiber.stepUpdate.empty()) {
             fiber.stepUpdate = "cle";
         }
+        if (fiber.stepUpdate != "cle" && fiber.stepUpdate != "nlp" && fiber.stepUpdate != "lem") {
+            ERROR("Wrong step update rule.");
+        }
+        fiber.isLem = fiber.stepUpdate == "lem";
+        if (fiber.isLem && fiber.errorTolerance <= 0) {
+            ERROR("fiber.errorTolerance must be positive with the \"lem\" step update.");
+        }
         if (fiber.stepUpdate == "cle") {
             if (!fiber.dphiFwm) {
                 ERROR("The combination fiber.dphiFwm=false and fiber.stepUpdate=\"cle\" is not possible");
@@ -461,18 +2044,25 @@ tuple<Linear *, double> CheckFiber(const E &e, Fiber &fiber) {
     }
 
     // Step type
+    fiber.isRk4ip = fiber.stepType == "rk4ip";
     if (!fiber.stepType.empty()) {
         if (fiber.stepType == "asymm") {
             fiber.isSym = false;
         } else if (fiber.stepType == "symm") {
             fiber.isSym = true;
+        } else if (fiber.stepType == "rk4ip") {
+            fiber.isSym = false;
+            if (!fiber.isUnique)
+                ERROR("The \"rk4ip\" step type needs a unique field.");
+            if (fiber.errorTolerance <= 0)
+                ERROR("fiber.errorTolerance must be positive with the \"rk4ip\" step type.");
         } else {
             ERROR("Wrong step type.");
         }
     } else {
         fiber.isSym = DEF_IS_SYMMETRIC;
     }
-    return make_tuple(linear, diffGroupDelay);
+    return make_tuple(move(linear), diffGroupDelay);
 }
 
 }  // namespace HARDWARE_TYPE
@@ -0,0 +1,264 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+
+/**
+ * Gaussian-noise (GN) model of the nonlinear interference (NLI) of a link [Pog12]
+ *
+ * The NLI power spectral density at frequency f of a span is
+ *
+ *   G_NLI(f) = c * gam^2 * int int G(f + v1) G(f + v2) G(f + v1 + v2) |rho(v1 * v2)|^2 dv1 dv2
+ *
+ * with G the power spectral density of the signal at the span input, c = 16/27 with
+ * two polarizations and 2 with one, and |rho|^2 the link function of the span,
+ * (1 - 2 exp(-alpha L) cos(db L) + exp(-2 alpha L)) / (alpha^2 + db^2), db =
+ * 4 pi^2 beta2 v1 v2. The inner integral runs over the pieces of v2 where the two
+ * shifted spectra are constant: the part of |rho|^2 without the cosine is exact
+ * after the change of variable theta = atan(db / alpha), the cosine by midpoints
+ * within eight of its periods around v2 = 0, past which it averages out. The
+ * outer integral takes midpoints of an asinh map of v1, dense around v1 = 0 where
+ * the inner integral peaks.
+ *
+ * [Pog12] P. Poggiolini, "The GN Model of Non-Linear Propagation in Uncompensated
+ *         Coherent Optical Systems," J. Lightw. Technol., vol. 30, no. 24, 2012.
+ */
+
+#include "Internal"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+namespace SimuLib {
+
+namespace HARDWARE_TYPE {
+
+double AmplifierGain(const Span &span, const Fiber &fiber);
+tuple<double, double> DispersionCoefficients(double lambda, double dispersion, double slope);
+
+namespace {
+
+const double OUTER_STEP       = 0.125;      // midpoint spacing of the asinh map of the outer integral
+const int MIN_OUTER_POINTS    = 16;         // midpoints of the outer integral per channel, at least
+const double MAX_PHASE        = 16 * M_PI;  // extent of the cosine of |rho|^2 integrated around v2 = 0 [rad]
+const double PHASE_RESOLUTION = M_PI / 4;   // midpoint spacing of the cosine [rad]
+
+// Channel of the signal, [GHz] from the reference
+struct Band {
+    double low;
+    double high;
+    double psd;  // power spectral density [mW/GHz]
+};
+
+// Link function |rho|^2 of a span for a channel
+struct Kernel {
+    double alpha;   // power loss [1/m]
+    double length;  // [m]
+    double loss;    // exp(-alpha * length)
+    double beta2;   // [ns^2/m] at the channel
+};
+
+// PIECE is the integral of |rho|^2 over v2 in [A, B], with db = C * v2.
+
+double Piece(double a, double b, double c, const Kernel &kernel) {
+    double alpha = kernel.alpha;
+    double len   = kernel.length;
+    double e     = kernel.loss;
+    double s     = abs(c);
+    if (s * len * max(abs(a), abs(b)) < 1e-9)  // db = 0 over the piece
+        return (1 - e) * (1 - e) * (b - a) / (alpha * alpha);
+
+    double flat = (1 + e * e) * (atan(s * b / alpha) - atan(s * a / alpha)) / (alpha * s);
+
+    // cos(phi) / ((alpha L)^2 + phi^2), phi = s L v2, within MAX_PHASE of phi = 0
+    double low  = max(s * len * a, -MAX_PHASE);
+    double high = min(s * len * b, MAX_PHASE);
+    if (low >= high)
+        return flat;
+    int n        = max(2, (int) ceil((high - low) / PHASE_RESOLUTION));
+    double step  = (high - low) / n;
+    double alen2 = alpha * len * alpha * len;
+    double sum   = 0;
+#pragma omp simd reduction(+ : sum)
+    for (int i = 0; i < n; ++i) {
+        double phi = low + (i + 0.5) * step;
+        sum += cos(phi) / (alen2 + phi * phi);
+    }
+    return flat - 2 * e * len / s * sum * step;
+}
+
+// INNER is the integral over v2 of G(f + v2) G(f + v1 + v2) |rho|^2, with the channels
+// BANDS sorted and the target f at F. Two pointers walk the overlaps of the two shifted
+// spectra; abutting overlaps of equal density merge into one piece.
+
+double Inner(const vector<Band> &bands, double f, double v1, const Kernel &kernel) {
+    double c     = 4 * M_PI * M_PI * kernel.beta2 * v1;  // db / v2 [1/m/GHz]
+    double sum   = 0;
+    double start = 0, end = 0, psd = 0;  // piece being merged
+    size_t i = 0, j = 0;
+    while (i < bands.size() && j < bands.size()) {
+        double low  = max(bands[i].low - f, bands[j].low - f - v1);
+        double high = min(bands[i].high - f, bands[j].high - f - v1);
+        if (low < high) {
+            double product = bands[i].psd * bands[j].psd;
+            if (psd == product && abs(low - end) <= 1e-9 * max(1., abs(low))) {
+                end = high;
+            } else {
+                if (psd > 0)
+                    sum += psd * Piece(start, end, c, kernel);
+                start = low;
+                end   = high;
+                psd   = product;
+            }
+        }
+        if (bands[i].high - f < bands[j].high - f - v1)
+            i++;
+        else
+            j++;
+    }
+    if (psd > 0)
+        sum += psd * Piece(start, end, c, kernel);
+    return sum;
+}
+
+// NLIPSD is the double integral of the GN model at F, without the coefficient. The
+// asinh map v1 = v0 sinh(u) resolves the peak of width v0 of the inner integral.
+
+double NliPsd(const vector<Band> &bands, double f, double v0, const Kernel &kernel) {
+    double sum = 0;
+    for (const Band &band: bands) {
+        double low  = asinh((band.low - f) / v0);
+        double high = asinh((band.high - f) / v0);
+        int n       = max(MIN_OUTER_POINTS, (int) ceil((high - low) / OUTER_STEP));
+        double du   = (high - low) / n;
+        for (int k = 0; k < n; ++k) {
+            double u  = low + (k + 0.5) * du;
+            double v1 = v0 * sinh(u);
+            sum += band.psd * Inner(bands, f, v1, kernel) * v0 * cosh(u) * du;
+        }
+    }
+    return sum;
+}
+
+// SPANINTEGRALS is the double integral of each channel of SIGNAL for a span of FIBER,
+// with SOURCES the channels with power, of total WIDTH [GHz].
+
+RowVectorXd SpanIntegrals(const vector<Band> &sources, double width, const GnSignal &signal, const Fiber &fiber) {
+    Kernel kernel;
+    kernel.alpha  = log(10) * 1e-4 * fiber.attenuation;  // [1/m]
+    kernel.length = fiber.length;
+    kernel.loss   = exp(-kernel.alpha * fiber.length);
+
+    double b2, b3;  // beta2 [ns^2/m] and beta3 [ns^3/m] @ fiber.lambda
+    tie(b2, b3)   = DispersionCoefficients(fiber.lambda, fiber.dispersion, fiber.slope);
+    double domega = 2 * M_PI * LIGHT_SPEED * (1. / signal.lambda - 1. / fiber.lambda);  // [1/ns]
+
+    Index nch = signal.frequency.size();
+    RowVectorXd integrals(nch);
+#pragma omp parallel for schedule(dynamic)
+    for (Index k = 0; k < nch; ++k) {
+        Kernel channel = kernel;
+        channel.beta2  = b2 + b3 * (domega + 2 * M_PI * signal.frequency(k));
+        double v0      = channel.beta2 == 0 ? width : min(width, kernel.alpha / (4 * M_PI * M_PI * abs(channel.beta2) * width));  // [GHz]
+        integrals(k)   = NliPsd(sources, signal.frequency(k), v0, channel);
+    }
+    return integrals;
+}
+
+}  // namespace
+
+/**
+ * @brief Estimates the nonlinear interference (NLI) of a link for a WDM signal
+ *        with the GN model [Pog12], in place of linkTransmit: each channel is
+ *        Gaussian noise of flat spectrum, the NLI of the spans adds up in power
+ *        and the dispersion of a channel is its beta2. The channels are computed
+ *        in parallel.
+ * @param link: the fiber types and the spans, as for linkTransmit. The fibers
+ *        need a positive attenuation; isDual selects the two-polarization model.
+ * @param signal: the channels at the link input.
+ * @return the NLI and ASE noise of each channel at the link output.
+ */
+GnOut gnModel(const Link &link, const GnSignal &signal) {
+
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();  // Start time
+
+    Index nch = signal.frequency.size();
+    if (signal.bandwidth.size() != nch || signal.power.size() != nch)
+        ERROR("signal.frequency, signal.bandwidth and signal.power must have the same size.");
+    vector<Band> bands(nch);
+    for (Index k = 0; k < nch; ++k) {
+        if (signal.bandwidth(k) <= 0 || signal.power(k) < 0)
+            ERROR("The channels need a positive bandwidth and a non-negative power.");
+        bands[k].low  = signal.frequency(k) - signal.bandwidth(k) / 2;
+        bands[k].high = signal.frequency(k) + signal.bandwidth(k) / 2;
+        bands[k].psd  = signal.power(k) / signal.bandwidth(k);
+    }
+    sort(bands.begin(), bands.end(), [](const Band &x, const Band &y) { return x.low < y.low; });
+    for (Index k = 1; k < nch; ++k)
+        if (bands[k].low < bands[k - 1].high - 1e-9)
+            ERROR("The channels of the signal must not overlap.");
+    vector<Band> sources;  // the channels with power
+    for (const Band &band: bands)
+        if (band.psd > 0)
+            sources.push_back(band);
+    double width = sources.empty() ? 0 : sources.back().high - sources.front().low;  // [GHz]
+
+    GnOut out;
+    out.nliPsd   = RowVectorXd::Zero(nch);
+    out.asePower = RowVectorXd::Zero(nch);
+    vector<RowVectorXd> integrals(link.fibers.size());  // of each fiber type, once computed
+    double scale = 1;                                   // power of the signal at the span input over the launch power
+    for (const Span &span: link.spans) {
+        if (span.fiberType >= link.fibers.size())
+            ERROR("Span fiber type out of link.fibers.");
+        const Fiber &fiber = link.fibers[span.fiberType];
+        if (fiber.attenuation <= 0)
+            ERROR("gnModel needs fibers with a positive attenuation.");
+        double gain  = AmplifierGain(span, fiber);
+        double after = exp(-log(10) * 1e-4 * fiber.attenuation * fiber.length) * gain;  // span net gain
+
+        out.nliPsd   *= after;  // the noise of the former spans follows the signal
+        out.asePower *= after;
+
+        // NLI at the span output, the signal at the span input scaled by SCALE
+        double gam = 0;
+        if (!isinf(fiber.effectiveArea) && fiber.nonlinearIndex != 0)
+            gam = (2 * M_PI * fiber.nonlinearIndex) / (signal.lambda * fiber.effectiveArea) * 1e18;  // [1/mW/m]
+        double coeff = (fiber.isDual ? 16. / 27 : 2) * gam * gam * pow(scale, 3) * after;
+        if (coeff > 0 && !sources.empty()) {
+            RowVectorXd &integral = integrals[span.fiberType];
+            if (integral.size() == 0)
+                integral = SpanIntegrals(sources, width, signal, fiber);
+            out.nliPsd += coeff * integral;
+        }
+
+        // ASE [mW/GHz] of the amplifier, as in Amplifier
+        if (span.isAse && gain > 1) {
+            double nsp = pow(10, span.noiseFigure / 10) / 2;  // spontaneous emission factor
+            for (Index k = 0; k < nch; ++k) {
+                double freq = (LIGHT_SPEED / signal.lambda + signal.frequency(k)) * 1e9;  // [Hz]
+                out.asePower(k) += (fiber.isDual ? 2 : 1) * (gain - 1) * nsp * PLANK_CONST * freq * 1e12 * signal.bandwidth(k);
+            }
+        }
+        scale *= after;
+    }
+    out.nliPower = out.nliPsd.cwiseProduct(signal.bandwidth);
+    out.snr      = (signal.power * scale).cwiseQuotient(out.asePower + out.nliPower);
+    out.time     = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    return out;
+}
+
+}  // namespace HARDWARE_TYPE
+
+}  // namespace SimuLib
@@ -18,6 +18,10 @@
 
 #include "Internal"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 /**
  * Functions for initializing global variables
  */
@@ -36,6 +40,33 @@ void initGstate(double Nsamp, double Fs) {
     gstate.FN        = fftShift(vec);  // Frequencies [GHz]
     gstate.SAMP_FREQ = Fs;             // Sampling frequency [GHz]
 
+    // Pre-build the FFT plans used by single and dual polarization fields
+    warmFFTCache(gstate.NSAMP, 1);
+    warmFFTCache(gstate.NSAMP, 2);
+}
+
+/**
+ * @brief Sets the OpenMP threads of the simulation: the columns of the batched FFTs,
+ *        the dispersion and the nonlinear steps of the SSFM. The results do not depend
+ *        on the number of threads.
+ * @param n: number of threads; 0 or less: one per processor.
+ */
+void setNumThreads(int n) {
+#ifdef _OPENMP
+    omp_set_num_threads(n > 0 ? n : omp_get_num_procs());
+#endif
+}
+
+/**
+ * @brief Threads of the simulation, as set by setNumThreads or OMP_NUM_THREADS.
+ * @return number of threads; 1 without OpenMP.
+ */
+int getNumThreads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
 }
 
 }  // namespace SimuLib
\ No newline at end of file
@@ -0,0 +1,482 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Fused nonlinear step kernel: |u|^2, exp(-i*phi) and the product in one pass over
+ * the field, with the peak power for the next step-size decision as a by-product.
+ * The AVX2 and AVX-512 versions are picked at run time. Single-precision samples
+ * are either converted to double for the power and the phase (mixed precision) or,
+ * with AVX-512, processed 16 at a time in single precision.
+ */
+
+#include "Internal"
+#include <cmath>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SIMULIB_KERR_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace SimuLib {
+
+namespace HARDWARE_TYPE {
+
+namespace {
+
+// Scalar path, also used for the tail of the vectorized loops. With DUAL the phase
+// is driven by the power of both polarizations (Manakov), otherwise ux alone. The
+// samples of type T are evaluated in the arithmetic of type A.
+template<bool DUAL, typename T = double, typename A = double>
+double kerrScalar(complex<T> *ux, complex<T> *uy, Index n, double gamleff, double gain, double pmax) {
+    for (Index i = 0; i < n; ++i) {
+        complex<A> x     = ux[i];
+        complex<A> y     = DUAL ? uy[i] : complex<T>();
+        A power          = DUAL ? norm(x) + norm(y) : norm(x);
+        complex<A> expip = polar((A) gain, (A) -gamleff * power);
+        ux[i]            = complex<T>(x * expip);
+        if (DUAL)
+            uy[i] = complex<T>(y * expip);
+        pmax = max(pmax, (double) power);
+    }
+    return pmax;
+}
+
+#ifdef SIMULIB_KERR_SIMD
+
+// GCC flags the "undefined" registers the AVX-512 intrinsics use as pass-through operands
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+// sin/cos polynomials on [-pi/4, pi/4] and the three-part split of pi/2 for the
+// Cody-Waite range reduction, from the Cephes library.
+const double SIN_COEF[6] = {1.58962301576546568060E-10, -2.50507477628578072866E-8, 2.75573136213857245213E-6,
+                            -1.98412698295895385996E-4, 8.33333333332211858878E-3, -1.66666666666666307295E-1};
+const double COS_COEF[6] = {-1.13585365213876817300E-11, 2.08757008419747316778E-9, -2.75573141792967388112E-7,
+                            2.48015872888517045348E-5, -1.38888888888730564116E-3, 4.16666666666665929218E-2};
+const double PIO2_1      = 1.57079625129699707031E0;
+const double PIO2_2      = 7.54978941586159635335E-8;
+const double PIO2_3      = 5.39030285815811905290E-15;
+
+// The reduction and the polynomials only use FMA intrinsics, which -Ofast cannot reassociate.
+__attribute__((target("avx2,fma"))) inline void sinCos4(__m256d x, __m256d &s, __m256d &c) {
+    __m256d k  = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(2 / M_PI)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r  = _mm256_fnmadd_pd(k, _mm256_set1_pd(PIO2_1), x);
+    r          = _mm256_fnmadd_pd(k, _mm256_set1_pd(PIO2_2), r);
+    r          = _mm256_fnmadd_pd(k, _mm256_set1_pd(PIO2_3), r);
+    __m256d z  = _mm256_mul_pd(r, r);
+    __m256d ps = _mm256_set1_pd(SIN_COEF[0]);
+    __m256d pc = _mm256_set1_pd(COS_COEF[0]);
+    for (int i = 1; i < 6; ++i) {
+        ps = _mm256_fmadd_pd(ps, z, _mm256_set1_pd(SIN_COEF[i]));
+        pc = _mm256_fmadd_pd(pc, z, _mm256_set1_pd(COS_COEF[i]));
+    }
+    __m256d sr = _mm256_fmadd_pd(_mm256_mul_pd(r, z), ps, r);                                                            // sin(r)
+    __m256d cr = _mm256_fmadd_pd(_mm256_mul_pd(z, z), pc, _mm256_fnmadd_pd(z, _mm256_set1_pd(0.5), _mm256_set1_pd(1)));  // cos(r)
+
+    // quadrant q = k mod 4: odd quadrants swap sin and cos, then q and q+1 give the signs
+    __m256i q    = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(k));
+    __m256i one  = _mm256_set1_epi64x(1);
+    __m256d swap = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(q, one), one));
+    __m256d sinQ = _mm256_blendv_pd(sr, cr, swap);
+    __m256d cosQ = _mm256_blendv_pd(cr, sr, swap);
+    __m256i two  = _mm256_set1_epi64x(2);
+    s            = _mm256_xor_pd(sinQ, _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_and_si256(q, two), 62)));
+    c            = _mm256_xor_pd(cosQ, _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_and_si256(_mm256_add_epi64(q, one), two), 62)));
+}
+
+// (re + i*im) * (c + i*s), with c and s duplicated on the re/im pairs
+__attribute__((target("avx2,fma"))) inline __m256d rotate4(__m256d u, __m256d c, __m256d s) {
+    return _mm256_fmaddsub_pd(u, c, _mm256_mul_pd(_mm256_permute_pd(u, 0x5), s));
+}
+
+// 2 complex samples in double precision, converted from and to single-precision storage
+__attribute__((target("avx2,fma"))) inline __m256d load4(const double *p) {
+    return _mm256_loadu_pd(p);
+}
+
+__attribute__((target("avx2,fma"))) inline __m256d load4(const float *p) {
+    return _mm256_cvtps_pd(_mm_loadu_ps(p));
+}
+
+__attribute__((target("avx2,fma"))) inline void store4(double *p, __m256d v) {
+    _mm256_storeu_pd(p, v);
+}
+
+__attribute__((target("avx2,fma"))) inline void store4(float *p, __m256d v) {
+    _mm_storeu_ps(p, _mm256_cvtpd_ps(v));
+}
+
+template<bool DUAL, typename T>
+__attribute__((target("avx2,fma"))) double kerrAvx2(complex<T> *ux, complex<T> *uy, Index n, double gamleff, double gain) {
+    auto *x       = reinterpret_cast<T *>(ux);
+    auto *y       = reinterpret_cast<T *>(uy);
+    __m256d phase = _mm256_set1_pd(-gamleff);
+    __m256d scale = _mm256_set1_pd(gain);
+    __m256d peak  = _mm256_setzero_pd();
+    Index i       = 0;
+    for (; i + 4 <= n; i += 4) {  // 4 samples per iteration
+        __m256d xa  = load4(x + 2 * i);      // re0 im0 re1 im1
+        __m256d xb  = load4(x + 2 * i + 4);  // re2 im2 re3 im3
+        __m256d sqa = _mm256_mul_pd(xa, xa);
+        __m256d sqb = _mm256_mul_pd(xb, xb);
+        __m256d ya, yb;
+        if (DUAL) {
+            ya  = load4(y + 2 * i);
+            yb  = load4(y + 2 * i + 4);
+            sqa = _mm256_fmadd_pd(ya, ya, sqa);
+            sqb = _mm256_fmadd_pd(yb, yb, sqb);
+        }
+        __m256d power = _mm256_hadd_pd(sqa, sqb);  // p0 p2 p1 p3
+        peak          = _mm256_max_pd(peak, power);
+
+        __m256d s, c;
+        sinCos4(_mm256_mul_pd(power, phase), s, c);
+        s = _mm256_mul_pd(s, scale);
+        c = _mm256_mul_pd(c, scale);
+
+        __m256d ca = _mm256_unpacklo_pd(c, c), sa = _mm256_unpacklo_pd(s, s);  // samples 0 1
+        __m256d cb = _mm256_unpackhi_pd(c, c), sb = _mm256_unpackhi_pd(s, s);  // samples 2 3
+        store4(x + 2 * i, rotate4(xa, ca, sa));
+        store4(x + 2 * i + 4, rotate4(xb, cb, sb));
+        if (DUAL) {
+            store4(y + 2 * i, rotate4(ya, ca, sa));
+            store4(y + 2 * i + 4, rotate4(yb, cb, sb));
+        }
+    }
+    __m128d half = _mm_max_pd(_mm256_castpd256_pd128(peak), _mm256_extractf128_pd(peak, 1));
+    double pmax  = max(_mm_cvtsd_f64(half), _mm_cvtsd_f64(_mm_unpackhi_pd(half, half)));
+    return kerrScalar<DUAL, T>(ux + i, DUAL ? uy + i : uy, n - i, gamleff, gain, pmax);
+}
+
+__attribute__((target("avx512f"))) inline void sinCos8(__m512d x, __m512d &s, __m512d &c) {
+    __m512d k  = _mm512_roundscale_pd(_mm512_mul_pd(x, _mm512_set1_pd(2 / M_PI)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512d r  = _mm512_fnmadd_pd(k, _mm512_set1_pd(PIO2_1), x);
+    r          = _mm512_fnmadd_pd(k, _mm512_set1_pd(PIO2_2), r);
+    r          = _mm512_fnmadd_pd(k, _mm512_set1_pd(PIO2_3), r);
+    __m512d z  = _mm512_mul_pd(r, r);
+    __m512d ps = _mm512_set1_pd(SIN_COEF[0]);
+    __m512d pc = _mm512_set1_pd(COS_COEF[0]);
+    for (int i = 1; i < 6; ++i) {
+        ps = _mm512_fmadd_pd(ps, z, _mm512_set1_pd(SIN_COEF[i]));
+        pc = _mm512_fmadd_pd(pc, z, _mm512_set1_pd(COS_COEF[i]));
+    }
+    __m512d sr = _mm512_fmadd_pd(_mm512_mul_pd(r, z), ps, r);
+    __m512d cr = _mm512_fmadd_pd(_mm512_mul_pd(z, z), pc, _mm512_fnmadd_pd(z, _mm512_set1_pd(0.5), _mm512_set1_pd(1)));
+
+    __m512i q     = _mm512_cvtepi32_epi64(_mm512_cvtpd_epi32(k));
+    __m512i one   = _mm512_set1_epi64(1);
+    __m512i two   = _mm512_set1_epi64(2);
+    __mmask8 swap = _mm512_test_epi64_mask(q, one);
+    __m512d sinQ  = _mm512_mask_blend_pd(swap, sr, cr);
+    __m512d cosQ  = _mm512_mask_blend_pd(swap, cr, sr);
+    __m512i sSign = _mm512_slli_epi64(_mm512_and_epi64(q, two), 62);
+    __m512i cSign = _mm512_slli_epi64(_mm512_and_epi64(_mm512_add_epi64(q, one), two), 62);
+    s             = _mm512_castsi512_pd(_mm512_xor_epi64(_mm512_castpd_si512(sinQ), sSign));
+    c             = _mm512_castsi512_pd(_mm512_xor_epi64(_mm512_castpd_si512(cosQ), cSign));
+}
+
+__attribute__((target("avx512f"))) inline __m512d rotate8(__m512d u, __m512d c, __m512d s) {
+    return _mm512_fmaddsub_pd(u, c, _mm512_mul_pd(_mm512_permute_pd(u, 0x55), s));
+}
+
+__attribute__((target("avx512f"))) inline __m512d load8(const double *p) {
+    return _mm512_loadu_pd(p);
+}
+
+__attribute__((target("avx512f"))) inline __m512d load8(const float *p) {
+    return _mm512_cvtps_pd(_mm256_loadu_ps(p));
+}
+
+__attribute__((target("avx512f"))) inline void store8(double *p, __m512d v) {
+    _mm512_storeu_pd(p, v);
+}
+
+__attribute__((target("avx512f"))) inline void store8(float *p, __m512d v) {
+    _mm256_storeu_ps(p, _mm512_cvtpd_ps(v));
+}
+
+template<bool DUAL, typename T>
+__attribute__((target("avx512f"))) double kerrAvx512(complex<T> *ux, complex<T> *uy, Index n, double gamleff, double gain) {
+    auto *x       = reinterpret_cast<T *>(ux);
+    auto *y       = reinterpret_cast<T *>(uy);
+    __m512d phase = _mm512_set1_pd(-gamleff);
+    __m512d scale = _mm512_set1_pd(gain);
+    __m512d peak  = _mm512_setzero_pd();
+    __m512i even  = _mm512_set_epi64(14, 12, 10, 8, 6, 4, 2, 0);  // re of samples 0..7 across a and b
+    __m512i odd   = _mm512_set_epi64(15, 13, 11, 9, 7, 5, 3, 1);  // im of samples 0..7
+    __m512i lo    = _mm512_set_epi64(3, 3, 2, 2, 1, 1, 0, 0);     // samples 0..3 on re/im pairs
+    __m512i hi    = _mm512_set_epi64(7, 7, 6, 6, 5, 5, 4, 4);     // samples 4..7 on re/im pairs
+    Index i       = 0;
+    for (; i + 8 <= n; i += 8) {  // 8 samples per iteration
+        __m512d xa    = load8(x + 2 * i);
+        __m512d xb    = load8(x + 2 * i + 8);
+        __m512d re    = _mm512_permutex2var_pd(xa, even, xb);
+        __m512d im    = _mm512_permutex2var_pd(xa, odd, xb);
+        __m512d power = _mm512_fmadd_pd(re, re, _mm512_mul_pd(im, im));
+        __m512d ya, yb;
+        if (DUAL) {
+            ya    = load8(y + 2 * i);
+            yb    = load8(y + 2 * i + 8);
+            re    = _mm512_permutex2var_pd(ya, even, yb);
+            im    = _mm512_permutex2var_pd(ya, odd, yb);
+            power = _mm512_fmadd_pd(re, re, _mm512_fmadd_pd(im, im, power));
+        }
+        peak = _mm512_max_pd(peak, power);
+
+        __m512d s, c;
+        sinCos8(_mm512_mul_pd(power, phase), s, c);
+        s = _mm512_mul_pd(s, scale);
+        c = _mm512_mul_pd(c, scale);
+
+        __m512d clo = _mm512_permutexvar_pd(lo, c), slo = _mm512_permutexvar_pd(lo, s);
+        __m512d chi = _mm512_permutexvar_pd(hi, c), shi = _mm512_permutexvar_pd(hi, s);
+        store8(x + 2 * i, rotate8(xa, clo, slo));
+        store8(x + 2 * i + 8, rotate8(xb, chi, shi));
+        if (DUAL) {
+            store8(y + 2 * i, rotate8(ya, clo, slo));
+            store8(y + 2 * i + 8, rotate8(yb, chi, shi));
+        }
+    }
+    return kerrScalar<DUAL, T>(ux + i, DUAL ? uy + i : uy, n - i, gamleff, gain, _mm512_reduce_max_pd(peak));
+}
+
+// Single-precision sin/cos polynomials on [-pi/4, pi/4] and split of pi/2, from Cephes sinf/cosf
+const float SIN_COEF_F[3] = {-1.9515295891E-4f, 8.3321608736E-3f, -1.6666654611E-1f};
+const float COS_COEF_F[3] = {2.443315711809948E-5f, -1.388731625493765E-3f, 4.166664568298827E-2f};
+const float PIO2F_1       = 1.5703125f;
+const float PIO2F_2       = 4.837512969970703125E-4f;
+const float PIO2F_3       = 7.54978995489188216E-8f;
+
+__attribute__((target("avx512f"))) inline void sinCos16(__m512 x, __m512 &s, __m512 &c) {
+    __m512 k  = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(2 / M_PI)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 r  = _mm512_fnmadd_ps(k, _mm512_set1_ps(PIO2F_1), x);
+    r         = _mm512_fnmadd_ps(k, _mm512_set1_ps(PIO2F_2), r);
+    r         = _mm512_fnmadd_ps(k, _mm512_set1_ps(PIO2F_3), r);
+    __m512 z  = _mm512_mul_ps(r, r);
+    __m512 ps = _mm512_set1_ps(SIN_COEF_F[0]);
+    __m512 pc = _mm512_set1_ps(COS_COEF_F[0]);
+    for (int i = 1; i < 3; ++i) {
+        ps = _mm512_fmadd_ps(ps, z, _mm512_set1_ps(SIN_COEF_F[i]));
+        pc = _mm512_fmadd_ps(pc, z, _mm512_set1_ps(COS_COEF_F[i]));
+    }
+    __m512 sr = _mm512_fmadd_ps(_mm512_mul_ps(r, z), ps, r);
+    __m512 cr = _mm512_fmadd_ps(_mm512_mul_ps(z, z), pc, _mm512_fnmadd_ps(z, _mm512_set1_ps(0.5f), _mm512_set1_ps(1)));
+
+    __m512i q      = _mm512_cvtps_epi32(k);
+    __m512i one    = _mm512_set1_epi32(1);
+    __m512i two    = _mm512_set1_epi32(2);
+    __mmask16 swap = _mm512_test_epi32_mask(q, one);
+    __m512 sinQ    = _mm512_mask_blend_ps(swap, sr, cr);
+    __m512 cosQ    = _mm512_mask_blend_ps(swap, cr, sr);
+    __m512i sSign  = _mm512_slli_epi32(_mm512_and_epi32(q, two), 30);
+    __m512i cSign  = _mm512_slli_epi32(_mm512_and_epi32(_mm512_add_epi32(q, one), two), 30);
+    s              = _mm512_castsi512_ps(_mm512_xor_epi32(_mm512_castps_si512(sinQ), sSign));
+    c              = _mm512_castsi512_ps(_mm512_xor_epi32(_mm512_castps_si512(cosQ), cSign));
+}
+
+__attribute__((target("avx512f"))) inline __m512 rotate16(__m512 u, __m512 c, __m512 s) {
+    return _mm512_fmaddsub_ps(u, c, _mm512_mul_ps(_mm512_permute_ps(u, 0xB1), s));
+}
+
+// The whole step in single precision, 16 samples per iteration
+template<bool DUAL>
+__attribute__((target("avx512f"))) double kerrAvx512Single(complex<float> *ux, complex<float> *uy, Index n, double gamleff, double gain) {
+    auto *x      = reinterpret_cast<float *>(ux);
+    auto *y      = reinterpret_cast<float *>(uy);
+    __m512 phase = _mm512_set1_ps((float) -gamleff);
+    __m512 scale = _mm512_set1_ps((float) gain);
+    __m512 peak  = _mm512_setzero_ps();
+    __m512i even = _mm512_set_epi32(30, 28, 26, 24, 22, 20, 18, 16, 14, 12, 10, 8, 6, 4, 2, 0);  // re of samples 0..15 across a and b
+    __m512i odd  = _mm512_set_epi32(31, 29, 27, 25, 23, 21, 19, 17, 15, 13, 11, 9, 7, 5, 3, 1);  // im of samples 0..15
+    __m512i lo   = _mm512_set_epi32(7, 7, 6, 6, 5, 5, 4, 4, 3, 3, 2, 2, 1, 1, 0, 0);              // samples 0..7 on re/im pairs
+    __m512i hi   = _mm512_set_epi32(15, 15, 14, 14, 13, 13, 12, 12, 11, 11, 10, 10, 9, 9, 8, 8);  // samples 8..15 on re/im pairs
+    Index i      = 0;
+    for (; i + 16 <= n; i += 16) {  // 16 samples per iteration
+        __m512 xa    = _mm512_loadu_ps(x + 2 * i);
+        __m512 xb    = _mm512_loadu_ps(x + 2 * i + 16);
+        __m512 re    = _mm512_permutex2var_ps(xa, even, xb);
+        __m512 im    = _mm512_permutex2var_ps(xa, odd, xb);
+        __m512 power = _mm512_fmadd_ps(re, re, _mm512_mul_ps(im, im));
+        __m512 ya, yb;
+        if (DUAL) {
+            ya    = _mm512_loadu_ps(y + 2 * i);
+            yb    = _mm512_loadu_ps(y + 2 * i + 16);
+            re    = _mm512_permutex2var_ps(ya, even, yb);
+            im    = _mm512_permutex2var_ps(ya, odd, yb);
+            power = _mm512_fmadd_ps(re, re, _mm512_fmadd_ps(im, im, power));
+        }
+        peak = _mm512_max_ps(peak, power);
+
+        __m512 s, c;
+        sinCos16(_mm512_mul_ps(power, phase), s, c);
+        s = _mm512_mul_ps(s, scale);
+        c = _mm512_mul_ps(c, scale);
+
+        __m512 clo = _mm512_permutexvar_ps(lo, c), slo = _mm512_permutexvar_ps(lo, s);
+        __m512 chi = _mm512_permutexvar_ps(hi, c), shi = _mm512_permutexvar_ps(hi, s);
+        _mm512_storeu_ps(x + 2 * i, rotate16(xa, clo, slo));
+        _mm512_storeu_ps(x + 2 * i + 16, rotate16(xb, chi, shi));
+        if (DUAL) {
+            _mm512_storeu_ps(y + 2 * i, rotate16(ya, clo, slo));
+            _mm512_storeu_ps(y + 2 * i + 16, rotate16(yb, chi, shi));
+        }
+    }
+    return kerrScalar<DUAL, float, float>(ux + i, DUAL ? uy + i : uy, n - i, gamleff, gain, _mm512_reduce_max_ps(peak));
+}
+
+#pragma GCC diagnostic pop
+
+#endif
+
+enum KERR_ISA { KERR_SCALAR,
+                KERR_AVX2,
+                KERR_AVX512 };
+
+KERR_ISA detectIsa() {
+#ifdef SIMULIB_KERR_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return KERR_AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return KERR_AVX2;
+#endif
+    return KERR_SCALAR;
+}
+
+const KERR_ISA KERNEL_ISA = detectIsa();
+
+template<bool DUAL>
+double kerrDispatch(complex<double> *ux, complex<double> *uy, Index n, double gamleff, double gain) {
+    double pmax;
+    switch (KERNEL_ISA) {
+#ifdef SIMULIB_KERR_SIMD
+        case KERR_AVX512:
+            pmax = kerrAvx512<DUAL, double>(ux, uy, n, gamleff, gain);
+            break;
+        case KERR_AVX2:
+            pmax = kerrAvx2<DUAL, double>(ux, uy, n, gamleff, gain);
+            break;
+#endif
+        default:
+            pmax = kerrScalar<DUAL>(ux, uy, n, gamleff, gain, 0);
+            break;
+    }
+    return pmax * gain * gain;
+}
+
+// Single-precision samples. Without AVX-512 the vectorized step is the mixed-precision one.
+template<bool DUAL>
+double kerrDispatch(complex<float> *ux, complex<float> *uy, Index n, double gamleff, double gain, bool isMixed) {
+    double pmax;
+    switch (KERNEL_ISA) {
+#ifdef SIMULIB_KERR_SIMD
+        case KERR_AVX512:
+            if (isMixed)
+                pmax = kerrAvx512<DUAL, float>(ux, uy, n, gamleff, gain);
+            else
+                pmax = kerrAvx512Single<DUAL>(ux, uy, n, gamleff, gain);
+            break;
+        case KERR_AVX2:
+            pmax = kerrAvx2<DUAL, float>(ux, uy, n, gamleff, gain);
+            break;
+#endif
+        default:
+            if (isMixed)
+                pmax = kerrScalar<DUAL, float, double>(ux, uy, n, gamleff, gain, 0);
+            else
+                pmax = kerrScalar<DUAL, float, float>(ux, uy, n, gamleff, gain, 0);
+            break;
+    }
+    return pmax * gain * gain;
+}
+
+}  // namespace
+
+/**
+ * @brief Fused Kerr nonlinear step u = gain * u * exp(-i*gamleff*|u|^2), done in a
+ *        single pass over the samples.
+ * @param u: samples of one polarization, overwritten.
+ * @param n: number of samples.
+ * @param gamleff: nonlinear coefficient times the effective length of the step [1/mW].
+ * @param gain: field attenuation of the step, folded in the same pass.
+ * @return peak power [mW] of the samples after the step, i.e., gain^2 * max(|u|^2).
+ */
+double kerrKernel(complex<double> *u, Index n, double gamleff, double gain) {
+    return kerrDispatch<false>(u, nullptr, n, gamleff, gain);
+}
+
+/**
+ * @brief Fused Manakov nonlinear step of a dual-polarization field:
+ *        [ux, uy] = gain * [ux, uy] * exp(-i*gamleff*(|ux|^2 + |uy|^2)). The phase is
+ *        evaluated once per sample and applied to both polarizations in the same pass.
+ * @param ux: samples of the x polarization, overwritten.
+ * @param uy: samples of the y polarization, overwritten.
+ * @param n: number of samples of each polarization.
+ * @param gamleff: nonlinear coefficient, including the 8/9 Manakov factor, times the
+ *        effective length of the step [1/mW].
+ * @param gain: field attenuation of the step, folded in the same pass.
+ * @return peak power [mW] of |ux|^2 + |uy|^2 after the step.
+ */
+double kerrKernel(complex<double> *ux, complex<double> *uy, Index n, double gamleff, double gain) {
+    return kerrDispatch<true>(ux, uy, n, gamleff, gain);
+}
+
+/**
+ * @brief Fused Kerr nonlinear step of single-precision samples, as kerrKernel of
+ *        double-precision ones.
+ * @param u: samples of one polarization, overwritten.
+ * @param n: number of samples.
+ * @param gamleff: nonlinear coefficient times the effective length of the step [1/mW].
+ * @param gain: field attenuation of the step, folded in the same pass.
+ * @param isMixed: true: the power and the phase are evaluated in double precision;
+ *        false: in single precision, twice as many samples per instruction.
+ * @return peak power [mW] of the samples after the step.
+ */
+double kerrKernel(complex<float> *u, Index n, double gamleff, double gain, bool isMixed) {
+    return kerrDispatch<false>(u, nullptr, n, gamleff, gain, isMixed);
+}
+
+/**
+ * @brief Fused Manakov nonlinear step of single-precision samples, as kerrKernel of
+ *        double-precision ones.
+ * @param ux: samples of the x polarization, overwritten.
+ * @param uy: samples of the y polarization, overwritten.
+ * @param n: number of samples of each polarization.
+ * @param gamleff: nonlinear coefficient, including the 8/9 Manakov factor, times the
+ *        effective length of the step [1/mW].
+ * @param gain: field attenuation of the step, folded in the same pass.
+ * @param isMixed: true: the power and the phase are evaluated in double precision;
+ *        false: in single precision.
+ * @return peak power [mW] of |ux|^2 + |uy|^2 after the step.
+ */
+double kerrKernel(complex<float> *ux, complex<float> *uy, Index n, double gamleff, double gain, bool isMixed) {
+    return kerrDispatch<true>(ux, uy, n, gamleff, gain, isMixed);
+}
+
+const char *kerrKernelIsa() {
+    switch (KERNEL_ISA) {
+        case KERR_AVX512:
+            return "AVX-512";
+        case KERR_AVX2:
+            return "AVX2";
+        default:
+            return "scalar";
+    }
+}
+
+}  // namespace HARDWARE_TYPE
+
+}  // namespace SimuLib
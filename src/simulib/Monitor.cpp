@@ -0,0 +1,194 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Field monitors of the SSFM step loop
+ */
+
+#include "Internal"
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+namespace SimuLib {
+
+namespace HARDWARE_TYPE {
+
+namespace {
+
+const size_t RING_SIZE = 4;  // snapshots copied ahead of the reducer
+
+// Sorted positions [m] past START, without duplicates
+vector<double> Positions(vector<double> positions, double start) {
+    positions.erase(remove_if(positions.begin(), positions.end(), [start](double z) { return z < start; }), positions.end());
+    sort(positions.begin(), positions.end());
+    positions.erase(unique(positions.begin(), positions.end()), positions.end());
+    return positions;
+}
+
+}  // namespace
+
+/**
+ * @brief Starts the thread of the field monitors of a fiber.
+ * @param fiber: the checked fiber, with the monitor positions.
+ * @param start: distance [m] the propagation starts from: the positions before it are skipped.
+ */
+Monitor::Monitor(const Fiber &fiber, double start) : fiber(fiber) {
+    if (fiber.monitorDecimation == 0)
+        ERROR("fiber.monitorDecimation must be at least 1.");
+    vector<double> all = fiber.monitorPositions;
+    all.insert(all.end(), fiber.spectrumPositions.begin(), fiber.spectrumPositions.end());
+    if (fiber.monitorSpacing > 0)
+        for (double z = 0; z <= fiber.length; z += fiber.monitorSpacing)
+            all.push_back(z);
+    positions   = Positions(all, start);
+    spectra     = Positions(fiber.spectrumPositions, start);
+    isEveryStep = fiber.trace && positions.empty();
+
+    ring.resize(RING_SIZE);
+    reducer = thread(&Monitor::reduce, this);
+}
+
+Monitor::~Monitor() {
+    {
+        lock_guard<mutex> lock(guard);
+        isStopped = true;
+    }
+    changed.notify_all();
+    reducer.join();
+}
+
+bool Monitor::isDue(double z, bool &withSpectrum) {
+    withSpectrum = false;
+    while (nextSpectrum < spectra.size() && spectra[nextSpectrum] <= z) {
+        withSpectrum = true;
+        nextSpectrum++;
+    }
+    bool isDue = isEveryStep;
+    while (nextPosition < positions.size() && positions[nextPosition] <= z) {
+        isDue = true;
+        nextPosition++;
+    }
+    return isDue;
+}
+
+/**
+ * @brief Records the field at a distance: the field is copied and reduced by the
+ *        background thread.
+ * @param z: position [m] of the field.
+ * @param step: steps done.
+ * @param field: time samples of the field.
+ * @param spectrum: spectrum of the field, or nullptr.
+ */
+void Monitor::record(double z, unsigned long step, const MatrixXcd &field, const MatrixXcd *spectrum) {
+    Snapshot &snapshot = acquire();
+    snapshot.z         = z;
+    snapshot.step      = step;
+    snapshot.field.resize(field.rows(), field.cols());  // no reallocation after the first records
+    snapshot.field.array() = field.array();
+    if (spectrum != nullptr) {
+        snapshot.spectrum.resize(field.rows(), field.cols());
+        snapshot.spectrum.array() = spectrum->array();
+    } else {
+        snapshot.spectrum.resize(0, 0);
+    }
+    release();
+}
+
+void Monitor::record(double z, unsigned long step, const MatrixXcf &field, const MatrixXcf *spectrum) {
+    Snapshot &snapshot = acquire();
+    snapshot.z         = z;
+    snapshot.step      = step;
+    snapshot.field.resize(field.rows(), field.cols());
+    snapshot.field.array() = field.cast<complex<double>>().array();
+    if (spectrum != nullptr) {
+        snapshot.spectrum.resize(field.rows(), field.cols());
+        snapshot.spectrum.array() = spectrum->cast<complex<double>>().array();
+    } else {
+        snapshot.spectrum.resize(0, 0);
+    }
+    release();
+}
+
+vector<MonitorRecord> Monitor::finish() {
+    unique_lock<mutex> lock(guard);
+    changed.wait(lock, [this] { return size == 0; });
+    return move(records);
+}
+
+// ACQUIRE waits for a free snapshot of the ring and RELEASE hands it to the reducer.
+
+Monitor::Snapshot &Monitor::acquire() {
+    unique_lock<mutex> lock(guard);
+    changed.wait(lock, [this] { return size < ring.size(); });
+    return ring[head];  // the reducer does not touch it until released
+}
+
+void Monitor::release() {
+    {
+        lock_guard<mutex> lock(guard);
+        head = (head + 1) % ring.size();
+        size++;
+    }
+    changed.notify_all();
+}
+
+// REDUCE is the loop of the background thread: each snapshot becomes a MonitorRecord,
+// in the order of the step loop.
+
+void Monitor::reduce() {
+    Index group = fiber.isUnique ? (fiber.isDual ? 2 : 1) : 0;  // columns of a field, 0 until the field is known
+    unique_lock<mutex> lock(guard);
+    while (true) {
+        changed.wait(lock, [this] { return size > 0 || isStopped; });
+        if (size == 0)
+            return;
+        Snapshot &snapshot = ring[(head + ring.size() - size) % ring.size()];
+        lock.unlock();
+
+        MonitorRecord record;
+        record.z      = snapshot.z;
+        record.step   = snapshot.step;
+        MatrixXd p    = snapshot.field.cwiseAbs2();
+        record.energy = p.colwise().sum() / gstate.SAMP_FREQ;  // [mW/GHz]
+        if (group == 0)
+            group = p.cols() / fiber.nRealizations;
+        record.peakPower = 0;
+        for (Index c = 0; c + group <= p.cols(); c += group)
+            record.peakPower = max(record.peakPower, p.middleCols(c, group).rowwise().sum().maxCoeff());
+        Index decimation = fiber.monitorDecimation;
+        record.power.resize((p.rows() + decimation - 1) / decimation, p.cols());
+        for (Index i = 0; i < record.power.rows(); ++i)
+            record.power.row(i) = p.row(i * decimation);
+        if (snapshot.spectrum.size() > 0)
+            record.spectrum = snapshot.spectrum.cwiseAbs2();
+
+        if (fiber.trace) {
+            if (records.empty())
+                cout << "Stepupd\tstep #\tz [m]\tPmax [mW]" << endl;
+            cout << (fiber.isRk4ip ? fiber.stepType : fiber.stepUpdate) << "\t" << record.step << "\t" << record.z << "\t" << record.peakPower << endl;
+        }
+        if (fiber.onMonitor)
+            fiber.onMonitor(record);
+
+        lock.lock();
+        records.push_back(move(record));
+        size--;
+        changed.notify_all();
+    }
+}
+
+}  // namespace HARDWARE_TYPE
+
+}  // namespace SimuLib
@@ -0,0 +1,259 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Few-mode fiber of space-division multiplexing (SDM)
+ *
+ * The N modes propagate by the symmetric SSFM with steps of equal length dz: half a
+ * linear step, then nonlinear and linear steps in turn, the last linear step of half
+ * a step. A linear step of length h is exp(-i*D*h/2) * exp(-i*K*h) * exp(-i*D*h/2)
+ * on the spectrum at each frequency, with D the diagonal of the dispersion, group
+ * delay and loss of the modes and K the coupling matrix, the exponential of K taken
+ * once by its eigendecomposition. The steps being of equal length, all the operators
+ * are computed before the first step. A nonlinear step multiplies mode m of group a
+ * by exp(-i*gam*dz*sum_b kappa(a, b) * P_b), with P_b the power of the modes of group b.
+ *
+ * The FFTs transform the N modes in one batch, so the columns of the field stay one
+ * per mode. The coupling works on blocks of frequencies small enough for the cache,
+ * as a product of the block by the coupling matrix, and the blocks are shared by the
+ * OpenMP threads. The powers of the nonlinear step go one mode group per thread and
+ * the phases one mode per thread. No sum depends on the split among the threads, so
+ * the results do not depend on the number of threads.
+ *
+ * [Mum13] S. Mumtaz, R.-J. Essiambre and G. P. Agrawal, "Nonlinear Propagation in
+ *         Multimode and Multicore Fibers: Generalization of the Manakov Equations,"
+ *         J. Lightw. Technol., vol. 31, no. 3, 2013.
+ */
+
+// Eigen's matrix-vector products, instantiated here by the eigensolver, trip
+// -Wmaybe-uninitialized in Eigen's own headers
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include "Internal"
+#include "src/Eigen/Eigenvalues"
+#pragma GCC diagnostic pop
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+namespace SimuLib {
+
+namespace HARDWARE_TYPE {
+
+tuple<double, double> DispersionCoefficients(double lambda, double dispersion, double slope);
+
+namespace {
+
+const Index BLOCK_ROWS = 256;  // frequencies of a block of the coupling: a block of 12 modes takes 48 kB
+
+// Linear step of a length: the diagonal operator of half the step and the transposed
+// exponential of the coupling; without coupling the diagonal of the whole step
+struct ModeOperator {
+    MatrixXcd diagonal;  // one column per mode, ordered as gstate.FN
+    MatrixXcd coupling;  // exp(-i*K*h) transposed, empty without coupling
+};
+
+// GROUPS lists the modes of each group, checking FIBER against N modes.
+
+vector<vector<Index>> Groups(const MultimodeFiber &fiber, Index n) {
+    vector<unsigned> group = fiber.modeGroups;
+    if (group.empty())
+        group.assign(n, 0);
+    if ((Index) group.size() != n)
+        ERROR("fiber.modeGroups must have one group per column of E.field.");
+    vector<vector<Index>> groups(*max_element(group.begin(), group.end()) + 1);
+    for (Index m = 0; m < n; ++m)
+        groups[group[m]].push_back(m);
+    for (const auto &members: groups)
+        if (members.empty())
+            ERROR("fiber.modeGroups must number the groups from 0 without gaps.");
+    return groups;
+}
+
+// OPERATOR is the linear step of length H: BETAT [1/m] of each mode, the loss ALPHA
+// [1/m] and the eigendecomposition VECTORS, VALUES of the coupling matrix, if any.
+
+ModeOperator Operator(const MatrixXd &betat, double alpha, const MatrixXcd &vectors, const VectorXd &values, double h) {
+    ModeOperator op;
+    bool isCoupled = vectors.size() > 0;
+    double length  = isCoupled ? h / 2 : h;
+    op.diagonal    = (betat * complex<double>(0, -length)).array().exp() * exp(-alpha / 2 * length);
+    if (isCoupled) {
+        VectorXcd phase = (values * complex<double>(0, -h)).array().exp();
+        op.coupling     = (vectors * phase.asDiagonal() * vectors.adjoint()).transpose();
+    }
+    return op;
+}
+
+// LINEARMODESTEP applies the linear step OP to the spectrum: each block of frequencies
+// through the diagonal, the coupling and the diagonal again, in TILES of the threads.
+
+void LinearModeStep(MatrixXcd &spectrum, const ModeOperator &op, vector<MatrixXcd> &tiles) {
+    if (op.coupling.size() == 0) {
+#pragma omp parallel for
+        for (Index m = 0; m < spectrum.cols(); ++m)
+            spectrum.col(m).array() *= op.diagonal.col(m).array();
+        return;
+    }
+    Index nblocks = (spectrum.rows() + BLOCK_ROWS - 1) / BLOCK_ROWS;
+#pragma omp parallel for
+    for (Index b = 0; b < nblocks; ++b) {
+        int thread = 0;
+#ifdef _OPENMP
+        thread = omp_get_thread_num();
+#endif
+        Index first = b * BLOCK_ROWS;
+        Index rows  = min(BLOCK_ROWS, spectrum.rows() - first);
+        auto block  = spectrum.middleRows(first, rows);
+        auto tile   = tiles[thread].topRows(rows);
+        block.array() *= op.diagonal.middleRows(first, rows).array();
+        tile.noalias() = block * op.coupling;
+        block          = tile.cwiseProduct(op.diagonal.middleRows(first, rows));
+    }
+}
+
+// NONLINEARMODESTEP is the nonlinear step of length DZ: the power of each group in
+// POWER, one group per thread, their phases in PHASE, then each mode by the phase of
+// its group, one mode per thread.
+
+void NonlinearModeStep(MatrixXcd &field, const vector<vector<Index>> &groups, const VectorXi &group, const MatrixXd &kappa, double gam, double dz,
+                       MatrixXd &power, MatrixXd &phase) {
+#pragma omp parallel for
+    for (Index g = 0; g < (Index) groups.size(); ++g) {
+        power.col(g).setZero();
+        for (Index m: groups[g])
+            power.col(g) += field.col(m).cwiseAbs2();
+    }
+    phase.noalias() = power * (gam * dz * kappa.transpose());
+#pragma omp parallel for
+    for (Index m = 0; m < field.cols(); ++m)
+        field.col(m).array() *= phase.col(group[m]).array().unaryExpr([](double phi) { return polar(1., -phi); });
+}
+
+}  // namespace
+
+/**
+ * @brief Few-mode fiber of space-division multiplexing: N spatial and polarization
+ *        modes with dispersion and group delay of their own, linear coupling and the
+ *        Kerr effect of the generalized Manakov equations, by the symmetric SSFM with
+ *        steps of equal length.
+ * @param e: electric field, one column per mode, overwritten by the field at the
+ *        fiber output. E.lambda: central wavelength [nm] of the field.
+ * @param fiber: the few-mode fiber.
+ * @param workspace: scratch buffers: the spectrum and the FFT counters.
+ * @return out: fiber option, with the step length in out.firstStepLength
+ */
+Out multimodeTransmit(E &e, const MultimodeFiber &fiber, SsfmWorkspace &workspace) {
+
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();  // Start time
+
+    Index n = e.field.cols();
+    if (n == 0 || e.field.rows() != (Index) gstate.NSAMP)
+        ERROR("E.field must have gstate.NSAMP rows and one column per mode.");
+    if (fiber.length <= 0 || fiber.maxStepLength <= 0)
+        ERROR("fiber.length and fiber.maxStepLength must be positive.");
+    RowVectorXd dispersion = fiber.dispersion.size() == 0 ? RowVectorXd::Constant(n, 17) : fiber.dispersion;
+    RowVectorXd groupDelay = fiber.groupDelay.size() == 0 ? RowVectorXd::Zero(n) : fiber.groupDelay;
+    if (dispersion.size() != n || groupDelay.size() != n)
+        ERROR("fiber.dispersion and fiber.groupDelay must have one value per mode.");
+    vector<vector<Index>> groups = Groups(fiber, n);
+    Index ngroups                = (Index) groups.size();
+    VectorXi group(n);
+    for (Index g = 0; g < ngroups; ++g)
+        for (Index m: groups[g])
+            group[m] = (int) g;
+    MatrixXd kappa = fiber.kerrCoefficients;
+    if (kappa.size() == 0 && ngroups == 1 && n == 2)  // the Manakov equation of two polarizations
+        kappa = MatrixXd::Constant(1, 1, 8. / 9);
+    else if (kappa.size() == 0 && fiber.nonlinearIndex == 0)
+        kappa = MatrixXd::Zero(ngroups, ngroups);
+    else if (kappa.size() == 0)
+        ERROR("fiber.kerrCoefficients must be given unless the field is the two polarizations of one mode.");
+    if (kappa.rows() != ngroups || kappa.cols() != ngroups)
+        ERROR("fiber.kerrCoefficients must have one row and one column per mode group.");
+
+    // Beta coefficients [1/m] of each mode
+    VectorXd omega = 2 * M_PI * gstate.FN;  // angular frequency [rad/ns]
+    double domega  = 2 * M_PI * LIGHT_SPEED * (1. / e.lambda(0, 0) - 1. / fiber.lambda);  // [1/ns]
+    MatrixXd betat(omega.size(), n);
+    for (Index m = 0; m < n; ++m) {
+        double b2, b3;  // beta2 [ns^2/m] and beta3 [ns^3/m] @ fiber.lambda
+        tie(b2, b3)  = DispersionCoefficients(fiber.lambda, dispersion[m], fiber.slope);
+        double beta1 = groupDelay[m] * 1e-6;  // [ns/m]
+        double beta2 = b2 + b3 * domega;      // [ns^2/m] @ E.lambda
+        betat.col(m) = omega.array() * (omega.array() * (omega.array() * b3 / 6 + beta2 / 2) + beta1);
+    }
+    double alpha = log(10) * 1e-4 * fiber.attenuation;  // [1/m]
+    double gam   = 0;                                   // nonlinear coefficient [1/mW/m] of the fundamental mode
+    if (fiber.nonlinearIndex != 0)
+        gam = 2 * M_PI * fiber.nonlinearIndex / (e.lambda(0, 0) * fiber.effectiveArea) * 1e18;
+
+    // Operators of the steps
+    MatrixXcd vectors;
+    VectorXd values;
+    if (fiber.coupling.size() > 0) {
+        if (fiber.coupling.rows() != n || fiber.coupling.cols() != n)
+            ERROR("fiber.coupling must be N x N for N modes.");
+        if ((fiber.coupling - fiber.coupling.adjoint()).norm() > 1e-12 * fiber.coupling.norm())
+            ERROR("fiber.coupling must be Hermitian.");
+        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXcd> solver(Eigen::MatrixXcd(fiber.coupling));  // MatrixXcd is derived from the Eigen matrix
+        vectors = solver.eigenvectors();
+        values  = solver.eigenvalues();
+    }
+    unsigned long nsteps = (unsigned long) ceil(fiber.length / fiber.maxStepLength);
+    double dz            = fiber.length / nsteps;
+    ModeOperator half    = Operator(betat, alpha, vectors, values, dz / 2);
+    ModeOperator whole   = Operator(betat, alpha, vectors, values, dz);
+
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+    vector<MatrixXcd> tiles(threads, MatrixXcd(BLOCK_ROWS, n));
+    MatrixXd power(e.field.rows(), ngroups);
+    MatrixXd phase(e.field.rows(), ngroups);
+    MatrixXcd &spectrum = workspace.spectrum;
+    workspace.resize(e.field.rows(), n, 1);
+
+    fftCol(e.field, spectrum);
+    LinearModeStep(spectrum, half, tiles);
+    for (unsigned long k = 1; k <= nsteps; ++k) {
+        ifftCol(spectrum, e.field);
+        if (gam != 0)
+            NonlinearModeStep(e.field, groups, group, kappa, gam, dz, power, phase);
+        fftCol(e.field, spectrum);
+        LinearModeStep(spectrum, k < nsteps ? whole : half, tiles);
+    }
+    ifftCol(spectrum, e.field);
+
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();  // End time
+
+    Out out             = {};
+    out.time            = chrono::duration<double>(end - begin).count();
+    out.firstStepLength = dz;
+    out.nCycle          = nsteps;
+    out.nFft            = nsteps + 1;
+    out.nIfft           = nsteps + 1;
+    out.samplingRate    = gstate.SAMP_FREQ;
+    return out;
+}
+
+}  // namespace HARDWARE_TYPE
+
+}  // namespace SimuLib
@@ -0,0 +1,110 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+
+/**
+ * Resampling of the field around a fiber
+ */
+
+#include "Internal"
+
+using namespace std;
+
+namespace SimuLib {
+
+namespace HARDWARE_TYPE {
+
+namespace {
+
+// Smallest even product of 2, 3 and 5 not below N
+Index FftLength(Index n) {
+    for (Index m = max<Index>(n + n % 2, 2);; m += 2) {
+        Index r = m;
+        for (Index p: {2, 3, 5})
+            while (r % p == 0)
+                r /= p;
+        if (r == 1)
+            return m;
+    }
+}
+
+// Copies the bins of the frequencies of an FFT of even length M, the first and the
+// last M/2 bins in FFT order, from the spectrum IN to the spectrum OUT, scaled by SCALE
+void CopyBins(const MatrixXcd &in, MatrixXcd &out, Index m, double scale) {
+    out.topRows(m / 2)    = in.topRows(m / 2) * scale;
+    out.bottomRows(m / 2) = in.bottomRows(m / 2) * scale;
+}
+
+}  // namespace
+
+/**
+ * @brief Moves the field to the propagation grid of a fiber: the signal bandwidth
+ *        is the smallest band around the carrier with all but fiber.resampleTolerance
+ *        of the energy of the field, the rest filtered out.
+ * @param e: electric field on the grid of gstate, moved to the propagation grid.
+ * @param fiber: the fiber, with isResampled, resampleMargin and resampleTolerance.
+ */
+Resampler::Resampler(E &e, const Fiber &fiber) : saved(gstate) {
+    if (!fiber.isResampled)
+        return;
+    if (fiber.resampleMargin < 2)
+        ERROR("fiber.resampleMargin must be at least 2.");
+    Index nsamp = e.field.rows();
+    if (nsamp != (Index) gstate.NSAMP || nsamp % 2 != 0)
+        ERROR("Resampling needs a field of gstate.NSAMP samples, an even number.");
+
+    // Energy of the bins at each distance from the carrier, all columns together
+    MatrixXcd spectrum = fftCol(e.field);
+    VectorXd energy    = VectorXd::Zero(nsamp / 2 + 1);
+    for (Index i = 0; i < nsamp; ++i)
+        energy(min(i, nsamp - i)) += spectrum.row(i).squaredNorm();
+    double outside = fiber.resampleTolerance * energy.sum();
+    Index edge     = nsamp / 2;  // the band is the bins within EDGE of the carrier
+    for (double sum = energy(edge); edge > 0 && sum <= outside; sum += energy(--edge))
+        ;
+    Index m = FftLength((Index) ceil(fiber.resampleMargin * (2 * edge + 1)));
+    if (m >= nsamp)
+        return;
+
+    MatrixXcd resampled = MatrixXcd::Zero(m, e.field.cols());
+    CopyBins(spectrum, resampled, m, (double) m / nsamp);
+    ifftCol(resampled, e.field);
+
+    gstate.NSAMP     = (unsigned long) m;
+    gstate.SAMP_FREQ = saved.SAMP_FREQ * m / nsamp;
+    gstate.FN.resize(m);
+    gstate.FN.head(m / 2) = saved.FN.head(m / 2);
+    gstate.FN.tail(m / 2) = saved.FN.tail(m / 2);
+    isResampled           = true;
+}
+
+Resampler::~Resampler() {
+    if (isResampled)
+        gstate = saved;
+}
+
+void Resampler::restore(E &e) {
+    if (!isResampled)
+        return;
+    Index m            = e.field.rows();
+    MatrixXcd spectrum = fftCol(e.field);
+    MatrixXcd full     = MatrixXcd::Zero(saved.NSAMP, e.field.cols());
+    CopyBins(spectrum, full, m, (double) saved.NSAMP / m);
+    ifftCol(full, e.field);
+    gstate      = saved;
+    isResampled = false;
+}
+
+}  // namespace HARDWARE_TYPE
+
+}  // namespace SimuLib
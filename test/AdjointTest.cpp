@@ -0,0 +1,160 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+/**
+ * Adjoint gradients of fiberGradient against central finite differences of
+ * fiberTransmit, for the input field along a random direction and for the fiber
+ * parameters: scalar and dual-polarization fields, asymmetric and symmetric steps,
+ * with and without Kerr effect. The steps are held fixed by fiber.maxStepLength. A
+ * few checkpoints give the gradient of many. Prints the cost of the gradient in
+ * fiberTransmit runs.
+ */
+
+#include <SimuLib>
+#include <random>
+
+using namespace SimuLib;
+
+// Squared distance of the output field to TARGET
+double distance(const MatrixXcd &field, const MatrixXcd &target, MatrixXcd &gradient) {
+    gradient = 2 * (field - target);
+    return (field - target).squaredNorm();
+}
+
+// Loss of the output of FIBER for the input E
+double transmitLoss(E e, const Fiber &fiber, const MatrixXcd &target) {
+    SsfmWorkspace workspace;
+    fiberTransmit(e, fiber, workspace);
+    return (e.field - target).squaredNorm();
+}
+
+// Central finite difference of the loss with respect to the fiber parameter PARAMETER,
+// changed by DELTA
+double centralDifference(const E &e, Fiber fiber, double Fiber::*parameter, const MatrixXcd &target, double delta) {
+    double value     = fiber.*parameter;
+    fiber.*parameter = value + delta;
+    double plus      = transmitLoss(e, fiber, target);
+    fiber.*parameter = value - delta;
+    double minus     = transmitLoss(e, fiber, target);
+    return (plus - minus) / (2 * delta);
+}
+
+// Derivative of the loss with respect to the fiber parameter PARAMETER: the central
+// differences with STEP and STEP / 2 times its value, Richardson-extrapolated to an
+// error of order STEP^4
+double parameterDifference(const E &e, const Fiber &fiber, double Fiber::*parameter, const MatrixXcd &target, double step = 1e-4) {
+    double delta = step * (fiber.*parameter);
+    double whole = centralDifference(e, fiber, parameter, target, delta);
+    double half  = centralDifference(e, fiber, parameter, target, delta / 2);
+    return (4 * half - whole) / 3;
+}
+
+// Relative error of the gradient against the finite differences; prints both
+double relativeError(const string &name, double gradient, double difference) {
+    double error = abs(gradient - difference) / abs(difference);
+    cout << "  " << name << ": adjoint " << gradient << ", finite difference " << difference << ", error " << error << endl;
+    return error;
+}
+
+// Largest relative error of the gradients of the loss through FIBER
+double checkGradient(const string &name, const E &input, const Fiber &fiber, const MatrixXcd &target, unsigned checkpoints, FiberGradient &gradient) {
+    SsfmWorkspace workspace;
+    E e     = input;
+    Out out = fiberGradient(e, fiber, [&target](const MatrixXcd &field, MatrixXcd &g) { return distance(field, target, g); }, gradient, workspace,
+                            checkpoints);
+    cout << name << ": " << out.nCycle << " steps, loss " << gradient.loss << endl;
+
+    mt19937 generator(7);
+    normal_distribution<double> normal;
+    MatrixXcd direction(input.field.rows(), input.field.cols());
+    for (Index i = 0; i < direction.size(); ++i)
+        direction(i) = complex<double>(normal(generator), normal(generator));
+    direction *= 1e-6 * input.field.norm() / direction.norm();
+    E plus       = input;
+    E minus      = input;
+    plus.field  += direction;
+    minus.field -= direction;
+
+    double error = relativeError("input field", (gradient.field.conjugate().array() * direction.array()).real().sum(),
+                                 (transmitLoss(plus, fiber, target) - transmitLoss(minus, fiber, target)) / 2);
+    if (fiber.nonlinearIndex != 0)
+        error = max(error, relativeError("nonlinear index", gradient.nonlinearIndex, parameterDifference(input, fiber, &Fiber::nonlinearIndex, target)));
+    error = max(error, relativeError("dispersion", gradient.dispersion, parameterDifference(input, fiber, &Fiber::dispersion, target)));
+    // The loss changes little with the slope: a large step keeps the rounding of the loss
+    // small against its change, and the extrapolation its curvature
+    error = max(error, relativeError("slope", gradient.slope, parameterDifference(input, fiber, &Fiber::slope, target, 2e-1)));
+    error = max(error, relativeError("attenuation", gradient.attenuation, parameterDifference(input, fiber, &Fiber::attenuation, target)));
+    return error;
+}
+
+int main() {
+    initGstate(4096, 256);
+
+    // 64 QPSK Gaussian pulses of 20 mW peak power at 16 GBd
+    mt19937 generator(1);
+    uniform_int_distribution<int> symbol(0, 3);
+    E input;
+    input.field = MatrixXcd::Zero(gstate.NSAMP, 1);
+    input.lambda.resize(1, 1);
+    input.lambda(0, 0) = 1550;
+    for (int k = 0; k < 64; ++k) {
+        complex<double> a = polar(sqrt(20.), M_PI / 4 + M_PI / 2 * symbol(generator));
+        for (Index i = 0; i < input.field.rows(); ++i)
+            input.field(i, 0) += a * exp(-pow((double) (i - 32 - 64 * k) / 16, 2) / 2);
+    }
+    MatrixXcd target = input.field;
+
+    Fiber fiber;
+    fiber.length         = 20000;
+    fiber.attenuation    = 0.2;
+    fiber.slope          = 0.06;
+    fiber.nonlinearIndex = 2.5e-20;
+    fiber.maxStepLength  = 500;
+
+    FiberGradient gradient;
+    double error = checkGradient("scalar, asymmetric steps", input, fiber, target, 4, gradient);
+
+    FiberGradient stored;
+    checkGradient("scalar, all steps stored", input, fiber, target, 1000, stored);
+    double storeError = (stored.field - gradient.field).norm() / stored.field.norm();
+    cout << "checkpoints: gradient difference " << storeError << endl;
+
+    E dual;
+    dual.field        = MatrixXcd::Zero(gstate.NSAMP, 2);
+    dual.field.col(0) = input.field.col(0) * sqrt(0.7);
+    dual.field.col(1) = input.field.col(0).reverse() * sqrt(0.3);
+    dual.lambda       = input.lambda;
+    Fiber manakov     = fiber;
+    manakov.isDual    = true;
+    manakov.isManakov = true;
+    manakov.stepType  = "symm";
+    error             = max(error, checkGradient("dual polarization, symmetric steps", dual, manakov, dual.field.reverse().eval(), 8, gradient));
+
+    Fiber linear          = fiber;
+    linear.nonlinearIndex = 0;
+    error                 = max(error, checkGradient("without Kerr effect", input, linear, target, 4, gradient));
+
+    // Cost of the gradient
+    SsfmWorkspace workspace;
+    E e         = input;
+    Out out     = fiberTransmit(e, fiber, workspace);
+    e           = input;
+    Out adjoint = fiberGradient(e, fiber, [&target](const MatrixXcd &field, MatrixXcd &g) { return distance(field, target, g); }, gradient, workspace);
+    cout << "fiberTransmit " << out.time * 1e3 << " ms, fiberGradient " << adjoint.time * 1e3 << " ms (" << adjoint.time / out.time << " runs)" << endl;
+
+    if (error > 1e-4 || storeError > 1e-12) {  // the loss is weakly sensitive to the slope: its finite difference is the least accurate
+        cout << "FAILED" << endl;
+        return 1;
+    }
+    cout << "PASSED" << endl;
+    return 0;
+}
@@ -0,0 +1,110 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Batched realizations: K fields stacked on the columns of E.field must propagate as
+ * K separate fiberTransmit calls, for unique and separate fields, and each realization
+ * with polarization coupling must see its own fiber. Prints the time per realization
+ * of the batch and of the sequential loop.
+ */
+
+#include <SimuLib>
+#include <chrono>
+
+using namespace SimuLib;
+
+// Propagates the K realizations of batch.field, NCOLS columns each, one at a time
+// and all together, and returns the relative difference and the two times [s].
+tuple<double, double, double> compare(const E &batch, Index ncols, const Fiber &fiber) {
+    Index nreal = batch.field.cols() / ncols;
+    MatrixXcd sequential(batch.field.rows(), batch.field.cols());
+    SsfmWorkspace workspace;
+
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    for (Index r = 0; r < nreal; ++r) {
+        E e;
+        e.lambda = batch.lambda;
+        e.field  = batch.field.middleCols(r * ncols, ncols);
+        fiberTransmit(e, fiber, workspace);
+        sequential.middleCols(r * ncols, ncols) = e.field;
+    }
+    double sequentialTime = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    E e   = batch;
+    begin = chrono::steady_clock::now();
+    fiberTransmit(e, fiber, workspace);
+    double batchTime = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    return make_tuple((e.field - sequential).norm() / sequential.norm(), sequentialTime, batchTime);
+}
+
+int main() {
+    const Index NREAL = 16;  // realizations
+    initGstate(4096, 64);
+
+    // Scalar unique field, default 'cle' step update
+    E scalar;
+    scalar.field = MatrixXcd::Random(4096, NREAL) * 3;
+    scalar.lambda.resize(1, 1);
+    scalar.lambda(0, 0) = 1550;
+
+    Fiber fiber;
+    fiber.length         = 50000;
+    fiber.attenuation    = 0.2;
+    fiber.nonlinearIndex = 2.5e-20;
+    double scalarError, sequentialTime, batchTime;
+    tie(scalarError, sequentialTime, batchTime) = compare(scalar, 1, fiber);
+    cout << "scalar: " << NREAL << " realizations, error " << scalarError << ", " << sequentialTime / NREAL * 1e3 << " ms per realization sequentially, "
+         << batchTime / NREAL * 1e3 << " ms batched (" << sequentialTime / batchTime << "x)" << endl;
+
+    // Separate dual-polarization field of three channels, Manakov
+    E wdm;
+    wdm.field       = MatrixXcd::Random(4096, 6 * 4);
+    wdm.lambda      = (RowVectorXd(3) << 1549.6, 1550, 1550.4).finished();
+    fiber.isUnique  = false;
+    fiber.isDual    = true;
+    fiber.isManakov = true;
+    double wdmError;
+    tie(wdmError, sequentialTime, batchTime) = compare(wdm, 6, fiber);
+    cout << "separate field: 4 realizations, error " << wdmError << ", " << sequentialTime / batchTime << "x" << endl;
+
+    // PMD: each realization in its own fiber, with the power of each one conserved
+    E pmd;
+    pmd.field = MatrixXcd::Zero(4096, 2 * NREAL);
+    for (Index r = 0; r < NREAL; ++r)
+        pmd.field.col(2 * r).setOnes();
+    pmd.lambda.resize(1, 1);
+    pmd.lambda(0, 0) = 1550;
+    fiber              = Fiber();
+    fiber.length       = 10000;
+    fiber.attenuation  = 0;
+    fiber.isDual       = true;
+    fiber.pmdParameter = 0.5;
+    fiber.beatLength   = 23;  // not a divisor of the waveplate length, else the waveplates do not rotate a CW
+    fiber.coupling     = "pol";
+    fiberTransmit(pmd, fiber);
+    double powerError = 0, minDistance = INFINITY;
+    for (Index r = 0; r < NREAL; ++r) {
+        powerError = max(powerError, abs(pmd.field.middleCols(2 * r, 2).squaredNorm() / 4096 - 1));
+        if (r > 0)
+            minDistance = min(minDistance, (pmd.field.middleCols(2 * r, 2) - pmd.field.middleCols(0, 2)).norm() / sqrt(4096.));
+    }
+    cout << "PMD: power error " << powerError << ", least distance from the first realization " << minDistance << endl;
+
+    if (scalarError > 1e-12 || wdmError > 1e-12 || powerError > 1e-12 || minDistance < 1e-3) {
+        cout << "FAILED" << endl;
+        return 1;
+    }
+    cout << "PASSED" << endl;
+    return 0;
+}
@@ -0,0 +1,120 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Checkpoint and resume: fiberResume from the last checkpoint of a fiberTransmit
+ * must give its output bit for bit, with the same step counters, for the step
+ * updates, RK4IP, the precisions and a fiber with polarization coupling. Prints the
+ * time of fiberTransmit with and without checkpoints.
+ */
+
+#include <SimuLib>
+#include <chrono>
+#include <cstdio>
+
+using namespace SimuLib;
+
+const char *FILE_NAME = "CheckpointTest.ckpt";
+
+// Propagates INPUT with checkpoints, resumes from the last one and returns true if
+// the two outputs are the same
+bool compare(const string &name, const E &input, Fiber fiber) {
+    fiber.checkpointFile = FILE_NAME;
+    SsfmWorkspace workspace;
+    E e     = input;
+    Out out = fiberTransmit(e, fiber, workspace);
+
+    E resumed     = input;
+    Out resumeOut = fiberResume(resumed, fiber, workspace);
+    double error  = (resumed.field - e.field).norm();
+    bool isSame   = error == 0 && resumeOut.nCycle == out.nCycle && resumeOut.nFft == out.nFft && resumeOut.nIfft == out.nIfft &&
+                  resumeOut.nRejected == out.nRejected && resumeOut.localError == out.localError;
+    cout << name << ": " << out.nCycle << " steps, difference " << error << (isSame ? "" : ", counters differ") << endl;
+    return isSame;
+}
+
+int main() {
+    initGstate(4096, 64);
+
+    E scalar;
+    scalar.field = MatrixXcd::Random(4096, 1) * 3;
+    scalar.lambda.resize(1, 1);
+    scalar.lambda(0, 0) = 1550;
+
+    Fiber fiber;
+    fiber.length          = 100000;
+    fiber.attenuation     = 0.2;
+    fiber.nonlinearIndex  = 2.5e-20;
+    fiber.checkpointSteps = 4;
+
+    bool isPassed = compare("cle", scalar, fiber);
+
+    fiber.stepType = "symm";
+    isPassed       = compare("symmetric", scalar, fiber) && isPassed;
+
+    fiber.stepType   = "";
+    fiber.stepUpdate = "lem";
+    isPassed         = compare("lem", scalar, fiber) && isPassed;
+
+    fiber.stepUpdate = "cle";
+    fiber.stepType   = "rk4ip";
+    isPassed         = compare("rk4ip", scalar, fiber) && isPassed;
+
+    fiber.stepType   = "";
+    fiber.precision  = "single";
+    isPassed         = compare("single", scalar, fiber) && isPassed;
+
+    // Polarization coupling, checkpoints by distance: the waveplates come from the file
+    E dual;
+    dual.field               = MatrixXcd::Random(4096, 2) * 3;
+    dual.lambda              = scalar.lambda;
+    fiber                    = Fiber();
+    fiber.length             = 100000;
+    fiber.attenuation        = 0.2;
+    fiber.nonlinearIndex     = 2.5e-20;
+    fiber.isDual             = true;
+    fiber.isManakov          = true;
+    fiber.pmdParameter       = 0.5;
+    fiber.beatLength         = 23;
+    fiber.coupling           = "pol";
+    fiber.checkpointDistance = 7000;
+    isPassed                 = compare("PMD", dual, fiber) && isPassed;
+
+    // Cost of the checkpoints
+    const int RUNS = 5;
+    SsfmWorkspace workspace;
+    double times[2] = {INFINITY, INFINITY};
+    for (int isCheckpoint = 0; isCheckpoint < 2; ++isCheckpoint) {
+        fiber                 = Fiber();
+        fiber.length          = 100000;
+        fiber.attenuation     = 0.2;
+        fiber.nonlinearIndex  = 2.5e-20;
+        fiber.checkpointFile  = isCheckpoint ? FILE_NAME : "";
+        fiber.checkpointSteps = 1;
+        for (int i = 0; i < RUNS; ++i) {
+            E e                                    = scalar;
+            chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+            fiberTransmit(e, fiber, workspace);
+            times[isCheckpoint] = min(times[isCheckpoint], chrono::duration<double>(chrono::steady_clock::now() - begin).count());
+        }
+    }
+    cout << "without checkpoints: " << times[0] * 1e3 << " ms, with a checkpoint every step: " << times[1] * 1e3 << " ms" << endl;
+    remove(FILE_NAME);
+
+    if (!isPassed) {
+        cout << "FAILED" << endl;
+        return 1;
+    }
+    cout << "PASSED" << endl;
+    return 0;
+}
@@ -0,0 +1,110 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Digital backpropagation of a noiseless link with the field of files/field.txt:
+ * the error of the recovered input falls from dispersion compensation to DBP with
+ * more steps per span, and filtered DBP improves on DBP with one step per span.
+ * Prints the errors and the time of DBP over a launch power sweep.
+ */
+
+#include <SimuLib>
+#include <fstream>
+
+using namespace SimuLib;
+
+VectorXcd readField() {
+    ifstream infile;
+    infile.open("../files/field.txt");
+
+    VectorXcd vec(32768);
+    for (Index i = 0; i < vec.size(); ++i) {
+        infile >> vec[i];
+    }
+    infile.close();
+    return vec;
+}
+
+// Relative error of the input recovered from RECEIVED by DBP with OPTION
+double dbpError(const E &input, const E &received, const Link &link, const DbpOption &option, SsfmWorkspace &workspace, double &time) {
+    E e  = received;
+    time = digitalBackpropagation(e, link, option, workspace).time;
+    return (e.field - input.field).norm() / input.field.norm();
+}
+
+int main() {
+    initGstate(32768, 320);
+    E input;
+    input.field = readField() * 2;  // 4 mW
+    input.lambda.resize(1, 1);
+    input.lambda(0, 0) = 1550;
+
+    Fiber smf;
+    smf.length         = 80000;
+    smf.attenuation    = 0.2;
+    smf.nonlinearIndex = 2.5e-20;
+    smf.stepType       = "rk4ip";
+    smf.errorTolerance = 1e-8;
+
+    Link link;
+    link.fibers.push_back(smf);
+    link.spans.resize(3);
+    SsfmWorkspace workspace;
+    E received = input;
+    Out out    = linkTransmit(received, link, workspace);
+    cout << "Link: " << out.nCycle << " steps, " << out.time * 1e3 << " ms" << endl;
+
+    DbpOption cdc;
+    cdc.gammaFactor = 0;
+    double time;
+    double cdcError = dbpError(input, received, link, cdc, workspace, time);
+    cout << "Dispersion compensation: error " << cdcError << ", " << time * 1e3 << " ms" << endl;
+    bool isPassed    = true;
+    double lastError = cdcError;
+    for (unsigned steps: {1, 4, 32}) {
+        DbpOption dbp;
+        dbp.stepsPerSpan = steps;
+        double error     = dbpError(input, received, link, dbp, workspace, time);
+        cout << "DBP, steps per span: " << steps << ", error " << error << ", " << time * 1e3 << " ms" << endl;
+        isPassed  = isPassed && error < lastError / 2;
+        lastError = error;
+    }
+    isPassed = isPassed && lastError < 0.01;
+
+    DbpOption dbp;
+    double dbpError1     = dbpError(input, received, link, dbp, workspace, time);
+    dbp.filterBandwidth  = 40;
+    double filteredError = dbpError(input, received, link, dbp, workspace, time);
+    cout << "Filtered DBP, 1 step per span: error " << filteredError << ", " << time * 1e3 << " ms" << endl;
+    isPassed = isPassed && filteredError < dbpError1;
+
+    // Launch power sweep
+    dbp = DbpOption();
+    for (double power: {1, 4, 16}) {  // [mW]
+        E launched      = input;
+        launched.field *= sqrt(power / input.field.cwiseAbs2().mean());
+        E rx            = launched;
+        linkTransmit(rx, link, workspace);
+        double cdcSweep = dbpError(launched, rx, link, cdc, workspace, time);
+        double dbpSweep = dbpError(launched, rx, link, dbp, workspace, time);
+        cout << power << " mW: dispersion compensation error " << cdcSweep << ", DBP error " << dbpSweep << " in " << time * 1e3 << " ms" << endl;
+        isPassed = isPassed && dbpSweep < cdcSweep;
+    }
+
+    if (!isPassed) {
+        cout << "FAILED" << endl;
+        return 1;
+    }
+    cout << "PASSED" << endl;
+    return 0;
+}
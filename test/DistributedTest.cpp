@@ -0,0 +1,138 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Distributed field, run by mpirun -np P with P = 1, 2, 4 or 8: the four-step FFT of
+ * the slabs is the FFT of the whole field, the inverse gives the slabs back, and
+ * distributedTransmit is multimodeTransmit of one group of the polarizations. Prints
+ * the time of a step and of its transposes for 2^20 samples over the P ranks (strong
+ * scaling) and for 2^18 samples per rank (weak scaling).
+ */
+
+#include <SimuLib>
+#include <fstream>
+
+using namespace SimuLib;
+
+VectorXcd readField() {
+    ifstream infile;
+    infile.open("../files/field.txt");
+
+    VectorXcd vec(32768);
+    for (Index i = 0; i < vec.size(); ++i) {
+        infile >> vec[i];
+    }
+    infile.close();
+    return vec;
+}
+
+// Largest value of X over the ranks
+double maxOverRanks(double x) {
+    double result;
+    MPI_Allreduce(&x, &result, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    return result;
+}
+
+// Time [ms] of a step of distributedTransmit and of its transposes for LENGTH samples
+tuple<double, double> stepTime(const VectorXcd &input, Index length) {
+    const double LENGTH = 2000;
+    DistributedFft fft(length, 320);
+    Fiber fiber;
+    fiber.length         = LENGTH;
+    fiber.maxStepLength  = LENGTH / 4;
+    fiber.nonlinearIndex = 2.5e-20;
+    E e;
+    e.lambda.resize(1, 1);
+    e.lambda(0, 0) = 1550;
+    e.field.resize(fft.localLength(), 1);
+    for (Index i = 0; i < fft.localLength(); ++i)
+        e.field(i, 0) = input((fft.firstSample() + i) % input.size());
+    MPI_Barrier(MPI_COMM_WORLD);
+    Out out = distributedTransmit(e, fiber, fft);
+    return make_tuple(maxOverRanks(out.time) / out.nCycle * 1e3, maxOverRanks(fft.transposeTime) / out.nCycle * 1e3);
+}
+
+int main(int argc, char **argv) {
+    MPI_Init(&argc, &argv);
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    VectorXcd input = readField() * 4;
+
+    // FFT of a dual-polarization field of 2^16 samples
+    const Index N = 65536;
+    initGstate(N, 640);
+    MatrixXcd whole(N, 2);
+    whole.col(0) = input.replicate(2, 1);
+    whole.col(1) = input.reverse().replicate(2, 1) * complex<double>(0, 0.5);
+    MatrixXcd reference = fftCol(whole);
+
+    DistributedFft fft(N, 640);
+    MatrixXcd slab = whole.middleRows(fft.firstSample(), fft.localLength());
+    MatrixXcd spectrum, back;
+    fft.forward(slab, spectrum);
+    fft.inverse(spectrum, back);
+    double fftError = 0, frequencyError = 0;
+    for (Index i = 0; i < fft.localLength(); ++i) {
+        Index k = (Index) round(fft.frequencies()(i) / 640 * N + N) % N;  // frequency index, FFT order
+        fftError       = max(fftError, (spectrum.row(i) - reference.row(k)).norm() / reference.norm());
+        frequencyError = max(frequencyError, abs(fft.frequencies()(i) - gstate.FN(k)));
+    }
+    fftError              = maxOverRanks(fftError);
+    frequencyError        = maxOverRanks(frequencyError);
+    double roundTripError = maxOverRanks((back - slab).norm() / slab.norm());
+    bool isPassed         = fftError < 1e-14 && roundTripError < 1e-14 && frequencyError < 1e-9;
+
+    // SSFM of the slabs against multimodeTransmit of the whole field
+    Fiber fiber;
+    fiber.length         = 20000;
+    fiber.attenuation    = 0.2;
+    fiber.nonlinearIndex = 2.5e-20;
+    fiber.maxStepLength  = 100;
+    fiber.isDual         = true;
+    fiber.isManakov      = true;
+    E e;
+    e.lambda.resize(1, 1);
+    e.lambda(0, 0) = 1550;
+    e.field        = slab;
+    Out out        = distributedTransmit(e, fiber, fft);
+
+    MultimodeFiber fmf;
+    fmf.length         = fiber.length;
+    fmf.attenuation    = fiber.attenuation;
+    fmf.nonlinearIndex = fiber.nonlinearIndex;
+    fmf.maxStepLength  = fiber.maxStepLength;
+    E full;
+    full.lambda = e.lambda;
+    full.field  = whole;
+    SsfmWorkspace workspace;
+    multimodeTransmit(full, fmf, workspace);
+    double ssfmError = maxOverRanks((e.field - full.field.middleRows(fft.firstSample(), fft.localLength())).norm() / full.field.norm());
+    isPassed         = isPassed && ssfmError < 1e-12 && out.nCycle == 200;
+    if (rank == 0)
+        cout << size << " ranks: FFT error " << fftError << ", round trip " << roundTripError << ", SSFM error " << ssfmError << endl;
+
+    // Strong and weak scaling
+    double time, transposeTime;
+    tie(time, transposeTime) = stepTime(input, 1 << 20);
+    if (rank == 0)
+        cout << "2^20 samples: " << time << " ms per step, " << transposeTime << " ms in transposes" << endl;
+    tie(time, transposeTime) = stepTime(input, (Index) size << 18);
+    if (rank == 0)
+        cout << "2^18 samples per rank: " << time << " ms per step, " << transposeTime << " ms in transposes" << endl;
+
+    if (rank == 0)
+        cout << (isPassed ? "PASSED" : "FAILED") << endl;
+    MPI_Finalize();
+    return isPassed ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * FFT backends: checks the transforms of every backend built in against kissfft, in
+ * double and single precision, for lengths of odd and even powers of 2 and a length
+ * the bundled Stockham backend leaves to kissfft, transforms while another thread
+ * switches the backend, then ranks the backends for gstate.NSAMP.
+ */
+
+#include <SimuLib>
+#include <atomic>
+#include <thread>
+
+using namespace SimuLib;
+
+// Relative difference of the transforms of the selected backend from those of kissfft
+double difference(const string &backend, Index length, Index batch) {
+    MatrixXcd in = MatrixXcd::Random(length, batch);
+    MatrixXcd reference, spectrum, out;
+    setFFTBackend("kissfft");
+    fftCol(in, reference);
+    setFFTBackend(backend);
+    fftCol(in, spectrum);
+    ifftCol(spectrum, out);
+    return max((spectrum - reference).norm() / reference.norm(), (out - in).norm() / in.norm());
+}
+
+double singleDifference(const string &backend, Index length, Index batch) {
+    MatrixXcf in = MatrixXcf::Random(length, batch);
+    MatrixXcf reference, spectrum, out;
+    setFFTBackend("kissfft");
+    fftCol(in, reference);
+    setFFTBackend(backend);
+    fftCol(in, spectrum);
+    ifftCol(spectrum, out);
+    return max((spectrum - reference).norm() / reference.norm(), (out - in).norm() / in.norm());
+}
+
+int main() {
+    initGstate(32768, 320);
+    string initial = fftBackend();
+    bool isPassed  = true;
+
+    const vector<Index> LENGTHS = {2, 8, 1024, 2048, 4324, 32768};
+    for (const string &backend: fftBackends()) {
+        double worst = 0, singleWorst = 0;
+        for (Index length: LENGTHS) {
+            for (Index batch: {1, 3}) {
+                worst       = max(worst, difference(backend, length, batch));
+                singleWorst = max(singleWorst, singleDifference(backend, length, batch));
+            }
+        }
+        cout << backend << ": difference " << worst << " (double), " << singleWorst << " (single)" << endl;
+        isPassed = worst < 1e-12 && singleWorst < 1e-5 && isPassed;
+    }
+
+    setFFTBackend("stockham");
+    isPassed = fftBackend() == "stockham" && fftCacheStats().plans == 0 && isPassed;
+    warmFFTCache(gstate.NSAMP);
+    isPassed = fftCacheStats().plans == 2 && isPassed;
+    try {
+        setFFTBackend("none");
+        isPassed = false;
+    } catch (const runtime_error &) {
+        isPassed = fftBackend() == "stockham" && isPassed;  // the selection is kept
+    }
+
+    // The plans of the transforms in flight outlive the cache cleared by the switches
+    MatrixXcd in       = MatrixXcd::Random(gstate.NSAMP, 2);
+    MatrixXcd expected = fftCol(in);
+    atomic<bool> isTransforming(true);
+    double switchError = 0;
+    thread transforms([&]() {
+        MatrixXcd spectrum;
+        for (int k = 0; k < 200; ++k) {
+            fftCol(in, spectrum);
+            switchError = max(switchError, (spectrum - expected).norm() / expected.norm());
+        }
+        isTransforming = false;
+    });
+    for (int k = 0; isTransforming; ++k)
+        setFFTBackend(k % 2 == 0 ? "kissfft" : "stockham");
+    transforms.join();
+    cout << "Transforms during the switches: difference " << switchError << endl;
+    isPassed = switchError < 1e-12 && isPassed;
+    setFFTBackend(initial);
+
+    cout << "Ranking for " << gstate.NSAMP << " samples, 2 columns:" << endl;
+    for (const auto &backend: rankFFTBackends(gstate.NSAMP, 2))
+        cout << "  " << backend.first << "\t" << backend.second * 1e3 << " ms" << endl;
+
+    if (!isPassed) {
+        cout << "FAILED" << endl;
+        return 1;
+    }
+    cout << "PASSED" << endl;
+    return 0;
+}
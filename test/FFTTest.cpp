@@ -17,6 +17,7 @@
  */
 
 #include <SimuLib>
+#include <chrono>
 
 using namespace SimuLib;
 
@@ -37,6 +38,9 @@ int main() {
     long long duration_ms = chrono::duration_cast<chrono::milliseconds>(end - begin).count();
     double time           = (double) duration_ms / 1000;
     cout << "FFT运行时间: " << time << "s" << endl;
+
+    FFTCacheStats stats = fftCacheStats();
+    cout << "FFT plan cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.plans << " plans" << endl;
     //    std::cout << v << std::endl;
 
     //    cout << v << endl;
@@ -27,7 +27,7 @@ VectorXcd readField() {
 
     // Open file in read mode
     ifstream infile;
-    infile.open("../field.txt");
+    infile.open("../files/field.txt");
 
     VectorXcd vec(32768);
     for (Index i = 0; i < vec.size(); ++i) {
@@ -56,6 +56,7 @@ int main() {
     Out out     = {};
     tie(out, e) = fiberTransmit(e, fiber);
     cout << e.field << endl;
+    cout << "SSFM steps: " << out.nCycle << ", FFTs: " << out.nFft << ", IFFTs: " << out.nIfft << endl;
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+
+/**
+ * GN model against the SSFM: a WDM signal of Gaussian noise with a spectral hole at
+ * the center channel goes through linkTransmit, and the power spectral density of
+ * the nonlinear interference in the hole matches gnModel over one and two spans,
+ * with one and two polarizations. Prints the time of gnModel for a larger comb.
+ */
+
+#include <SimuLib>
+#include <random>
+
+using namespace SimuLib;
+
+const double SPACING   = 50;  // channel spacing [GHz]
+const double BANDWIDTH = 32;  // channel bandwidth [GHz]
+const Index NCH        = 5;   // channels, the center one empty
+const double POWER     = 2;   // channel power [mW]
+
+// NREALIZATIONS blocks of NPOL columns of a WDM signal of Gaussian noise with flat
+// channel spectra and an empty center channel
+E gaussianSignal(int npol, int nrealizations, mt19937 &generator) {
+    Index nsamp = gstate.NSAMP;
+    normal_distribution<double> noise(0, 1);
+    MatrixXcd spectrum = MatrixXcd::Zero(nsamp, npol * nrealizations);
+    for (Index i = 0; i < nsamp; ++i) {
+        double f = gstate.FN(i);
+        for (Index k = 0; k < NCH; ++k)
+            if (k != NCH / 2 && abs(f - (k - NCH / 2) * SPACING) < BANDWIDTH / 2)
+                for (Index j = 0; j < spectrum.cols(); ++j)
+                    spectrum(i, j) = complex<double>(noise(generator), noise(generator));
+    }
+    E e;
+    e.field = ifftCol(spectrum);
+    for (int r = 0; r < nrealizations; ++r)  // POWER per channel in each realization
+        e.field.middleCols(r * npol, npol) *= sqrt((NCH - 1) * POWER * nsamp / e.field.middleCols(r * npol, npol).squaredNorm());
+    e.lambda.resize(1, 1);
+    e.lambda(0, 0) = 1550;
+    return e;
+}
+
+// Power spectral density [mW/GHz] of the field of E within 8 GHz of the center
+double holePsd(const E &e) {
+    MatrixXcd spectrum = fftCol(e.field);
+    double total       = spectrum.squaredNorm();
+    double hole        = 0;
+    Index nbins        = 0;
+    for (Index i = 0; i < spectrum.rows(); ++i)
+        if (abs(gstate.FN(i)) < 8) {
+            hole += spectrum.row(i).squaredNorm();
+            nbins++;
+        }
+    double power = e.field.squaredNorm() / e.field.rows() * e.lambda.size();  // of all realizations
+    return hole / total * power / (nbins * gstate.SAMP_FREQ / gstate.NSAMP);
+}
+
+int main() {
+    initGstate(8192, 512);
+    mt19937 generator(1);
+
+    Fiber smf;
+    smf.length         = 80000;
+    smf.attenuation    = 0.2;
+    smf.nonlinearIndex = 2.5e-20;
+    smf.stepType       = "symm";
+
+    GnSignal signal;
+    signal.frequency.resize(NCH);
+    signal.bandwidth = RowVectorXd::Constant(NCH, BANDWIDTH);
+    signal.power     = RowVectorXd::Constant(NCH, POWER);
+    for (Index k = 0; k < NCH; ++k)
+        signal.frequency(k) = (k - NCH / 2) * SPACING;
+    signal.power(NCH / 2) = 0;
+
+    bool isPassed = true;
+    SsfmWorkspace workspace;
+    for (int npol: {1, 2}) {
+        Fiber fiber     = smf;
+        fiber.isDual    = npol == 2;
+        fiber.isManakov = fiber.isDual;
+        for (size_t nspans: {1, 2}) {
+            Link link;
+            link.fibers.push_back(fiber);
+            link.spans.resize(nspans);
+
+            E e = gaussianSignal(npol, 32 / npol, generator);
+            linkTransmit(e, link, workspace);
+            double measured = holePsd(e) / (32 / npol);
+            GnOut out       = gnModel(link, signal);
+            double error    = out.nliPsd(NCH / 2) / measured - 1;
+            cout << npol << " polarization(s), " << nspans << " span(s): NLI PSD " << measured << " mW/GHz by linkTransmit, " << out.nliPsd(NCH / 2)
+                 << " mW/GHz by gnModel in " << out.time * 1e3 << " ms, error " << error * 100 << "%" << endl;
+            isPassed = isPassed && abs(error) < 0.15;
+        }
+    }
+
+    // C-band comb: 64 channels over 20 spans
+    const Index NCOMB = 64;
+    GnSignal comb;
+    comb.frequency = RowVectorXd::LinSpaced(NCOMB, -(NCOMB - 1) * SPACING / 2, (NCOMB - 1) * SPACING / 2);
+    comb.bandwidth = RowVectorXd::Constant(NCOMB, BANDWIDTH);
+    comb.power     = RowVectorXd::Constant(NCOMB, 1);
+    Link link;
+    link.fibers.push_back(smf);
+    link.fibers[0].isDual = link.fibers[0].isManakov = true;
+    link.spans.resize(20);
+    for (Span &span: link.spans)
+        span.isAse = true;
+    GnOut out = gnModel(link, comb);
+    cout << NCOMB << " channels, " << link.spans.size() << " spans: gnModel in " << out.time * 1e3 << " ms, center channel SNR "
+         << 10 * log10(out.snr(NCOMB / 2)) << " dB, edge channel SNR " << 10 * log10(out.snr(0)) << " dB" << endl;
+    isPassed = isPassed && out.nliPsd.minCoeff() > 0 && out.snr(NCOMB / 2) < out.snr(0);
+
+    if (!isPassed) {
+        cout << "FAILED" << endl;
+        return 1;
+    }
+    cout << "PASSED" << endl;
+    return 0;
+}
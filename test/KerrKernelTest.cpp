@@ -0,0 +1,110 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Accuracy and speed of the fused Kerr kernel against the Eigen expression path
+ * (cwiseAbs2, fastExp, cwiseProduct and the maxCoeff of the step-size rule), for a
+ * single polarization and for the Manakov dual-polarization version, and of the
+ * single- and mixed-precision versions.
+ */
+
+#include <SimuLib>
+#include <chrono>
+
+using namespace SimuLib;
+
+int main() {
+    const Index n        = 1 << 16;
+    const int rounds     = 500;
+    const double gamleff = 0.3;  // up to a few rad of nonlinear phase
+    const double gain    = 0.99;
+
+    VectorXcd field = VectorXcd::Random(n) * 3;
+
+    // Accuracy
+    VectorXcd reference = field;
+    VectorXd phi        = reference.cwiseAbs2() * gamleff;
+    reference           = reference.cwiseProduct(fastExp(-phi)) * gain;
+    double refPeak      = reference.cwiseAbs2().maxCoeff();
+
+    VectorXcd fused = field;
+    double peak     = kerrKernel(fused.data(), n, gamleff, gain);
+    double error    = (fused - reference).norm() / reference.norm();
+    cout << "Kernel: " << kerrKernelIsa() << endl;
+    cout << "Relative error: " << error << ", peak power error: " << abs(peak - refPeak) / refPeak << endl;
+
+    // Speed
+    VectorXcd u                            = field;
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    double sink                            = 0;
+    for (int i = 0; i < rounds; ++i) {
+        phi = u.cwiseAbs2() * gamleff;
+        u   = u.cwiseProduct(fastExp(-phi));
+        sink += u.cwiseAbs2().maxCoeff();
+    }
+    chrono::steady_clock::time_point middle = chrono::steady_clock::now();
+    u                                       = field;
+    for (int i = 0; i < rounds; ++i) {
+        sink += kerrKernel(u.data(), n, gamleff, 1);
+    }
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+    double eigenTime = chrono::duration<double>(middle - begin).count();
+    double fusedTime = chrono::duration<double>(end - middle).count();
+    cout << "Eigen expressions: " << eigenTime / rounds * 1e3 << " ms per step" << endl;
+    cout << "Fused kernel: " << fusedTime / rounds * 1e3 << " ms per step (" << eigenTime / fusedTime << "x)" << endl;
+
+    // Manakov: both polarizations rotated by the phase of |ux|^2 + |uy|^2
+    MatrixXcd pol          = MatrixXcd::Random(n, 2) * 2;
+    MatrixXcd polReference = pol;
+    phi                    = polReference.rowwise().squaredNorm() * gamleff;
+    VectorXcd expiphi      = fastExp(-phi) * gain;
+    polReference.col(0)    = polReference.col(0).cwiseProduct(expiphi);
+    polReference.col(1)    = polReference.col(1).cwiseProduct(expiphi);
+    double polRefPeak      = polReference.rowwise().squaredNorm().maxCoeff();
+
+    double polPeak  = kerrKernel(pol.col(0).data(), pol.col(1).data(), n, gamleff, gain);
+    double polError = (pol - polReference).norm() / polReference.norm();
+    cout << "Dual polarization relative error: " << polError << ", peak power error: " << abs(polPeak - polRefPeak) / polRefPeak << endl;
+
+    begin = chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        sink += kerrKernel(pol.col(0).data(), pol.col(1).data(), n, gamleff, 1);
+    }
+    end             = chrono::steady_clock::now();
+    double dualTime = chrono::duration<double>(end - begin).count();
+    cout << "Fused dual-polarization kernel: " << dualTime / rounds * 1e3 << " ms per step (" << dualTime / fusedTime
+         << "x the single polarization)" << endl;
+
+    // Single-precision samples: mixed (double arithmetic) and single precision
+    double singleError[2], singleTime[2];
+    for (int mixed = 0; mixed < 2; ++mixed) {
+        VectorXcf single = field.cast<complex<float>>();
+        kerrKernel(single.data(), n, gamleff, gain, mixed);
+        singleError[mixed] = (single.cast<complex<double>>() - reference).norm() / reference.norm();
+
+        single = field.cast<complex<float>>();
+        begin  = chrono::steady_clock::now();
+        for (int i = 0; i < rounds; ++i) {
+            sink += kerrKernel(single.data(), n, gamleff, 1, mixed);
+        }
+        singleTime[mixed] = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    }
+    cout << "Single precision: relative error " << singleError[0] << ", " << singleTime[0] / rounds * 1e3 << " ms per step ("
+         << fusedTime / singleTime[0] << "x the double kernel)" << endl;
+    cout << "Mixed precision: relative error " << singleError[1] << ", " << singleTime[1] / rounds * 1e3 << " ms per step ("
+         << fusedTime / singleTime[1] << "x the double kernel)" << endl;
+    cout << (sink > 0 ? "" : " ") << endl;
+
+    return error < 1e-13 && polError < 1e-13 && singleError[0] < 1e-5 && singleError[1] < 1e-5 ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * A multi-span link by linkTransmit against the loop of fiberTransmit calls with
+ * the amplifier gain applied by hand, with as many dispersion operator lookups, and
+ * the ASE noise power of the amplifiers and its draws for a seed.
+ */
+
+#include <SimuLib>
+#include <chrono>
+
+using namespace SimuLib;
+
+int main() {
+    const int nspan = 20;
+    initGstate(4096, 320);
+
+    E input;
+    input.field = VectorXcd::Random(4096);
+    input.lambda.resize(1, 1);
+    input.lambda(0, 0) = 1550;
+
+    Fiber smf;
+    smf.length         = 80000;
+    smf.attenuation    = 0.2;
+    smf.nonlinearIndex = 2.5e-20;
+    smf.stepGrid       = 100;
+
+    Link link;
+    link.fibers.push_back(smf);
+    link.spans.resize(nspan);  // fiber 0, gain recovering the span loss, no ASE
+
+    E loop                                 = input;
+    unsigned long lookups                  = 0;  // dispersion operators asked for by the loop
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    for (int i = 0; i < nspan; ++i) {
+        Out spanOut = get<0>(fiberTransmit(loop, smf));
+        lookups += spanOut.nDispersionHits + spanOut.nDispersionMisses;
+        loop.field *= sqrt(pow(10, smf.attenuation * smf.length * 1e-3 / 10));
+    }
+    chrono::steady_clock::time_point middle = chrono::steady_clock::now();
+    E linked                                = input;
+    SsfmWorkspace workspace;
+    Out out                              = linkTransmit(linked, link, workspace);
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+    double error    = (linked.field - loop.field).norm() / loop.field.norm();
+    double loopTime = chrono::duration<double>(middle - begin).count();
+    double linkTime = chrono::duration<double>(end - middle).count();
+    cout << nspan << " spans, " << out.nCycle << " steps, relative error: " << error << endl;
+    cout << "fiberTransmit loop: " << loopTime << " s, linkTransmit: " << linkTime << " s, first span: " << out.spanTime[0] << " s" << endl;
+
+    // ASE of one amplifier on a zero field: power n0 * SAMP_FREQ [mW]
+    E dark              = input;
+    dark.field          = VectorXcd::Zero(4096);
+    link.spans          = {Span()};
+    link.spans[0].isAse = true;
+    linkTransmit(dark, link, workspace);
+    double gain   = pow(10, smf.attenuation * smf.length * 1e-3 / 10);
+    double freq   = LIGHT_SPEED / 1550 * 1e9;
+    double n0     = (gain - 1) * pow(10, link.spans[0].noiseFigure / 10) / 2 * PLANK_CONST * freq * 1e12;
+    double power  = dark.field.cwiseAbs2().mean();
+    double aseErr = abs(power / (n0 * gstate.SAMP_FREQ) - 1);
+    cout << "ASE power: " << power << " mW, expected " << n0 * gstate.SAMP_FREQ << " mW" << endl;
+
+    // The ASE noise of a seed: the normal draws of mt19937, real then imaginary part of each sample
+    link.seed  = 7;
+    dark.field = VectorXcd::Zero(4096);
+    linkTransmit(dark, link, workspace);
+    mt19937 generator(link.seed);
+    normal_distribution<double> noise(0, sqrt(n0 * gstate.SAMP_FREQ / 2));
+    VectorXcd expected(4096);
+    for (Index i = 0; i < expected.size(); ++i) {
+        double re   = noise(generator);
+        double im   = noise(generator);
+        expected[i] = complex<double>(re, im);
+    }
+    double seedErr = (dark.field - expected).norm() / expected.norm();
+    cout << "ASE noise of seed " << link.seed << ", relative error: " << seedErr << endl;
+
+    if (error > 1e-12 || out.spanTime.size() != nspan || out.nDispersionHits + out.nDispersionMisses != lookups || aseErr > 0.1 ||
+        seedErr > 1e-9) {
+        cout << "FAILED" << endl;
+        return 1;
+    }
+    cout << "PASSED" << endl;
+    return 0;
+}
@@ -0,0 +1,77 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Steps and accuracy of the local error method ("lem" step update) against
+ * fixed symmetric steps halved down to its accuracy, both compared with a finely
+ * resolved reference. The error estimate of the local error method must bound its
+ * error.
+ */
+
+#include <SimuLib>
+
+using namespace SimuLib;
+
+Fiber testFiber() {
+    Fiber fiber;
+    fiber.length         = 80000;
+    fiber.attenuation    = 0.2;
+    fiber.nonlinearIndex = 2.5e-20;
+    return fiber;
+}
+
+int main() {
+    initGstate(2048, 320);
+
+    E input;
+    input.field = VectorXcd::Random(2048);
+    input.field *= sqrt(10 / input.field.cwiseAbs2().mean());  // 10 mW
+    input.lambda.resize(1, 1);
+    input.lambda(0, 0) = 1550;
+
+    E reference          = input;
+    Fiber fiber          = testFiber();
+    fiber.stepUpdate     = "lem";
+    fiber.errorTolerance = 1e-9;
+    fiberTransmit(reference, fiber);
+
+    E lem                = input;
+    fiber.errorTolerance = 1e-5;
+    Out lemOut           = get<0>(fiberTransmit(lem, fiber));
+    double lemError      = (lem.field - reference.field).norm() / reference.field.norm();
+
+    cout << "Local error method: " << lemOut.nCycle << " steps (" << lemOut.nRejected << " rejected), " << lemOut.nFft + lemOut.nIfft
+         << " FFTs, error " << lemError << ", estimated " << lemOut.localError << endl;
+
+    Out fixedOut;
+    double fixedError;
+    for (double step = 160; step >= 1.25; step /= 2) {
+        E fixed             = input;
+        fiber               = testFiber();
+        fiber.stepUpdate    = "nlp";
+        fiber.stepType      = "symm";
+        fiber.maxStepLength = step;
+        fixedOut            = get<0>(fiberTransmit(fixed, fiber));
+        fixedError          = (fixed.field - reference.field).norm() / reference.field.norm();
+        cout << "Fixed symmetric steps of " << step << " m: " << fixedOut.nCycle << " steps, " << fixedOut.nFft + fixedOut.nIfft << " FFTs, error "
+             << fixedError << endl;
+        if (fixedError <= lemError)
+            break;
+    }
+    if (lemError > lemOut.localError || fixedError > lemError || lemOut.nCycle * 3 > fixedOut.nCycle) {
+        cout << "FAILED" << endl;
+        return 1;
+    }
+    cout << "PASSED" << endl;
+    return 0;
+}
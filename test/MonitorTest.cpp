@@ -0,0 +1,119 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Field monitors: the records come at the asked positions, in order, with the energy
+ * decaying as the fiber loss, spectra where asked and the output power profile at the
+ * fiber end; fiber.onMonitor sees every record. Prints the cost of coarse monitors on
+ * the field of files/field.txt.
+ */
+
+#include <SimuLib>
+#include <chrono>
+#include <fstream>
+
+using namespace SimuLib;
+
+VectorXcd readField() {
+    ifstream infile;
+    infile.open("../files/field.txt");
+
+    VectorXcd vec(32768);
+    for (Index i = 0; i < vec.size(); ++i) {
+        infile >> vec[i];
+    }
+    infile.close();
+    return vec;
+}
+
+// Best times [s] of a few fiberTransmit calls through FIBER and OTHER, alternated so
+// that both see the same load of the machine
+tuple<double, double> compareTimes(const E &input, const Fiber &fiber, const Fiber &other) {
+    const int RUNS = 9;
+    SsfmWorkspace workspace;
+    double best[2] = {INFINITY, INFINITY};
+    for (int i = 0; i < 2 * RUNS; ++i) {
+        E e                                    = input;
+        chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+        fiberTransmit(e, i % 2 ? other : fiber, workspace);
+        best[i % 2] = min(best[i % 2], chrono::duration<double>(chrono::steady_clock::now() - begin).count());
+    }
+    return make_tuple(best[0], best[1]);
+}
+
+int main() {
+    initGstate(32768, 320);
+    E input;
+    input.field = readField() * 4;
+    input.lambda.resize(1, 1);
+    input.lambda(0, 0) = 1550;
+
+    Fiber fiber;
+    fiber.length             = 100000;
+    fiber.attenuation        = 0.2;
+    fiber.nonlinearIndex     = 2.5e-20;
+    fiber.monitorPositions   = {30000, 0, 75000};
+    fiber.monitorSpacing     = 20000;
+    fiber.spectrumPositions  = {50000};
+    unsigned long nCallbacks = 0;
+    fiber.onMonitor          = [&nCallbacks](const MonitorRecord &) { nCallbacks++; };
+
+    E e = input;
+    SsfmWorkspace workspace;
+    Out out                              = fiberTransmit(e, fiber, workspace);
+    const vector<MonitorRecord> &records = out.monitor;
+
+    // 0, 20, 30, 40, 50, 60, 75, 80 and 100 km
+    bool isPassed      = records.size() == 9 && nCallbacks == records.size();
+    double alpha       = log(10) * 1e-4 * fiber.attenuation;  // [1/m]
+    double inputEnergy = input.field.squaredNorm() / gstate.SAMP_FREQ;
+    double energyError = 0;
+    int nSpectra       = 0;
+    for (size_t k = 0; k < records.size(); ++k) {
+        const MonitorRecord &record = records[k];
+        energyError                 = max(energyError, abs(record.energy(0) / inputEnergy / exp(-alpha * record.z) - 1));
+        if (k > 0)
+            isPassed = isPassed && record.z > records[k - 1].z;
+        if (record.spectrum.size() > 0) {
+            nSpectra++;
+            isPassed = isPassed && k > 0 && record.z >= 50000 && records[k - 1].z < 50000;
+        }
+        cout << "z " << record.z << " m, step " << record.step << ", peak power " << record.peakPower << " mW, energy " << record.energy(0) << " pJ"
+             << (record.spectrum.size() > 0 ? ", with spectrum" : "") << endl;
+    }
+    const MonitorRecord &last = records.back();
+    double profileError       = 0;
+    for (Index i = 0; i < last.power.rows(); ++i)
+        profileError = max(profileError, abs(last.power(i, 0) - norm(e.field(i * fiber.monitorDecimation, 0))));
+    cout << "energy error " << energyError << ", output profile error " << profileError << endl;
+    isPassed = isPassed && nSpectra == 1 && last.z == fiber.length && last.step == out.nCycle && energyError < 1e-9 && profileError < 1e-12;
+
+    // Cost of coarse monitors
+    Fiber plain             = fiber;
+    plain.monitorPositions  = {};
+    plain.monitorSpacing    = 0;
+    plain.spectrumPositions = {};
+    plain.onMonitor         = nullptr;
+    fiber.monitorSpacing    = 10000;
+    double plainTime, monitorTime;
+    tie(plainTime, monitorTime) = compareTimes(input, plain, fiber);
+    cout << "without monitors: " << plainTime * 1e3 << " ms, with a record every " << fiber.monitorSpacing << " m: " << monitorTime * 1e3 << " ms ("
+         << (monitorTime / plainTime - 1) * 100 << "%)" << endl;
+
+    if (!isPassed) {
+        cout << "FAILED" << endl;
+        return 1;
+    }
+    cout << "PASSED" << endl;
+    return 0;
+}
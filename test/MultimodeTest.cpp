@@ -0,0 +1,166 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Few-mode fiber: two modes of one group are the two polarizations of fiberTransmit
+ * with the Manakov equation; the coupling alone is the exponential of the coupling
+ * matrix; without loss the energy is kept; a mode with group delay is delayed by it;
+ * three modes with the Kerr effect need their Kerr coefficients.
+ * Prints the time of a step of 12 modes of 2^18 samples.
+ */
+
+#include <SimuLib>
+#include <fstream>
+
+using namespace SimuLib;
+
+VectorXcd readField() {
+    ifstream infile;
+    infile.open("../files/field.txt");
+
+    VectorXcd vec(32768);
+    for (Index i = 0; i < vec.size(); ++i) {
+        infile >> vec[i];
+    }
+    infile.close();
+    return vec;
+}
+
+// Exponential of the matrix A by scaling and squaring of its Taylor series
+MatrixXcd exponential(const MatrixXcd &a) {
+    const int SQUARINGS = 10;
+    MatrixXcd scaled    = a / pow(2., SQUARINGS);
+    MatrixXcd term      = MatrixXcd::Identity(a.rows(), a.cols());
+    MatrixXcd result    = term;
+    for (int k = 1; k <= 16; ++k) {
+        term = term * scaled / k;
+        result += term;
+    }
+    for (int k = 0; k < SQUARINGS; ++k)
+        result = result * result;
+    return result;
+}
+
+// Relative error of the field A against B
+double relativeError(const MatrixXcd &a, const MatrixXcd &b) {
+    return (a - b).norm() / b.norm();
+}
+
+int main() {
+    initGstate(32768, 320);
+    VectorXcd input = readField() * 4;
+    E e;
+    e.lambda.resize(1, 1);
+    e.lambda(0, 0) = 1550;
+
+    // Two polarizations of the Manakov equation
+    Fiber fiber;
+    fiber.length         = 20000;
+    fiber.attenuation    = 0.2;
+    fiber.nonlinearIndex = 2.5e-20;
+    fiber.isDual         = true;
+    fiber.isManakov      = true;
+    fiber.maxStepLength  = 10;  // steps as those of multimodeTransmit
+    E reference            = e;
+    reference.field        = MatrixXcd::Zero(32768, 2);
+    reference.field.col(0) = input;
+    reference.field.col(1) = input * complex<double>(0, 0.5);
+    e.field                = reference.field;
+    SsfmWorkspace workspace;
+    fiberTransmit(reference, fiber, workspace);
+
+    MultimodeFiber fmf;
+    fmf.length          = fiber.length;
+    fmf.attenuation     = fiber.attenuation;
+    fmf.nonlinearIndex  = fiber.nonlinearIndex;
+    fmf.maxStepLength   = fiber.maxStepLength;
+    Out out             = multimodeTransmit(e, fmf, workspace);
+    double manakovError = relativeError(e.field, reference.field);
+    cout << "Manakov: error " << manakovError << ", " << out.nCycle << " steps" << endl;
+    bool isPassed = manakovError < 2e-4 && out.nCycle == 2000;
+
+    // Coupling of three modes, without dispersion, loss or Kerr effect
+    MatrixXcd k(3, 3);
+    k << 1e-3, complex<double>(2e-3, 1e-3), 0, complex<double>(2e-3, -1e-3), -1e-3, 5e-4, 0, 5e-4, 0;
+    fmf.dispersion     = RowVectorXd::Zero(3);
+    fmf.attenuation    = 0;
+    fmf.nonlinearIndex = 0;
+    fmf.coupling       = k;
+    fmf.length         = 5000;
+    fmf.maxStepLength  = 1000;
+    e.field            = MatrixXcd::Zero(32768, 3);
+    e.field.col(0)     = input;
+    e.field.col(2)     = input * 0.3;
+    MatrixXcd expected = e.field * exponential(k * complex<double>(0, -fmf.length)).transpose();
+    double energy      = e.field.squaredNorm();
+    multimodeTransmit(e, fmf, workspace);
+    double couplingError = relativeError(e.field, expected);
+    double energyError   = abs(e.field.squaredNorm() / energy - 1);
+    cout << "coupling: error " << couplingError << ", energy error " << energyError << endl;
+    isPassed = isPassed && couplingError < 1e-10 && energyError < 1e-12;
+
+    // Group delay of the second mode
+    fmf.coupling      = MatrixXcd();
+    fmf.dispersion    = RowVectorXd::Zero(2);
+    fmf.groupDelay    = RowVectorXd::Zero(2);
+    fmf.groupDelay(1) = 100;  // [ps/km]: 1 ns after 10 km, 320 samples
+    fmf.length        = 10000;
+    e.field           = MatrixXcd::Zero(32768, 2);
+    e.field.col(0)    = input;
+    e.field.col(1)    = input;
+    multimodeTransmit(e, fmf, workspace);
+    VectorXcd delayed(32768);
+    delayed << input.tail(320), input.head(32768 - 320);
+    double delayError = relativeError(e.field.col(1), delayed) + relativeError(e.field.col(0), input);
+    cout << "group delay: error " << delayError << endl;
+    isPassed = isPassed && delayError < 1e-9;
+
+    // The Kerr coefficients of three modes have no default
+    fmf.dispersion     = RowVectorXd::Zero(3);
+    fmf.groupDelay     = RowVectorXd::Zero(3);
+    fmf.nonlinearIndex = 2.5e-20;
+    e.field            = MatrixXcd::Zero(32768, 3);
+    try {
+        multimodeTransmit(e, fmf, workspace);
+        isPassed = false;
+    } catch (const runtime_error &) {
+    }
+
+    // Twelve modes in four groups, 2^18 samples
+    const Index MODES = 12;
+    initGstate(262144, 320);
+    e.field = MatrixXcd::Zero(262144, MODES);
+    for (Index m = 0; m < MODES; ++m)
+        e.field.col(m) = input.replicate(8, 1) * polar(0.3, 0.5 * m);
+    fmf                  = MultimodeFiber();
+    fmf.length           = 1000;
+    fmf.nonlinearIndex   = 2.5e-20;
+    fmf.dispersion       = RowVectorXd::LinSpaced(MODES, 16, 22);
+    fmf.groupDelay       = RowVectorXd::LinSpaced(MODES, -50, 50);
+    fmf.modeGroups       = {0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3};
+    fmf.kerrCoefficients = MatrixXd::Constant(4, 4, 0.3) + MatrixXd::Identity(4, 4) * 0.4;
+    fmf.coupling         = MatrixXcd::Random(MODES, MODES) * 1e-3;
+    fmf.coupling         = (fmf.coupling + fmf.coupling.adjoint()).eval();
+    energy               = e.field.squaredNorm();
+    out                  = multimodeTransmit(e, fmf, workspace);
+    energyError          = abs(e.field.squaredNorm() / energy / exp(-log(10) * 1e-4 * fmf.attenuation * fmf.length) - 1);
+    cout << MODES << " modes, 2^18 samples: " << out.time / out.nCycle * 1e3 << " ms per step, energy error " << energyError << endl;
+    isPassed = isPassed && energyError < 1e-9;
+
+    if (!isPassed) {
+        cout << "FAILED" << endl;
+        return 1;
+    }
+    cout << "PASSED" << endl;
+    return 0;
+}
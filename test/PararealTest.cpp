@@ -0,0 +1,111 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Parareal propagation of a noiseless link with the field of files/field.txt: with a
+ * zero tolerance the iterations run until all the segments are fine and the output
+ * is the one of the sequential SSFM within its accuracy; with a tolerance they stop
+ * earlier on the same field. Prints the iterations, the estimated speed-up and the
+ * times against linkTransmit for coarse propagators with and without nonlinear steps,
+ * and checks a single-precision fine SSFM against the single-precision linkTransmit.
+ */
+
+#include <SimuLib>
+#include <fstream>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace SimuLib;
+
+VectorXcd readField() {
+    ifstream infile;
+    infile.open("../files/field.txt");
+
+    VectorXcd vec(32768);
+    for (Index i = 0; i < vec.size(); ++i) {
+        infile >> vec[i];
+    }
+    infile.close();
+    return vec;
+}
+
+// Relative error of the parareal output with OPTION against REFERENCE
+double pararealError(const E &input, const E &reference, const Link &link, const PararealOption &option, SsfmWorkspace &workspace, Out &out) {
+    E e = input;
+    out = linkParareal(e, link, option, workspace);
+    cout << "coarse steps " << option.coarseSteps << ", tolerance " << option.tolerance << ": " << out.nIterations << " iterations, " << out.nCycle
+         << " fine steps, " << out.time * 1e3 << " ms, estimated speed-up " << out.speedUp;
+    double error = (e.field - reference.field).norm() / reference.field.norm();
+    cout << ", error " << error << endl;
+    return error;
+}
+
+int main() {
+    initGstate(32768, 320);
+    E input;
+    input.field = readField() * 2;  // 4 mW
+    input.lambda.resize(1, 1);
+    input.lambda(0, 0) = 1550;
+
+    Fiber smf;
+    smf.length         = 80000;
+    smf.attenuation    = 0.2;
+    smf.nonlinearIndex = 2.5e-20;
+
+    Link link;
+    link.fibers.push_back(smf);
+    link.spans.resize(4);
+    SsfmWorkspace workspace;
+    E reference = input;
+    Out out     = linkTransmit(reference, link, workspace);
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+    cout << "Sequential SSFM: " << out.nCycle << " steps, " << out.time * 1e3 << " ms; " << threads << " threads" << endl;
+    double sequentialTime = out.time;
+
+    PararealOption option;
+    option.tolerance  = 0;
+    Out exact;
+    double exactError = pararealError(input, reference, link, option, workspace, exact);
+    bool isPassed     = exact.nIterations == link.spans.size() * option.segmentsPerSpan && exactError < 1e-3;
+
+    option.tolerance = 1e-6;
+    double error     = pararealError(input, reference, link, option, workspace, out);
+    cout << "measured speed-up " << sequentialTime / out.time << endl;
+    isPassed = isPassed && out.nIterations < exact.nIterations && error < 2 * exactError + 1e-5;
+
+    option.coarseSteps = 0;  // linear coarse propagator
+    error              = pararealError(input, reference, link, option, workspace, out);
+    cout << "measured speed-up " << sequentialTime / out.time << endl;
+    isPassed = isPassed && error < 2 * exactError + 1e-5;
+
+    // Single-precision fine SSFM against the single-precision sequential SSFM
+    link.fibers[0].precision = "single";
+    reference                = input;
+    linkTransmit(reference, link, workspace);
+    option.coarseSteps = 1;
+    option.tolerance   = 0;
+    error              = pararealError(input, reference, link, option, workspace, out);
+    isPassed           = isPassed && out.nIterations == exact.nIterations && error < 1e-3;
+
+    if (!isPassed) {
+        cout << "FAILED" << endl;
+        return 1;
+    }
+    cout << "PASSED" << endl;
+    return 0;
+}
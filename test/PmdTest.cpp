@@ -0,0 +1,109 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Dual-polarization propagation with the waveplate PMD model: a lossless fiber must
+ * conserve the power, the coupling must move power between the polarizations, and
+ * the time per step with 100 waveplates is printed. The DGD of a fiber of a single
+ * waveplate, whatever its random axes, must be the one of fiber.pmdParameter.
+ */
+
+#include <SimuLib>
+#include <chrono>
+
+using namespace SimuLib;
+
+typedef Eigen::Vector3d Vector3d;
+
+// Cross product A x B
+Vector3d cross(const Vector3d &a, const Vector3d &b) {
+    return Vector3d(a(1) * b(2) - a(2) * b(1), a(2) * b(0) - a(0) * b(2), a(0) * b(1) - a(1) * b(0));
+}
+
+// Normalized Stokes vector of the x/y spectra in row K of SPECTRUM
+Vector3d stokes(const MatrixXcd &spectrum, Index k) {
+    complex<double> x = spectrum(k, 0), y = spectrum(k, 1);
+    complex<double> xy = conj(x) * y;
+    Vector3d s(norm(x) - norm(y), 2 * xy.real(), 2 * xy.imag());
+    return s / s.norm();
+}
+
+// DGD [ps] of a birefringent fiber from its output SPECTRUM for an x impulse: the
+// Stokes vector turns about the fiber axes by DGD * domega. The axes are the normal
+// of the circle through the Stokes vectors at the rows A, A + M and A + 2M.
+double birefringentDgd(const MatrixXcd &spectrum, Index a, Index m) {
+    Vector3d s0 = stokes(spectrum, a), s1 = stokes(spectrum, a + m), s2 = stokes(spectrum, a + 2 * m);
+    Vector3d axis = cross(s1 - s0, s2 - s1).normalized();
+    Vector3d u    = s0 - s0.dot(axis) * axis;  // projections on the plane of the circle
+    Vector3d v    = s1 - s1.dot(axis) * axis;
+    double angle  = atan2(cross(u, v).norm(), u.dot(v));
+    double domega = 2 * M_PI * (gstate.FN(a + m) - gstate.FN(a));  // [rad/ns]
+    return angle / domega * 1e3;
+}
+
+int main() {
+    initGstate(1 << 14, 320);
+
+    E e;
+    e.field        = MatrixXcd::Zero(1 << 14, 2);
+    e.field.col(0) = VectorXcd::Random(1 << 14);  // x polarization only
+    e.lambda.resize(1, 1);
+    e.lambda(0, 0) = 1550;
+    double power   = e.field.squaredNorm();
+
+    Fiber fiber;
+    fiber.length         = 10000;
+    fiber.attenuation    = 0;
+    fiber.nonlinearIndex = 2.5e-20;
+    fiber.isDual         = true;
+    fiber.isManakov      = true;
+    fiber.pmdParameter   = 0.5;
+    fiber.coupling       = "pol";
+    fiber.nWavePlates    = 100;
+    fiber.maxStepLength  = 1000;
+
+    SsfmWorkspace workspace;
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    Out out                                = fiberTransmit(e, fiber, workspace);
+    chrono::steady_clock::time_point end   = chrono::steady_clock::now();
+
+    double powerError = abs(e.field.squaredNorm() - power) / power;
+    double coupled    = e.field.col(1).squaredNorm() / e.field.squaredNorm();
+    double time       = chrono::duration<double>(end - begin).count();
+    cout << out.nCycle << " steps, " << time / out.nCycle * 1e3 << " ms per step" << endl;
+    cout << "Power error: " << powerError << ", power coupled to y: " << coupled << endl;
+
+    // One waveplate: DGD = pmdParameter * sqrt(length) * sqrt(3 * pi / 8), the DGD of a
+    // waveplate for the mean DGD of many to be pmdParameter * sqrt(length)
+    E impulse;
+    impulse.field        = MatrixXcd::Zero(1 << 14, 2);
+    impulse.field(0, 0)  = 1;
+    impulse.lambda       = e.lambda;
+    Fiber plate          = fiber;
+    plate.nonlinearIndex = 0;
+    plate.nWavePlates    = 1;
+    fiberTransmit(impulse, plate, workspace);
+    double expected = plate.pmdParameter * sqrt(plate.length * 1e-3) * sqrt(3 * M_PI / 8);  // [ps]
+    double df       = gstate.FN(1) - gstate.FN(0);                                        // [GHz]
+    Index m         = (Index) round(0.5 / (expected * 1e-3 * 2 * M_PI * df));             // half a radian apart
+    double dgd      = birefringentDgd(fftCol(impulse.field), 1, m);
+    double dgdError = abs(dgd - expected) / expected;
+    cout << "DGD of one waveplate: " << dgd << " ps, expected " << expected << " ps" << endl;
+
+    if (powerError > 1e-12 || coupled < 1e-3 || dgdError > 1e-6) {
+        cout << "FAILED" << endl;
+        return 1;
+    }
+    cout << "PASSED" << endl;
+    return 0;
+}
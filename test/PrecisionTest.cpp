@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Accuracy against speed of the single- and mixed-precision SSFM: the field of
+ * files/field.txt through a nonlinear fiber, compared with the double-precision run.
+ */
+
+#include <SimuLib>
+#include <chrono>
+#include <fstream>
+
+using namespace SimuLib;
+
+VectorXcd readField() {
+    ifstream infile;
+    infile.open("../files/field.txt");
+
+    VectorXcd vec(32768);
+    for (Index i = 0; i < vec.size(); ++i) {
+        infile >> vec[i];
+    }
+    infile.close();
+    return vec;
+}
+
+// Propagates the field with the given precision and returns the output and the
+// best time [s] of a few runs
+tuple<MatrixXcd, double> propagate(const VectorXcd &input, Fiber fiber, const string &precision) {
+    const int RUNS  = 5;
+    fiber.precision = precision;
+    SsfmWorkspace workspace;
+    E e;
+    double best = INFINITY;
+    for (int i = 0; i < RUNS; ++i) {
+        e.field = input;
+        e.lambda.resize(1, 1);
+        e.lambda(0, 0)                         = 1550;
+        chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+        fiberTransmit(e, fiber, workspace);
+        best = min(best, chrono::duration<double>(chrono::steady_clock::now() - begin).count());
+    }
+    return make_tuple(e.field, best);
+}
+
+int main() {
+    initGstate(32768, 320);
+    VectorXcd input = readField() * 4;  // a few mW of peak power
+
+    Fiber fiber;
+    fiber.length         = 100000;
+    fiber.attenuation    = 0.2;
+    fiber.nonlinearIndex = 2.5e-20;
+
+    MatrixXcd reference;
+    double referenceTime;
+    tie(reference, referenceTime) = propagate(input, fiber, "double");
+    cout << "double: " << referenceTime * 1e3 << " ms" << endl;
+
+    bool isPassed = true;
+    for (const char *precision: {"single", "mixed"}) {
+        MatrixXcd output;
+        double time;
+        tie(output, time) = propagate(input, fiber, precision);
+        double error      = (output - reference).norm() / reference.norm();
+        cout << precision << ": " << time * 1e3 << " ms (" << referenceTime / time << "x), relative error " << error << endl;
+        isPassed = isPassed && error < 1e-5;
+    }
+
+    if (!isPassed) {
+        cout << "FAILED" << endl;
+        return 1;
+    }
+    cout << "PASSED" << endl;
+    return 0;
+}
@@ -0,0 +1,97 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Profile of the SSFM: prints where the time of fiberTransmit goes for the field of
+ * files/field.txt, with and without polarization coupling, and checks the counts of
+ * the phases against the counters of Out.
+ */
+
+#include <SimuLib>
+#include <fstream>
+#include <iomanip>
+
+using namespace SimuLib;
+
+VectorXcd readField() {
+    ifstream infile;
+    infile.open("../files/field.txt");
+
+    VectorXcd vec(32768);
+    for (Index i = 0; i < vec.size(); ++i) {
+        infile >> vec[i];
+    }
+    infile.close();
+    return vec;
+}
+
+// Prints the phases of the profile and returns true if their counts match OUT
+bool report(const string &name, const Out &out) {
+    const SsfmProfile &profile = out.profile;
+    vector<pair<string, SsfmPhase>> phases = {{"fft", profile.fft},
+                                              {"ifft", profile.ifft},
+                                              {"dispersion", profile.dispersion},
+                                              {"exponential", profile.exponential},
+                                              {"nonlinear", profile.nonlinear},
+                                              {"step control", profile.stepControl},
+                                              {"check step", profile.checkStep}};
+    cout << name << ": " << out.time * 1e3 << " ms, " << out.nCycle << " steps" << endl;
+    unsigned long long total = 0;
+    for (const auto &phase: phases) {
+        cout << "  " << left << setw(14) << phase.first << right << setw(10) << fixed << setprecision(3) << phase.second.time * 1e-6 << " ms"
+             << setw(8) << phase.second.count << " calls" << endl;
+        cout.unsetf(ios::fixed);
+        total += phase.second.time;
+    }
+    total -= profile.exponential.time;  // within the dispersion phase
+    cout << "  " << left << setw(14) << "other" << right << setw(10) << fixed << setprecision(3) << (out.time * 1e9 - total) * 1e-6 << " ms" << endl;
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+
+    return profile.fft.count == out.nFft && profile.ifft.count == out.nIfft && profile.exponential.count == out.nDispersionMisses &&
+           profile.nonlinear.count == out.nCycle && total <= out.time * 1e9;
+}
+
+int main() {
+    initGstate(32768, 320);
+    E input;
+    input.field = readField() * 4;
+    input.lambda.resize(1, 1);
+    input.lambda(0, 0) = 1550;
+
+    Fiber fiber;
+    fiber.length         = 100000;
+    fiber.attenuation    = 0.2;
+    fiber.nonlinearIndex = 2.5e-20;
+    SsfmWorkspace workspace;
+    E e           = input;
+    bool isPassed = report("scalar", fiberTransmit(e, fiber, workspace));
+
+    E dual;
+    dual.field         = MatrixXcd::Zero(32768, 2);
+    dual.field.col(0)  = input.field;
+    dual.lambda        = input.lambda;
+    fiber.isDual       = true;
+    fiber.isManakov    = true;
+    fiber.pmdParameter = 0.5;
+    fiber.beatLength   = 23;
+    fiber.coupling     = "pol";
+    isPassed           = report("PMD", fiberTransmit(dual, fiber, workspace)) && isPassed;
+
+    if (!isPassed) {
+        cout << "FAILED" << endl;
+        return 1;
+    }
+    cout << "PASSED" << endl;
+    return 0;
+}
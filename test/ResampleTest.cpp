@@ -0,0 +1,124 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+
+/**
+ * Resampling around the fiber on the transmitter of example/Example.cpp, 32 samples
+ * per symbol: without Kerr effect the output misses only the filtered energy, with
+ * it the output stays close to the one at the full rate and the propagation is
+ * faster; gstate is restored and fiberResume follows the propagation grid. Prints
+ * the propagation rate and the speed-up.
+ */
+
+#include <SimuLib>
+#include <chrono>
+#include <cstdio>
+
+using namespace SimuLib;
+
+// Field of the transmitter of example/Example.cpp at POWERDBM [dBm]
+E transmitter(int nSymbol, int symbolRate, double powerDBM) {
+    Par par{};
+    par.rolloff      = 0.3;
+    par.emph         = "asin";
+    string modFormat = "qpsk";
+    RowVectorXd lambda(1);
+    lambda << 1550;
+    RowVectorXd pLin(1);
+    pLin << pow(10, powerDBM / 10);
+    LaserOption laserOption{};
+    laserOption.pol = LaserOption::single;
+    laserOption.n0  = 0.5;
+    E e             = CPU::laserSource(pLin, lambda, laserOption);
+
+    string array[2] = {"alpha", modFormat};
+    VectorXi pattern;
+    MatrixXi patternBinary;
+    tie(pattern, patternBinary) = CPU::genPattern(nSymbol, "rand", array);
+    MatrixXcd signal;
+    double norm, gain;
+    tie(signal, norm) = CPU::digitalModulator(pattern, symbolRate, par, modFormat, "rootrc");
+    tie(signal, gain) = CPU::electricAmplifier(signal, 5, 1, 10.0e-12);
+    return CPU::mzModulator(e, signal);
+}
+
+// Best times [s] of a few fiberTransmit calls through FIBER and OTHER, alternated
+tuple<double, double> compareTimes(const E &input, const Fiber &fiber, const Fiber &other) {
+    const int RUNS = 5;
+    SsfmWorkspace workspace;
+    double best[2] = {INFINITY, INFINITY};
+    for (int i = 0; i < 2 * RUNS; ++i) {
+        E e                                    = input;
+        chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+        fiberTransmit(e, i % 2 ? other : fiber, workspace);
+        best[i % 2] = min(best[i % 2], chrono::duration<double>(chrono::steady_clock::now() - begin).count());
+    }
+    return make_tuple(best[0], best[1]);
+}
+
+int main() {
+    int nSymbol    = 1024;
+    int nt         = 32;
+    int symbolRate = 10;
+    initGstate(nSymbol * nt, symbolRate * nt);
+    E input = transmitter(nSymbol, symbolRate, 3);
+    SsfmWorkspace workspace;
+
+    // Linear fiber, as in example/Example.cpp
+    Fiber linear;
+    Fiber resampled       = linear;
+    resampled.isResampled = true;
+    E full                = input;
+    E e                   = input;
+    fiberTransmit(full, linear, workspace);
+    Out out            = fiberTransmit(e, resampled, workspace);
+    double linearError = (e.field - full.field).norm() / full.field.norm();
+    bool isPassed      = e.field.rows() == input.field.rows() && gstate.NSAMP == (unsigned long) (nSymbol * nt) && gstate.SAMP_FREQ == symbolRate * nt &&
+                    linearError <= sqrt(resampled.resampleTolerance);
+    cout << "Linear fiber: propagation at " << out.samplingRate << " GHz, error " << linearError << endl;
+
+    // Nonlinear fiber
+    Fiber fiber;
+    fiber.length          = 100000;
+    fiber.attenuation     = 0.2;
+    fiber.nonlinearIndex  = 2.5e-20;
+    resampled             = fiber;
+    resampled.isResampled = true;
+    full                  = input;
+    e                     = input;
+    Out fullOut           = fiberTransmit(full, fiber, workspace);
+    out                   = fiberTransmit(e, resampled, workspace);
+    double error          = (e.field - full.field).norm() / full.field.norm();
+    double fullTime, resampledTime;
+    tie(fullTime, resampledTime) = compareTimes(input, fiber, resampled);
+    cout << "Nonlinear fiber: " << fullOut.nCycle << " steps at " << fullOut.samplingRate << " GHz, " << out.nCycle << " steps at " << out.samplingRate
+         << " GHz, error " << error << ", speed-up " << fullTime / resampledTime << endl;
+    isPassed = isPassed && out.samplingRate < fullOut.samplingRate / 2 && error < 1e-2 && resampledTime < fullTime;
+
+    // Resume on the propagation grid
+    resampled.checkpointFile  = "ResampleTest.ckpt";
+    resampled.checkpointSteps = 4;
+    E checkpointed            = input;
+    fiberTransmit(checkpointed, resampled, workspace);
+    E resumed = input;
+    fiberResume(resumed, resampled, workspace);
+    remove(resampled.checkpointFile.c_str());
+    isPassed = isPassed && resumed.field == checkpointed.field && checkpointed.field == e.field;
+
+    if (!isPassed) {
+        cout << "FAILED" << endl;
+        return 1;
+    }
+    cout << "PASSED" << endl;
+    return 0;
+}
@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * RK4IP ("rk4ip" step type) against the SSFM with fixed symmetric steps on the field
+ * of files/field.txt at high power: the symmetric SSFM converges to the RK4IP
+ * reference, and at matched accuracy RK4IP takes fewer steps. Prints the wall time of
+ * both at matched accuracy. In dual polarization, RK4IP agrees with the local error
+ * method.
+ */
+
+#include <SimuLib>
+#include <fstream>
+
+using namespace SimuLib;
+
+VectorXcd readField() {
+    ifstream infile;
+    infile.open("../files/field.txt");
+
+    VectorXcd vec(32768);
+    for (Index i = 0; i < vec.size(); ++i) {
+        infile >> vec[i];
+    }
+    infile.close();
+    return vec;
+}
+
+Fiber testFiber() {
+    Fiber fiber;
+    fiber.length         = 20000;
+    fiber.attenuation    = 0.2;
+    fiber.nonlinearIndex = 2.5e-20;
+    return fiber;
+}
+
+double relativeError(const E &e, const E &reference) {
+    return (e.field - reference.field).norm() / reference.field.norm();
+}
+
+int main() {
+    initGstate(32768, 320);
+    E input;
+    input.field = readField() * 8;  // 130 mW peak power
+    input.lambda.resize(1, 1);
+    input.lambda(0, 0) = 1550;
+    SsfmWorkspace workspace;
+
+    E reference          = input;
+    Fiber fiber          = testFiber();
+    fiber.stepType       = "rk4ip";
+    fiber.errorTolerance = 1e-10;
+    Out referenceOut     = fiberTransmit(reference, fiber, workspace);
+
+    E rk4ip              = input;
+    fiber.errorTolerance = 1e-7;
+    Out rk4ipOut         = fiberTransmit(rk4ip, fiber, workspace);
+    double rk4ipError    = relativeError(rk4ip, reference);
+    cout << "RK4IP: " << rk4ipOut.nCycle << " steps (" << rk4ipOut.nRejected << " rejected), " << rk4ipOut.nFft + rk4ipOut.nIfft << " FFTs, error "
+         << rk4ipError << ", " << rk4ipOut.time * 1e3 << " ms" << endl;
+
+    // Symmetric steps halved down to the accuracy of RK4IP: second order convergence
+    // to the reference
+    bool isPassed    = referenceOut.nRejected * 10 < referenceOut.nCycle && rk4ipError < 1e-5;
+    double lastError = INFINITY;
+    Out ssfmOut;
+    double ssfmError;
+    for (double step = 200; step >= 12.5; step /= 2) {
+        E ssfm              = input;
+        fiber               = testFiber();
+        fiber.stepUpdate    = "nlp";
+        fiber.stepType      = "symm";
+        fiber.maxStepLength = step;
+        ssfmOut             = fiberTransmit(ssfm, fiber, workspace);
+        ssfmError           = relativeError(ssfm, reference);
+        cout << "Symmetric steps of " << step << " m: " << ssfmOut.nCycle << " steps, " << ssfmOut.nFft + ssfmOut.nIfft << " FFTs, error " << ssfmError
+             << ", " << ssfmOut.time * 1e3 << " ms" << endl;
+        isPassed  = isPassed && ssfmError * 3 < lastError;
+        lastError = ssfmError;
+        if (ssfmError <= rk4ipError)
+            break;
+    }
+    cout << "At matched accuracy RK4IP takes " << ssfmOut.time / rk4ipOut.time << " times less than the symmetric SSFM" << endl;
+    isPassed = isPassed && ssfmError <= rk4ipError && rk4ipOut.nCycle * 2 < ssfmOut.nCycle;
+
+    // Dual polarization: RK4IP against the local error method
+    E dual;
+    dual.field           = MatrixXcd::Zero(32768, 2);
+    dual.field.col(0)    = input.field;
+    dual.field.col(1)    = input.field.reverse();
+    dual.lambda          = input.lambda;
+    E dualLem            = dual;
+    fiber                = testFiber();
+    fiber.length         = 5000;
+    fiber.isDual         = true;
+    fiber.isManakov      = true;
+    fiber.stepType       = "rk4ip";
+    fiber.errorTolerance = 1e-8;
+    Out dualOut          = fiberTransmit(dual, fiber, workspace);
+    fiber.stepType       = "";
+    fiber.stepUpdate     = "lem";
+    fiberTransmit(dualLem, fiber, workspace);
+    double dualDifference = relativeError(dual, dualLem);
+    cout << "Dual polarization: RK4IP " << dualOut.nCycle << " steps, difference from the local error method " << dualDifference << endl;
+    isPassed = isPassed && dualDifference < 1e-5;
+
+    if (!isPassed) {
+        cout << "FAILED" << endl;
+        return 1;
+    }
+    cout << "PASSED" << endl;
+    return 0;
+}
@@ -0,0 +1,73 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Checks that the SSFM step loop does no heap allocation once the workspace is sized:
+ * two runs that only differ in the number of steps must allocate the same number of times.
+ */
+
+#include <SimuLib>
+#include <atomic>
+#include <cstdlib>
+
+using namespace SimuLib;
+
+static std::atomic<unsigned long> allocations(0);
+
+#ifdef __GLIBC__
+// Eigen and operator new both end up in malloc, so counting it covers every heap allocation
+extern "C" void *__libc_malloc(size_t size);
+
+extern "C" void *malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+#endif
+
+tuple<unsigned long, unsigned long> countAllocations(E &e, const Fiber &fiber, SsfmWorkspace &workspace) {
+    unsigned long before = allocations;
+    Out out              = fiberTransmit(e, fiber, workspace);
+    return make_tuple(allocations - before, out.nCycle);
+}
+
+int main() {
+    initGstate(1024, 320);
+
+    E e;
+    e.field = VectorXcd::Random(1024);
+    e.lambda.resize(1, 1);
+    e.lambda(0, 0) = 1550;
+
+    Fiber fiber;
+    fiber.length         = 10000;
+    fiber.attenuation    = 0.2;
+    fiber.nonlinearIndex = 2.5e-20;
+
+    SsfmWorkspace workspace;
+    fiberTransmit(e, fiber, workspace);  // size the workspace
+
+    unsigned long fewAllocs, fewSteps, manyAllocs, manySteps;
+    fiber.maxStepLength        = 1000;
+    tie(fewAllocs, fewSteps)   = countAllocations(e, fiber, workspace);
+    fiber.maxStepLength        = 50;
+    tie(manyAllocs, manySteps) = countAllocations(e, fiber, workspace);
+
+    cout << fewSteps << " steps: " << fewAllocs << " allocations" << endl;
+    cout << manySteps << " steps: " << manyAllocs << " allocations" << endl;
+    if (manySteps <= fewSteps || manyAllocs != fewAllocs) {
+        cout << "FAILED: the step loop allocates" << endl;
+        return 1;
+    }
+    cout << "PASSED" << endl;
+    return 0;
+}
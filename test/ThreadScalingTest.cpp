@@ -0,0 +1,112 @@
+/**
+ * Copyright (c) 2022 Beijing Jiaotong University
+ * OpticaLab is licensed under [Open Source License].
+ * You can use this software according to the terms and conditions of the [Open Source License].
+ * You may obtain a copy of [Open Source License] at: [https://open.source.license/]
+ *
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+ *
+ * See the [Open Source License] for more details.
+ */
+
+/**
+ * Threads of the SSFM: fiberTransmit gives the same field, bit for bit, from 1 to N
+ * threads of setNumThreads, for a scalar field of one column, a dual-polarization
+ * field and a batch of dual-polarization realizations. PMD is left out: its waveplates
+ * are drawn again by each call. Prints the time and the speed-up of each number of
+ * threads, up to one per processor and at least 4.
+ */
+
+#include <SimuLib>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <thread>
+
+using namespace SimuLib;
+
+VectorXcd readField() {
+    ifstream infile;
+    infile.open("../files/field.txt");
+
+    VectorXcd vec(32768);
+    for (Index i = 0; i < vec.size(); ++i) {
+        infile >> vec[i];
+    }
+    infile.close();
+    return vec;
+}
+
+// Propagates INPUT through FIBER with 1 to MAXTHREADS threads, the best of a few runs
+// each, and returns true if all the outputs are those of one thread
+bool scaling(const string &name, const E &input, const Fiber &fiber, int maxThreads) {
+    const int RUNS = 2;
+    SsfmWorkspace workspace;
+    MatrixXcd reference;
+    double serialTime = 0;
+    bool isSame       = true;
+    cout << name << ":" << endl;
+    for (int threads = 1; threads <= maxThreads; ++threads) {
+        setNumThreads(threads);
+        double best = INFINITY;
+        E e;
+        for (int r = 0; r < RUNS; ++r) {
+            e    = input;
+            best = min(best, fiberTransmit(e, fiber, workspace).time);
+        }
+        if (threads == 1) {
+            reference  = e.field;
+            serialTime = best;
+        }
+        bool isEqual = e.field == reference;
+        isSame       = isSame && isEqual;
+        cout << "  " << setw(3) << threads << " threads: " << setw(9) << best * 1e3 << " ms, speed-up " << setw(5) << serialTime / best
+             << (isEqual ? "" : ", output differs") << endl;
+    }
+    return isSame;
+}
+
+int main() {
+    int maxThreads = max(4, (int) thread::hardware_concurrency());
+    VectorXcd field = readField() * 4;
+
+    // One column of 2^18 samples: the threads share the chunks of the column
+    initGstate(262144, 320);
+    E scalar;
+    scalar.field = field.replicate(8, 1);
+    scalar.lambda.resize(1, 1);
+    scalar.lambda(0, 0) = 1550;
+    Fiber fiber;
+    fiber.length         = 20000;
+    fiber.attenuation    = 0.2;
+    fiber.nonlinearIndex = 2.5e-20;
+    bool isPassed        = scaling("scalar, 2^18 samples", scalar, fiber, maxThreads);
+
+    // Dual polarization, and 8 realizations of it
+    initGstate(32768, 320);
+    E dual;
+    dual.field        = MatrixXcd::Zero(32768, 2);
+    dual.field.col(0) = field;
+    dual.field.col(1) = field * complex<double>(0, 0.3);
+    dual.lambda       = scalar.lambda;
+    fiber.isDual      = true;
+    fiber.isManakov   = true;
+    isPassed          = scaling("dual polarization", dual, fiber, maxThreads) && isPassed;
+
+    E batch;
+    batch.field  = dual.field.replicate(1, 8);
+    batch.lambda = scalar.lambda;
+    isPassed     = scaling("8 realizations", batch, fiber, maxThreads) && isPassed;
+
+    setNumThreads(0);
+    cout << "threads by default: " << getNumThreads() << endl;
+
+    if (!isPassed) {
+        cout << "FAILED" << endl;
+        return 1;
+    }
+    cout << "PASSED" << endl;
+    return 0;
+}